@@ -6,6 +6,12 @@
 #include <arpa/inet.h> // IP地址转换: inet_pton
 #include <unistd.h> // POSIX系统服务 close(), read(), write() sleep(), getpid()
 #include <poll.h>            // poll系统调用头文件，用于I/O多路复用
+#include <string>
+#include "../../common/frame_codec.hpp"  // 长度前缀分帧
+
+// 用法: ./poll_clientTCP [framed]
+//   framed : 与 ./poll_serverTCP ... framed 配合使用，每行输入按';'拆成多条消息，
+//            分别加上长度前缀后一次发送(流水线)，服务器的回复逐帧解析后打印
 
 
 // 信号处理：退出进程
@@ -19,7 +25,9 @@ const char* SERVER_IP = "127.0.0.1";
 const int PORT = 8080;
 const int BUFFER_SIZE = 1024;
 
-int main(){
+int main(int argc, char* argv[]){
+    bool framed = argc > 1 && std::string(argv[1]) == "framed";
+
     // 1. 创建TCP嵌套字
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if(sock == -1){
@@ -70,11 +78,32 @@ int main(){
     fds[1].revents = 0;     // 保存poll返回的事件
 
     
+    // 发送一行输入，分帧模式下按';'拆成多帧合并到一次send中
+    ConnBuffer out;
+    auto send_message = [&](const std::string& line) -> ssize_t {
+        if(!framed) return send(sock, line.c_str(), line.size(), 0);
+        size_t start = 0;
+        while(start <= line.size()){
+            size_t end = line.find(';', start);
+            if(end == std::string::npos) end = line.size();
+            if(end > start) encode_frame(out, line.data() + start, end - start);
+            start = end + 1;
+        }
+        ssize_t total = out.size();
+        while(!out.empty()){
+            if(out.write_to(sock) < 0 && errno != EINTR) return -1;
+        }
+        out.shrink();
+        return total;
+    };
+
     // 4. 数据交互
     char buffer[BUFFER_SIZE] = {0};
+    ConnBuffer in;
+    FrameDecoder decoder;
     std::string message;
     message = "Hello, server!";
-    send(sock, message.c_str(), message.size(), 0);
+    send_message(message);
     while(!stop_client){
         // 调用poll函数，等待事件发生
         int acitvity = poll(fds, 2, 500);
@@ -97,7 +126,7 @@ int main(){
             }
             if(message.empty()) continue;// 检查消息是否为空
 
-            ssize_t send_len = send(sock, message.c_str(), message.size(), 0);
+            ssize_t send_len = send_message(message);
             if(send_len > 0){
                 std::cout << "Message send" << std::endl;
                 std::cout << "> " << std::flush;
@@ -119,9 +148,28 @@ int main(){
 
         // 检查套接字是否有数据可读
         if(fds[1].revents & POLL_IN){
+            if(framed){
+                ssize_t valrecv = in.read_from(sock);
+                if(valrecv > 0){
+                    std::string_view reply;
+                    while(decoder.next(in, reply) == FrameDecoder::FRAME){
+                        std::cout << "\nReceived: " << reply;
+                    }
+                    std::cout << std::endl << "> " << std::flush;
+                    continue;
+                }
+                else if(valrecv == 0){
+                    perror("Connection closed");
+                    break;
+                }
+                if(errno == EINTR) continue;
+                perror("Receive Failed");
+                continue;
+            }
+
             // 清空缓冲区
             memset(buffer, 0, BUFFER_SIZE);
-            ssize_t valrecv = recv(sock, buffer, BUFFER_SIZE, 0);
+            ssize_t valrecv = recv(sock, buffer, BUFFER_SIZE - 1, 0);
             if(valrecv > 0){
                 buffer[valrecv] = '\0';
                 std::cout << "\nReceived: " << buffer << std::endl;
@@ -9,37 +9,148 @@
 #include <csignal>           // 信号处理头文件，用于捕获和处理信号，如SIGINT、SIGQUIT等
 #include <atomic>            // 原子操作头文件，用于实现线程安全的计数器
 #include <fcntl.h>           // 文件控制操作，用于设置文件描述符属性
+#include <algorithm>         // std::max
+#include <string>            // 字符串类，用于解析命令行参数
+#include <cctype>            // isdigit，判断位置参数是否为数字
+#include <cstdlib>           // strtoul
+#include <thread>            // C++11线程库，多reactor模式下每个事件循环一个线程
+#include <chrono>            // 热重启排空的截止时间
+#ifdef __linux__
+#include <sys/epoll.h>       // epoll系统调用头文件，仅Linux可用
+#endif
+#include "../../common/cpu_affinity.hpp"  // 线程绑核
+#include "../../common/conn_buffer.hpp"   // 按大小分级复用的连接缓冲区
+#include "../../common/frame_codec.hpp"   // 长度前缀分帧
+#include "../../common/out_queue.hpp"     // writev批量发送的发送队列
+#include "../../common/timer_wheel.hpp"   // 连接超时定时器
+#include "../../common/wakeup.hpp"        // 退出通知和signalfd
+#include "../../common/uring_loop.hpp"    // io_uring事件循环
+#include "../../common/zero_copy.hpp"     // 大响应的sendfile/MSG_ZEROCOPY发送
+#ifdef __linux__
+#include "../../common/hot_restart.hpp"   // 热重启时交出监听socket
+#endif
+
+// 用法: ./poll_serverTCP [poll|epoll|uring] [reactors] [framed] [file=路径] [copy|sendfile|zerocopy]
+//   poll     : 默认模式，每次唤醒都线性扫描整个pollfd数组，代价为O(总连接数)
+//   epoll    : 边缘触发(ET)模式，每次唤醒只返回就绪的socket，代价为O(就绪连接数)
+//   uring    : io_uring模式，不再等待"就绪"再调用accept/recv/send，而是把操作本身提交给内核：
+//              一个多shot accept接受所有新连接，每个连接一个多shot recv从共享的提供缓冲区环中取缓冲区，
+//              回复用sendmsg发出；一轮循环积累的所有提交和完成只需要一次io_uring_enter
+//              内核不支持(或io_uring被禁用)时回退到epoll模式
+//   reactors : 事件循环线程数，默认1；0表示CPU核数
+//              大于1时每个线程绑定一个CPU，各自拥有一个SO_REUSEPORT监听socket和独立的连接表，
+//              由内核按四元组哈希把新连接分散到各个监听socket上，accept和I/O都不再经过单个线程
+//   framed   : 消息使用varint长度前缀分帧(见common/frame_codec.hpp)，客户端可以连续发送多条请求而不等回复，
+//              一次recv中的所有请求处理完后，所有回复合并成一次writev；默认每次recv到的数据当作一条消息
+//   file=路径 : 回复改为该文件的全部内容(分帧模式下加长度前缀)，用来测试大响应；文件启动时映射，服务期间不能修改
+//   copy|sendfile|zerocopy : 文件内容的发送方式，默认sendfile(见common/zero_copy.hpp)：
+//              copy为和普通回复一样writev拷贝；zerocopy为send(MSG_ZEROCOPY)，完成通知从错误队列(POLLERR)取走；
+//              io_uring模式下文件内容总是按映射的内存用sendmsg发送
+//
+// 回复先进入每个连接的发送队列，写不完时才监听可写事件(POLLOUT/EPOLLOUT)，队列写空后立即取消；
+// 队列积压超过OUTPUT_HIGH_WATERMARK时暂停读取该连接，直到对端把回复读走(背压)
+//
+// 每个连接一个定时器，放在事件循环自己的时间轮中，每次处理完连接的事件后重新设置：
+// 有回复没写完时为写超时，收到了不完整的请求时为读超时，否则为空闲超时；到期后关闭连接
+// poll/epoll_wait的超时取时间轮中最近的到期时间，没有定时器时无限等待，而不是固定周期轮询
+//
+// 所有事件循环都在工作线程中运行，主线程屏蔽SIGINT/SIGTERM/SIGUSR2并阻塞在signalfd上，
+// 收到退出信号后通过stop_wakeup唤醒所有事件循环
+//
+// 热重启(Linux): 向服务器进程发送SIGUSR2，它以同样的参数exec启动时的程序文件，并把所有监听socket
+// 交给新进程(见common/hot_restart.hpp)；新进程的事件循环启动后，旧进程通过drain_wakeup通知各个事件循环
+// 停止accept，已有的连接照常处理到对端关闭，全部结束或DRAIN_TIMEOUT_MS到期后退出；
+// 监听socket始终没有关闭，升级期间不会有被拒绝或重置的连接。新进程启动失败时旧进程继续服务
 
 
 const int PORT = 8080;  // 服务器监听端口
-const int BUFFER_SIZE = 1024;  // 缓冲区大小
-const int MAX_CLIENTS = 10;  // 最大客户端连接数
+const int LISTEN_BACKLOG = SOMAXCONN;  // 已完成连接队列的最大长度
+const int MAX_EVENTS = 1024;  // epoll_wait单次最多返回的事件数
+const size_t OUTPUT_HIGH_WATERMARK = 256 * 1024;  // 发送队列超过该值时暂停读取
+const char* const RESPONSE = "Response from Server";
+StaticFile response_file;                   // 指定了file=时作为回复发送
+SendMode response_send = SendMode::SENDFILE;  // 文件内容的发送方式
+const uint64_t IDLE_TIMEOUT_MS = 60 * 1000;   // 没有未完成的请求和回复时的空闲超时
+const uint64_t READ_TIMEOUT_MS = 10 * 1000;   // 请求只收到一部分时，等待剩余部分的超时
+const uint64_t WRITE_TIMEOUT_MS = 10 * 1000;  // 回复写不出去(对端不读)时的超时
+const unsigned URING_ENTRIES = 1024;           // io_uring提交队列大小
+const unsigned RECV_BUFFER_COUNT = 1024;       // 每个事件循环的接收缓冲区个数(2的幂)
+const size_t RECV_BUFFER_SIZE = 4096;          // 每个接收缓冲区的大小
+const int HOT_RESTART_TIMEOUT_MS = 10 * 1000;  // 等待新进程就绪的最长时间
+const int DRAIN_TIMEOUT_MS = 30 * 1000;        // 热重启后等待已有连接结束的最长时间，到期后关闭剩余连接
 
 std::atomic<bool> _running{false};
-void signalHandler() {
-    struct sigaction sa;
-    sa.sa_flags = SA_RESTART; // 设置信号处理标志，使被中断的系统调用自动重启
-    sa.sa_handler = [](int signal) {
-        if (signal == SIGINT || signal == SIGTERM) {
-            std::cout << "[INFO] " << "收到退出信号: " << signal
-                        << " 正在关闭服务器..." << std::endl;
-            _running.store(false);
-            return;
-        }
-        std::cout << "[INFO] " << "收到信号: " << signal << std::endl;
-    };
+WakeupChannel stop_wakeup;   // 退出时notify一次且不drain，所有事件循环都会被唤醒
+WakeupChannel drain_wakeup;  // 热重启时notify一次且不drain，事件循环收到后停止accept并不再监听它
+WakeupChannel loops_done;    // 最后一个事件循环退出时notify
+std::atomic<unsigned> _active_loops{0};
 
-    sigemptyset(&sa.sa_mask); // 清空信号集
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP; // 设置信号处理标志
-
-    sigaction(SIGINT, &sa, NULL); // 捕获SIGINT信号
-    sigaction(SIGTERM, &sa, NULL); // 捕获SIGTERM信号
-    signal(SIGPIPE, SIG_IGN); // 忽略SIGPIPE信号
+// 主线程等待信号：SIGINT/SIGTERM时通知所有事件循环退出；
+// SIGUSR2时热重启，新进程接管监听socket后通知事件循环停止accept，等待已有连接结束(最长DRAIN_TIMEOUT_MS)
+// 所有事件循环都已经退出时(启动失败或排空完成)直接返回
+void wait_for_shutdown(const SignalChannel& signals, const std::vector<int>& listen_fds, char* argv[]) {
+#ifndef __linux__
+    (void)listen_fds;
+    (void)argv;
+#endif
+    pollfd pfds[2] = {{signals.fd(), POLLIN, 0}, {loops_done.fd(), POLLIN, 0}};
+    bool draining = false;
+    auto deadline = std::chrono::steady_clock::now();
+    while(true) {
+        int timeout = -1;
+        if(draining) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<long long>(0, left.count()));
+        }
+        int ready = poll(pfds, 2, timeout);
+        if(ready < 0 && errno != EINTR) {
+            std::cerr << "[ERROR] ";
+            perror("Poll Signal Failed");
+            break;
+        }
+        if(ready == 0) {
+            std::cout << "[INFO] " << "排空超时，关闭剩余连接" << std::endl;
+            break;
+        }
+        if(pfds[1].revents & POLLIN) break;
+        int sig;
+        bool stop = false;
+        while((sig = signals.next()) != 0) {
+            if(sig == SIGINT || sig == SIGTERM) {
+                std::cout << "[INFO] " << "收到退出信号: " << sig << " 正在关闭服务器..." << std::endl;
+                stop = true;
+            }
+#ifdef __linux__
+            else if(sig == SIGUSR2 && !draining) {
+                std::cout << "[INFO] " << "收到SIGUSR2，热重启: " << executable_path() << std::endl;
+                pid_t pid;
+                if(hot_restart(listen_fds, argv, HOT_RESTART_TIMEOUT_MS, pid)) {
+                    std::cout << "[INFO] " << "新进程 " << pid << " 已接管监听socket，停止接受新连接，等待已有连接结束" << std::endl;
+                    draining = true;
+                    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+                    drain_wakeup.notify();
+                }
+                else {
+                    std::cerr << "[ERROR] ";
+                    perror("Hot Restart Failed");
+                    std::cout << "[INFO] " << "继续服务" << std::endl;
+                }
+            }
+#endif
+            else {
+                std::cout << "[INFO] " << "收到信号: " << sig << std::endl;
+            }
+        }
+        if(stop) break;
+    }
+    _running.store(false);
+    stop_wakeup.notify();
 }
 
 
-int main() {
-    signalHandler();
+// 创建监听socket: 设置地址重用、绑定端口并开始监听，失败返回-1
+// reuse_port为true时设置SO_REUSEPORT，允许多个socket绑定同一端口
+int create_listen_socket(bool reuse_port = false) {
     // 1. 创建监听socket
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -56,6 +167,12 @@ int main() {
         close(server_fd);
         return -1;
     }
+    if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        std::cerr << "[ERROR] ";
+        perror("Setsockopt SO_REUSEPORT Failed");
+        close(server_fd);
+        return -1;
+    }
 
     // 3. 绑定地址和端口
     sockaddr_in server_addr{};
@@ -70,28 +187,185 @@ int main() {
     }
 
     // 4. 监听连接
-    if(listen(server_fd, MAX_CLIENTS) < 0) {
+    if(listen(server_fd, LISTEN_BACKLOG) < 0) {
         std::cerr << "[ERROR] ";
         perror("Listen Failed");
         close(server_fd);
         return -1;
     }
-    std::cout << "[INFO] " << "服务器进程: " << getpid() << std::endl;
-    std::cout << "[INFO] " << "服务器已启动，监听端口 " << PORT << std::endl;
+    return server_fd;
+}
+
+
+// 每个连接的状态，与pollfd数组按槽位(slot)一一对应
+struct Connection {
+    sockaddr_in addr{};   // 客户端地址，用于日志输出
+    ConnBuffer in;        // 已收到但还没处理的数据，没有数据时不占用缓冲区
+    OutQueue out;         // 还没写出的回复
+    bool throttled = false;  // epoll模式：因背压停止读取时socket中可能还有数据，队列降下来后要主动继续读
+    bool want_out = false;   // epoll模式：当前是否注册了EPOLLOUT
+    TimerWheel::TimerId timer = TimerWheel::INVALID_TIMER;  // 读/写/空闲超时
+};
+
+// 连接表
+// pollfd数组始终保持稠密，可以直接交给poll()；删除时把最后一个元素交换到被删除的槽位，
+// 再用slot_of_fd_反查fd所在的槽位，所以接入和关闭都是O(1)，不会像erase那样移动后面所有元素
+class ConnectionTable {
+private:
+    std::vector<pollfd> fds_;         // 交给内核的pollfd数组
+    std::vector<Connection> conns_;   // 与fds_平行的连接状态数组
+    std::vector<int> slot_of_fd_;     // fd -> 槽位，-1表示该fd不在表中
+
+public:
+    static constexpr int NO_SLOT = -1;
+
+    // 添加一个fd，返回它所在的槽位
+    size_t add(int fd, short events, const sockaddr_in& addr = sockaddr_in{}) {
+        size_t slot = fds_.size();
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        fds_.push_back(pfd);
+        conns_.emplace_back();
+        conns_.back().addr = addr;
+
+        if(static_cast<size_t>(fd) >= slot_of_fd_.size()) {
+            slot_of_fd_.resize(fd + 1, NO_SLOT);
+        }
+        slot_of_fd_[fd] = static_cast<int>(slot);
+        return slot;
+    }
+
+    // 移除槽位上的连接：与最后一个元素交换后弹出
+    void remove(size_t slot) {
+        size_t last = fds_.size() - 1;
+        slot_of_fd_[fds_[slot].fd] = NO_SLOT;
+        if(slot != last) {
+            fds_[slot] = fds_[last];
+            conns_[slot] = std::move(conns_[last]);
+            slot_of_fd_[fds_[slot].fd] = static_cast<int>(slot);
+        }
+        fds_.pop_back();
+        conns_.pop_back();
+    }
+
+    // 查找fd所在的槽位，不存在返回NO_SLOT
+    int slot_of(int fd) const {
+        if(fd < 0 || static_cast<size_t>(fd) >= slot_of_fd_.size()) return NO_SLOT;
+        return slot_of_fd_[fd];
+    }
+
+    pollfd* data() { return fds_.data(); }
+    size_t size() const { return fds_.size(); }
+    pollfd& pfd(size_t slot) { return fds_[slot]; }
+    Connection& conn(size_t slot) { return conns_[slot]; }
+};
+
+
+// 排入一条回复的内容：指定了文件时为整个文件，否则为RESPONSE
+void queue_response(Connection& conn) {
+    if(response_file.valid()) conn.out.push_file(response_file, response_send);
+    else conn.out.push_ref(RESPONSE, strlen(RESPONSE));
+}
+
+// 处理连接已收到的数据，回复排入conn.out，返回false表示应当关闭连接
+// 默认把收到的数据整体当作一条消息；分帧模式下取出所有完整的帧，每帧一条回复，
+// 不完整的帧留在conn.in中等待后续数据
+bool process_input(int fd, Connection& conn, bool framed) {
+    if(!framed) {
+        std::cout << "[INFO] " << "客户端消息: ";
+        std::cout.write(conn.in.data(), conn.in.size()) << std::endl;
+        conn.in.consume(conn.in.size());
+        conn.in.shrink();
+        queue_response(conn);
+        return true;
+    }
+
+    FrameDecoder decoder;
+    std::string_view message;
+    FrameDecoder::Status status;
+    size_t response_len = response_file.valid() ? response_file.size() : strlen(RESPONSE);
+    char header[FrameDecoder::MAX_VARINT];
+    size_t header_len = encode_varint(static_cast<uint32_t>(response_len), header);
+    while((status = decoder.next(conn.in, message)) == FrameDecoder::FRAME) {
+        std::cout << "[INFO] " << "客户端消息: " << message << std::endl;
+        if(!conn.out.push_copy(header, header_len)) {
+            std::cerr << "[ERROR] " << "客户端 " << fd << " 未发送的回复过多" << std::endl;
+            return false;
+        }
+        queue_response(conn);
+    }
+    if(status == FrameDecoder::BAD_FRAME) {
+        std::cerr << "[ERROR] " << "客户端 " << fd << " 发送了非法的帧长度" << std::endl;
+        return false;
+    }
+    conn.in.shrink();
+    return true;
+}
+
+// 写出发送队列，socket缓冲区满时剩余数据留在队列中；返回false表示连接出错
+bool flush_output(int fd, Connection& conn) {
+    if(conn.out.flush(fd)) return true;
+    std::cerr << "[ERROR] ";
+    perror("Send Failed");
+    return false;
+}
+
+// 打印断开连接的客户端
+void log_disconnect(const Connection& conn, const char* reason = "已断开连接") {
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(conn.addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+    std::cout << "[INFO] " << "客户端 " << client_ip << ":"
+            << ntohs(conn.addr.sin_port) << " " << reason << std::endl;
+}
+
+// 按连接当前的状态选择下一次超时
+uint64_t connection_timeout(const Connection& conn) {
+    if(!conn.out.empty()) return WRITE_TIMEOUT_MS;
+    if(!conn.in.empty()) return READ_TIMEOUT_MS;
+    return IDLE_TIMEOUT_MS;
+}
+
+// 设置非阻塞模式，边缘触发要求所有fd都是非阻塞的
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags < 0) return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+
+// poll模式的事件循环
+void run_poll_loop(int server_fd, bool framed) {
+    // 监听socket也设为非阻塞：热重启期间新旧进程在同一个socket上accept，poll返回可读时连接可能已被对方取走
+    if(!set_nonblocking(server_fd)) {
+        std::cerr << "[ERROR] ";
+        perror("Fcntl Failed");
+        close(server_fd);
+        return;
+    }
 
     // 5. 使用poll进行I/O多路复用
-    std::vector<pollfd> fds;  // 存储pollfd结构体
+    ConnectionTable table;            // 槽位0固定为监听socket
+    table.add(server_fd, POLLIN);     // 监听可读事件
+    table.add(stop_wakeup.fd(), POLLIN);  // 槽位1固定为退出通知
+    table.add(drain_wakeup.fd(), POLLIN);  // 槽位2为热重启通知，收到后连同监听socket一起移除
+    TimerWheel timers;
+    bool draining = false;  // 监听socket已交给新进程，只处理已有的连接
 
-    pollfd server_pollfd;
-    server_pollfd.fd = server_fd;  // 监听socket
-    server_pollfd.events = POLLIN; // 监听可读事件
-    server_pollfd.revents = 0;     // 清除上一次的revents
-    fds.push_back(server_pollfd);
+    // 到期的连接直接关闭，定时器已经由时间轮释放
+    auto on_timeout = [&table](TimerWheel::TimerId, uint64_t fd) {
+        int slot = table.slot_of(static_cast<int>(fd));
+        if(slot == ConnectionTable::NO_SLOT) return;
+        log_disconnect(table.conn(slot), "超时，关闭连接");
+        close(static_cast<int>(fd));
+        table.remove(slot);
+    };
 
-    _running.store(true);
-    while(_running){
-        // 6. 等待事件
-        int activaty = poll(fds.data(), fds.size(), 1000);
+    // 排空时剩下的最后一个是退出通知，此时已有连接全部结束
+    while(_running && !(draining && table.size() == 1)){
+        // 6. 等待事件，超时时间为最近一个连接定时器的到期时间，没有定时器时无限等待
+        int activaty = poll(table.data(), table.size(), timers.next_timeout());
         if(activaty < 0) {
             if(errno == EINTR) continue; // 如果是被信号中断，则继续等待事件
             std::cerr << "[ERROR] ";
@@ -99,92 +373,604 @@ int main() {
             continue;
         }
         else if(activaty == 0) {
+            timers.advance(on_timeout);
             continue;
         }
 
-        // 7. 检查所有文件描述符
-        for(size_t i = 0; i < fds.size(); ++i){
-            if(fds[i].revents & POLLIN){
-                // 如果是监听socket有事件发生，表示有新的连接请求
-                if(fds[i].fd == server_fd){
-                    sockaddr_in client_addr;
-                    socklen_t client_addr_len = sizeof(client_addr);
-                    int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addr_len);
+        // 7. 检查文件描述符，处理完activaty个就绪的fd后提前结束扫描
+        // 关闭连接时最后一个元素会被换到当前槽位，所以此时不递增i，继续检查换过来的元素
+        int handled = 0;
+        bool start_drain = false;
+        for(size_t i = 0; i < table.size() && handled < activaty; ){
+            pollfd& pfd = table.pfd(i);
+            if(pfd.revents == 0) {
+                ++i;
+                continue;
+            }
+            ++handled;
 
-                    if(client_fd < 0) {
-                        std::cerr << "[ERROR] ";
-                        perror("Accept Failed");
-                        continue;
-                    }
+            // 退出通知：不读取，回到循环条件检查_running
+            if(pfd.fd == stop_wakeup.fd()) {
+                pfd.revents = 0;
+                ++i;
+                continue;
+            }
+            // 热重启通知：扫描结束后再移除，避免扫描过程中槽位被交换
+            if(pfd.fd == drain_wakeup.fd()) {
+                pfd.revents = 0;
+                ++i;
+                start_drain = true;
+                continue;
+            }
 
-                    // 设置非阻塞模式
-                    int flags = fcntl(client_fd, F_GETFL, 0);       // 获取当前文件描述符的标志
-                    fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);  // 设置为非阻塞模式
+            // MSG_ZEROCOPY的完成通知放在错误队列中，同样表现为POLLERR，取走通知后连接照常处理
+            if((pfd.revents & POLLERR) && table.conn(i).out.completions_only(pfd.fd)) {
+                pfd.revents &= ~POLLERR;
+            }
 
-                    // 添加新客户端到poll结构
-                    pollfd client_pollfd;
-                    client_pollfd.fd = client_fd;
-                    client_pollfd.events = POLLIN;
-                    client_pollfd.revents = 0;
-                    fds.push_back(client_pollfd);
+            // 处理错误事件
+            if(!(pfd.revents & POLLIN) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))){
+                if(pfd.fd != server_fd) {
+                    std::cerr << "[ERROR] " << "客户端 " << pfd.fd << " 发生错误或断开连接" << std::endl;
+                }
+                else {
+                    std::cerr << "[ERROR] " << "服务器发生错误或断开连接" << std::endl;
+                }
+                timers.cancel(table.conn(i).timer);
+                close(pfd.fd); // 关闭socket
+                table.remove(i); // 从poll结构中移除，槽位i现在是原来的最后一个元素
+                continue;
+            }
 
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
-                    std::cout << "[INFO] " << "客户端 " << client_ip << ":" 
-                            << ntohs(client_addr.sin_port) << " 已连接" << std::endl;
+            // 如果是监听socket有事件发生，表示有新的连接请求
+            if(pfd.fd == server_fd){
+                pfd.revents = 0;
+                ++i;
 
+                sockaddr_in client_addr;
+                socklen_t client_addr_len = sizeof(client_addr);
+                int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addr_len);
+
+                if(client_fd < 0) {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) continue;
+                    std::cerr << "[ERROR] ";
+                    perror("Accept Failed");
                     continue;
                 }
-                else{
-                    // 如果是客户端有事件发生，表示有数据可读
-                    char buffer[BUFFER_SIZE] = {0};
-                    int bytes_read = recv(fds[i].fd, buffer, BUFFER_SIZE, 0);
-                    if (bytes_read > 0){
-                        buffer[bytes_read] = '\0';
-                        std::cout << "[INFO] " << "客户端消息: " << buffer << std::endl;
-                        // 发送响应
-                        const char* response = "Response from Server";
-                        send(fds[i].fd, response, strlen(response), 0);
-                        continue;
-                    }
-                    else if(bytes_read < 0) {
+
+                // 设置非阻塞模式
+                int flags = fcntl(client_fd, F_GETFL, 0);       // 获取当前文件描述符的标志
+                fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);  // 设置为非阻塞模式
+
+                // 添加新客户端到连接表，新槽位在末尾，revents为0，本轮不会被处理
+                size_t slot = table.add(client_fd, POLLIN, client_addr);
+                table.conn(slot).timer = timers.add(IDLE_TIMEOUT_MS, client_fd);
+
+                char client_ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+                std::cout << "[INFO] " << "客户端 " << client_ip << ":" 
+                        << ntohs(client_addr.sin_port) << " 已连接" << std::endl;
+                continue;
+            }
+
+            // 客户端可写：继续发送排队的回复
+            Connection& conn = table.conn(i);
+            bool ok = true;
+            if(pfd.revents & POLLOUT) {
+                ok = flush_output(pfd.fd, conn);
+            }
+
+            // 客户端可读：读一次，处理其中所有完整的请求，回复合并后一次writev写出
+            if(ok && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+                ssize_t bytes_read = conn.in.read_from(pfd.fd);
+                if(bytes_read > 0) {
+                    ok = process_input(pfd.fd, conn, framed) && flush_output(pfd.fd, conn);
+                }
+                else if(bytes_read == 0) {
+                    log_disconnect(conn);
+                    ok = false;
+                }
+                else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "[ERROR] ";
+                    perror("Received Failed");
+                    ok = false;
+                }
+            }
+
+            if(ok) {
+                // 发送队列非空时才监听可写；积压过多时停止监听可读，让对端先把回复读走
+                pfd.events = (conn.out.bytes() < OUTPUT_HIGH_WATERMARK ? POLLIN : 0) |
+                             (conn.out.empty() ? 0 : POLLOUT);
+                pfd.revents = 0;
+                timers.reset(conn.timer, connection_timeout(conn));
+                ++i;
+                continue;
+            }
+            timers.cancel(conn.timer);
+            close(pfd.fd); // 关闭客户端socket
+            table.remove(i); // O(1)移除，不递增i
+        }
+
+        // 扫描结束后再关闭超时的连接，避免扫描过程中槽位被交换
+        timers.advance(on_timeout);
+
+        // 停止accept：监听socket已由新进程持有，这里只关闭本进程的fd，accept队列中的连接留给新进程
+        if(start_drain) {
+            table.remove(table.slot_of(drain_wakeup.fd()));
+            int slot = table.slot_of(server_fd);
+            if(slot != ConnectionTable::NO_SLOT) {
+                close(server_fd);
+                table.remove(slot);
+            }
+            draining = true;
+            std::cout << "[INFO] " << "停止接受新连接，剩余连接: " << table.size() - 1 << std::endl;
+        }
+    }
+
+    std::cout << "[INFO] " << "服务器关闭中..." << std::endl;
+
+    // 8. 关闭所有socket
+    for(size_t i = 0; i < table.size(); ++i){
+        int fd = table.pfd(i).fd;
+        if(fd != stop_wakeup.fd() && fd != drain_wakeup.fd()) close(fd);
+    }
+    std::cout << "[INFO] " << "服务器关闭所有连接" << std::endl;
+}
+
+#ifdef __linux__
+// epoll模式的事件循环 (边缘触发)
+// 边缘触发只在状态变化时通知一次，所以accept和recv都必须循环到EAGAIN为止，
+// 否则剩余的连接或数据不会再触发事件
+void run_epoll_loop(int server_fd, bool framed) {
+    // 5. 创建epoll实例
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0) {
+        std::cerr << "[ERROR] ";
+        perror("Epoll Create Failed");
+        close(server_fd);
+        return;
+    }
+
+    if(!set_nonblocking(server_fd)) {
+        std::cerr << "[ERROR] ";
+        perror("Fcntl Failed");
+        close(epoll_fd);
+        close(server_fd);
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;  // 监听socket同样使用边缘触发
+    ev.data.fd = server_fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
+        std::cerr << "[ERROR] ";
+        perror("Epoll Ctl Failed");
+        close(epoll_fd);
+        close(server_fd);
+        return;
+    }
+
+    // 退出通知和热重启通知，所有事件循环共享，只用来唤醒epoll_wait
+    for(int wakeup_fd : {stop_wakeup.fd(), drain_wakeup.fd()}) {
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeup_fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev) < 0) {
+            std::cerr << "[ERROR] ";
+            perror("Epoll Ctl Failed");
+            close(epoll_fd);
+            close(server_fd);
+            return;
+        }
+    }
+
+    // 已连接的客户端，epoll模式下不使用pollfd数组的事件字段，只借用O(1)的槽位管理和连接状态
+    ConnectionTable clients;
+    TimerWheel timers;
+
+    // fd耗尽(EMFILE/ENFILE)时accept失败，连接还留在队列中，而边缘触发的监听socket在有新连接到达之前不会再通知：
+    // 预留一个fd，耗尽时先关掉它腾出位置，accept后立即关闭这个连接再重新打开预留fd，排队的客户端被拒绝而不是一直挂着；
+    // 预留fd不可用(被其他线程占用)时记下来，等有连接关闭后用EPOLL_CTL_MOD重新注册监听socket，队列非空时会再通知一次
+    // 注意fd表满时即使队列为空accept也返回EMFILE(先分配fd再取连接)，腾出位置后得到EAGAIN才说明队列已空
+    int reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    bool accept_blocked = false;
+    size_t blocked_clients = 0;  // accept被阻塞时的连接数，降下来说明有fd释放了
+    auto shed_connection = [&]() -> bool {
+        if(reserve_fd < 0) return false;
+        close(reserve_fd);
+        int fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+        int saved_errno = errno;
+        if(fd >= 0) close(fd);
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        errno = saved_errno;
+        if(fd < 0) return errno == EINTR || errno == ECONNABORTED;  // 可以重试；EAGAIN(队列已空)等由调用方处理
+        std::cerr << "[ERROR] " << "文件描述符耗尽，拒绝一个排队的连接" << std::endl;
+        return true;
+    };
+
+    // 循环recv直到EAGAIN，每次读到的请求处理完后立即writev回复；发送队列超过水位时停止读取
+    auto drain_input = [&](int fd, Connection& conn) -> bool {
+        while(true){
+            if(conn.out.bytes() >= OUTPUT_HIGH_WATERMARK) {
+                conn.throttled = true;
+                return true;
+            }
+            ssize_t bytes_read = conn.in.read_from(fd);
+            if(bytes_read > 0){
+                if(!process_input(fd, conn, framed) || !flush_output(fd, conn)) return false;
+                continue;
+            }
+            else if(bytes_read == 0){
+                log_disconnect(conn);
+                return false;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;  // 数据已读完
+            if(errno == EINTR) continue;
+            std::cerr << "[ERROR] ";
+            perror("Received Failed");
+            return false;
+        }
+        conn.throttled = false;
+        return true;
+    };
+
+    // 发送队列非空时注册EPOLLOUT，写空后取消，只在状态变化时调用epoll_ctl
+    auto update_interest = [&](int fd, Connection& conn) -> bool {
+        bool want_out = !conn.out.empty();
+        if(want_out == conn.want_out) return true;
+        epoll_event mod_ev{};
+        mod_ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (want_out ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        mod_ev.data.fd = fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &mod_ev) < 0) {
+            std::cerr << "[ERROR] ";
+            perror("Epoll Ctl Failed");
+            return false;
+        }
+        conn.want_out = want_out;
+        return true;
+    };
+    auto close_client = [&](int fd) {
+        int slot = clients.slot_of(fd);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+        if(slot != ConnectionTable::NO_SLOT) {
+            timers.cancel(clients.conn(slot).timer);
+            clients.remove(slot);
+        }
+    };
+    auto on_timeout = [&](TimerWheel::TimerId, uint64_t fd) {
+        int slot = clients.slot_of(static_cast<int>(fd));
+        if(slot == ConnectionTable::NO_SLOT) return;
+        log_disconnect(clients.conn(slot), "超时，关闭连接");
+        close_client(static_cast<int>(fd));  // 定时器已释放，cancel不会生效
+    };
+
+    // 停止accept：监听socket已由新进程持有，关闭本进程的fd并不会把它从epoll中移除(epoll跟踪的是打开的文件，
+    // 而不是fd号)，必须先显式删除，否则之后的新连接仍然会唤醒这里
+    bool draining = false;
+    auto start_drain = [&]() {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, drain_wakeup.fd(), NULL);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, server_fd, NULL);
+        close(server_fd);  // fd号保留在server_fd中，本轮已经取出的事件不会被当成客户端处理
+        draining = true;
+        std::cout << "[INFO] " << "停止接受新连接，剩余连接: " << clients.size() << std::endl;
+    };
+
+    epoll_event events[MAX_EVENTS];
+    while(_running && !(draining && clients.size() == 0)){
+        // 6. 等待事件，只返回就绪的fd；超时时间为最近一个连接定时器的到期时间，没有定时器时无限等待
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timers.next_timeout());
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            std::cerr << "[ERROR] ";
+            perror("Epoll Wait Failed");
+            continue;
+        }
+
+        // 7. 只处理就绪的文件描述符
+        for(int i = 0; i < n; ++i){
+            int fd = events[i].data.fd;
+            uint32_t revents = events[i].events;
+            if(fd == stop_wakeup.fd()) continue;  // 退出通知，回到循环条件检查_running
+            if(fd == drain_wakeup.fd()) {
+                if(!draining) start_drain();
+                continue;
+            }
+
+            if(fd == server_fd){
+                // 新连接：循环accept直到EAGAIN
+                while(!draining){
+                    sockaddr_in client_addr;
+                    socklen_t client_addr_len = sizeof(client_addr);
+                    int client_fd = accept4(server_fd, (struct sockaddr*)&client_addr,
+                                            &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if(client_fd < 0) {
+                        if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+                        if(errno == EINTR || errno == ECONNABORTED) continue;
+                        bool exhausted = errno == EMFILE || errno == ENFILE;
+                        if(exhausted && shed_connection()) continue;
+                        if(exhausted && (errno == EAGAIN || errno == EWOULDBLOCK)) break;  // 队列中已经没有连接
                         std::cerr << "[ERROR] ";
-                        perror("Received Failed");
-                        continue;
+                        perror("Accept Failed");
+                        if(exhausted) {
+                            accept_blocked = true;
+                            blocked_clients = clients.size();
+                        }
+                        break;
                     }
-                    else if(bytes_read == 0) {
-                        std::cout << "[INFO] " << "客户端已断开连接" << std::endl;
-                        close(fds[i].fd); // 关闭客户端socket
-                        fds.erase(fds.begin() + i); // 从poll结构中移除
-                        --i; // 重置当前元素，因为下一个元素会移动到当前位置
+
+                    epoll_event client_ev{};
+                    client_ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                    client_ev.data.fd = client_fd;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_ev) < 0) {
+                        std::cerr << "[ERROR] ";
+                        perror("Epoll Ctl Failed");
+                        close(client_fd);
                         continue;
                     }
+                    size_t slot = clients.add(client_fd, POLLIN, client_addr);
+                    clients.conn(slot).timer = timers.add(IDLE_TIMEOUT_MS, client_fd);
+
+                    char client_ip[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+                    std::cout << "[INFO] " << "客户端 " << client_ip << ":"
+                            << ntohs(client_addr.sin_port) << " 已连接" << std::endl;
                 }
+                continue;
             }
 
+            // MSG_ZEROCOPY的完成通知放在错误队列中，同样表现为EPOLLERR，取走通知后连接照常处理
+            Connection& conn = clients.conn(clients.slot_of(fd));
+            if((revents & EPOLLERR) && conn.out.completions_only(fd)) revents &= ~EPOLLERR;
+
             // 处理错误事件
-            if(fds[i].revents & POLLERR || fds[i].revents & POLLHUP){
-                if(fds[i].fd != server_fd) {
-                    std::cerr << "[ERROR] " << "客户端 " << fds[i].fd << " 发生错误或断开连接" << std::endl;
-                }
-                else {
-                    std::cerr << "[ERROR] " << "服务器发生错误或断开连接" << std::endl;
-                }
-                close(fds[i].fd); // 关闭socket
-                fds.erase(fds.begin() + i); // 从poll结构中移除
-                --i; // 重置当前元素，因为下一个元素会移动到当前位置
+            if(revents & (EPOLLERR | EPOLLHUP)){
+                std::cerr << "[ERROR] " << "客户端 " << fd << " 发生错误或断开连接" << std::endl;
+                close_client(fd);
                 continue;
             }
+
+            // 可写时继续发送排队的回复；可读时，或者之前因背压停止读取而队列已经降下来时，继续读
+            bool ok = true;
+            if(revents & EPOLLOUT) {
+                ok = flush_output(fd, conn);
+            }
+            if(ok && ((revents & (EPOLLIN | EPOLLRDHUP)) || conn.throttled)) {
+                ok = drain_input(fd, conn);
+            }
+            if(!ok || !update_interest(fd, conn)) close_client(fd);
+            else timers.reset(conn.timer, connection_timeout(conn));
+        }
+
+        timers.advance(on_timeout);
+
+        // fd耗尽后有连接关闭(对端断开或超时)，重新注册监听socket让排队的连接再触发一次
+        if(accept_blocked && !draining && clients.size() < blocked_clients) {
+            accept_blocked = false;
+            epoll_event mod_ev{};
+            mod_ev.events = EPOLLIN | EPOLLET;
+            mod_ev.data.fd = server_fd;
+            if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, server_fd, &mod_ev) < 0) {
+                std::cerr << "[ERROR] ";
+                perror("Epoll Ctl Failed");
+            }
         }
     }
 
     std::cout << "[INFO] " << "服务器关闭中..." << std::endl;
 
     // 8. 关闭所有socket
-    for(auto &fd : fds){
-        close(fd.fd);
+    for(size_t i = 0; i < clients.size(); ++i){
+        close(clients.pfd(i).fd);
     }
+    close(epoll_fd);
+    if(!draining) close(server_fd);
+    if(reserve_fd >= 0) close(reserve_fd);
     std::cout << "[INFO] " << "服务器关闭所有连接" << std::endl;
+}
+#endif
+
+
+#ifdef HAVE_IO_URING
+// io_uring模式下连接事件的处理，行为与epoll模式一致：对端关闭时立即关闭连接
+struct UringHandler {
+    bool framed;
+
+    void on_open(int, Connection& conn) {
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(conn.addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+        std::cout << "[INFO] " << "客户端 " << client_ip << ":"
+                << ntohs(conn.addr.sin_port) << " 已连接" << std::endl;
+    }
+    bool on_input(int fd, Connection& conn) { return process_input(fd, conn, framed); }
+    bool on_eof(int, Connection&) { return false; }
+    bool close_after_send(const Connection&) const { return false; }
+    void on_close(int, Connection& conn, CloseReason why) {
+        if(why == CLOSE_EOF) log_disconnect(conn);
+        else if(why == CLOSE_TIMEOUT) log_disconnect(conn, "超时，关闭连接");
+    }
+    uint64_t timeout(const Connection& conn, bool writing) const {
+        if(writing) return WRITE_TIMEOUT_MS;
+        if(!conn.in.empty()) return READ_TIMEOUT_MS;
+        return IDLE_TIMEOUT_MS;
+    }
+};
+
+// io_uring模式的事件循环，返回false表示io_uring初始化失败，调用方回退到epoll
+bool run_uring_loop(int server_fd, bool framed) {
+    // 5. 创建io_uring实例和接收缓冲区环，提交多shot accept
+    UringHandler handler{framed};
+    UringLoop<Connection, UringHandler> loop(handler, OUTPUT_HIGH_WATERMARK, URING_ENTRIES,
+                                             RECV_BUFFER_COUNT, RECV_BUFFER_SIZE);
+    if(!loop.init(server_fd, stop_wakeup.fd(), drain_wakeup.fd())) {
+        std::cerr << "[ERROR] ";
+        perror("Io_uring Init Failed");
+        return false;
+    }
+
+    // 6. 提交和收割都在loop.run中，每轮一次io_uring_enter，直到_running变为false
+    loop.run(_running);
+
+    std::cout << "[INFO] " << "服务器关闭中..." << std::endl;
+    close(server_fd);
+    std::cout << "[INFO] " << "io_uring_enter " << loop.enters() << " 次，完成 " << loop.completions() << " 个操作" << std::endl;
+    std::cout << "[INFO] " << "服务器关闭所有连接" << std::endl;
+    return true;
+}
+#endif
+
+
+// 位置参数中的数量：整个参数是十进制数时返回true，否则调用方把它当作选项处理
+static bool parse_count(const char* arg, unsigned long& count) {
+    if(!isdigit(static_cast<unsigned char>(arg[0]))) return false;
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if(*end != '\0' || errno == ERANGE) return false;
+    count = value;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN); // 忽略SIGPIPE信号
+#ifdef __linux__
+    executable_path();  // 记下启动时的程序路径，热重启时exec它
+    Takeover takeover;  // 由热重启启动时，监听socket从旧进程接收
+#endif
+    // 在创建任何线程之前屏蔽退出信号和热重启信号，事件循环线程继承屏蔽字，信号只通过signalfd交给主线程
+    SignalChannel signals({SIGINT, SIGTERM, SIGUSR2});
+    if(!signals.valid() || !stop_wakeup.valid() || !drain_wakeup.valid() || !loops_done.valid()) {
+        std::cerr << "[ERROR] ";
+        perror("Signal/Wakeup Channel Failed");
+        return -1;
+    }
+
+    std::string mode = argc > 1 ? argv[1] : "poll";
+    if(mode != "poll" && mode != "epoll" && mode != "uring") {
+        std::cerr << "[ERROR] " << "未知模式: " << mode << "，用法: " << argv[0] << " [poll|epoll|uring] [reactors] [framed] [file=路径] [copy|sendfile|zerocopy]" << std::endl;
+        return -1;
+    }
+#ifndef HAVE_IO_URING
+    if(mode == "uring") {
+        std::cerr << "[ERROR] " << "当前平台不支持io_uring，回退到epoll模式" << std::endl;
+        mode = "epoll";
+    }
+#endif
+#ifndef __linux__
+    if(mode == "epoll") {
+        std::cerr << "[ERROR] " << "当前平台不支持epoll，回退到poll模式" << std::endl;
+        mode = "poll";
+    }
+#endif
+
+    // 第二个参数是数字时为事件循环数，否则从它开始都是选项(如 ./poll_serverTCP epoll framed)
+    unsigned long count = 1;
+    int first_option = 2;
+    if(argc > 2 && parse_count(argv[2], count)) first_option = 3;
+    unsigned reactors = static_cast<unsigned>(count);
+    if(reactors == 0) reactors = std::max(1u, std::thread::hardware_concurrency());
+
+    bool framed = false;
+    const char* file_path = nullptr;
+    for(int i = first_option; i < argc; ++i) {
+        std::string opt = argv[i];
+        if(opt == "framed") framed = true;
+        else if(opt.compare(0, 5, "file=") == 0) file_path = argv[i] + 5;
+        else if(!parse_send_mode(opt, response_send)) {
+            std::cerr << "[ERROR] " << "未知选项: " << opt << "，用法: " << argv[0]
+                      << " [poll|epoll|uring] [reactors] [framed] [file=路径] [copy|sendfile|zerocopy]" << std::endl;
+            return -1;
+        }
+    }
+    if(file_path) {
+        if(!response_file.open(file_path)) {
+            std::cerr << "[ERROR] ";
+            perror("Open Response File Failed");
+            return -1;
+        }
+        if(framed && response_file.size() > UINT32_MAX) {
+            std::cerr << "[ERROR] " << "分帧模式下回复不能超过4GB" << std::endl;
+            return -1;
+        }
+    }
+
+    auto run_loop = [&mode, framed](int server_fd) {
+#ifdef HAVE_IO_URING
+        if(mode == "uring") {
+            if(run_uring_loop(server_fd, framed)) return;
+            std::cerr << "[ERROR] " << "io_uring不可用，回退到epoll模式" << std::endl;
+            run_epoll_loop(server_fd, framed);
+            return;
+        }
+#endif
+#ifdef __linux__
+        if(mode == "epoll") run_epoll_loop(server_fd, framed);
+        else run_poll_loop(server_fd, framed);
+#else
+        run_poll_loop(server_fd, framed);
+#endif
+    };
+
+    // 先创建所有监听socket，任何一个失败都直接退出
+    // 热重启时直接使用旧进程交出的监听socket，它们的accept队列中可能已经有等待的连接
+    bool reuse_port = reactors > 1;
+    std::vector<int> listen_fds;
+#ifdef __linux__
+    if(takeover.requested()) {
+        if(!takeover.receive(listen_fds)) {
+            std::cerr << "[ERROR] ";
+            perror("Receive Listen Sockets Failed");
+            return -1;
+        }
+        // 每个SO_REUSEPORT socket都有自己的accept队列，关掉多余的会重置排在其中的连接，所以按收到的个数运行
+        if(listen_fds.size() != reactors) {
+            std::cerr << "[ERROR] " << "旧进程交出了 " << listen_fds.size() << " 个监听socket，事件循环数改为与之相同" << std::endl;
+            reactors = static_cast<unsigned>(listen_fds.size());
+        }
+        std::cout << "[INFO] " << "已从旧进程接管 " << listen_fds.size() << " 个监听socket" << std::endl;
+    }
+#endif
+    for(unsigned i = listen_fds.size(); i < reactors; ++i){
+        int server_fd = create_listen_socket(reuse_port);
+        if(server_fd < 0) {
+            for(int fd : listen_fds) close(fd);
+            return -1;
+        }
+        listen_fds.push_back(server_fd);
+    }
+    std::cout << "[INFO] " << "服务器进程: " << getpid() << std::endl;
+    std::cout << "[INFO] " << "服务器已启动，监听端口 " << PORT << "，模式: " << mode
+            << "，事件循环数: " << reactors << (framed ? "，长度前缀分帧" : "") << std::endl;
+    if(response_file.valid()) {
+        const char* how = response_send == SendMode::SENDFILE ? "sendfile"
+                        : response_send == SendMode::ZEROCOPY ? "MSG_ZEROCOPY" : "拷贝";
+        std::cout << "[INFO] " << "回复文件: " << file_path << " (" << response_file.size() << " 字节)，发送方式: " << how << std::endl;
+    }
+
+    _running.store(true);
+    _active_loops.store(reactors);
+    // 每个线程一个事件循环，多于一个时绑定到各自的CPU
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < reactors; ++i){
+        threads.emplace_back([&run_loop, &listen_fds, i, reactors]() {
+            if(reactors > 1 && !pin_current_thread(i)) {
+                std::cerr << "[ERROR] " << "事件循环 " << i << " 绑定CPU失败" << std::endl;
+            }
+            run_loop(listen_fds[i]);
+            if(_active_loops.fetch_sub(1) == 1) loops_done.notify();
+        });
+    }
+#ifdef __linux__
+    // 事件循环线程已经启动(在此之前到达的连接排在accept队列中)，通知旧进程停止accept
+    if(takeover.requested() && !takeover.ready()) {
+        std::cerr << "[ERROR] ";
+        perror("Notify Old Process Failed");
+    }
+#endif
+    wait_for_shutdown(signals, listen_fds, argv);
+    for(auto &t : threads){
+        t.join();
+    }
+
     std::cout << "[INFO] " << "服务器已关闭" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,237 @@
+#pragma once
+// 连接缓冲区
+// 读写缓冲区按容量分为1K/4K/16K/64K四级，每一级的定长块从256K的slab中切出，
+// 释放后进入当前线程的空闲链表复用，分配和释放都不加锁，也不清零；
+// 数据放不下时升到更大的一级，所以不完整的消息可以跨多次recv保留，直到上层解析出完整的一条
+
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+class BufferSlab {
+public:
+    static constexpr int NUM_CLASSES = 4;
+    static constexpr size_t MIN_SIZE = 1024;
+    static constexpr size_t MAX_SIZE = MIN_SIZE << (2 * (NUM_CLASSES - 1));  // 64K
+
+    static constexpr size_t class_size(int cls) { return MIN_SIZE << (2 * cls); }
+
+    // 能容纳n字节的最小级别，超过MAX_SIZE返回-1
+    static int class_of(size_t n) {
+        for(int cls = 0; cls < NUM_CLASSES; ++cls) {
+            if(n <= class_size(cls)) return cls;
+        }
+        return -1;
+    }
+
+    static char* allocate(int cls) {
+        Cache& c = cache();
+        if(!c.head[cls]) refill(c, cls);
+        Block* b = c.head[cls];
+        c.head[cls] = b->next;
+        --c.count[cls];
+        return reinterpret_cast<char*>(b);
+    }
+
+    static void deallocate(char* p, int cls) {
+        Cache& c = cache();
+        Block* b = reinterpret_cast<Block*>(p);
+        b->next = c.head[cls];
+        c.head[cls] = b;
+        if(++c.count[cls] > cache_max(cls)) flush(c, cls, cache_max(cls) / 2);
+    }
+
+private:
+    static constexpr size_t SLAB_SIZE = 256 * 1024;         // 每次向系统申请的内存，切成该级的若干块
+    static constexpr size_t CACHE_MAX_BYTES = 256 * 1024;   // 每级线程缓存的上限
+
+    struct Block { Block* next; };
+
+    struct Global {
+        std::mutex mtx;
+        Block* head[NUM_CLASSES] = {};
+    };
+
+    struct Cache {
+        Block* head[NUM_CLASSES] = {};
+        size_t count[NUM_CLASSES] = {};
+        ~Cache() {  // 线程退出时把缓存还给全局链表
+            for(int cls = 0; cls < NUM_CLASSES; ++cls) flush(*this, cls, count[cls]);
+        }
+    };
+
+    static constexpr size_t cache_max(int cls) {
+        return CACHE_MAX_BYTES / class_size(cls) < 4 ? 4 : CACHE_MAX_BYTES / class_size(cls);
+    }
+
+    static Global& global() {
+        static Global g;
+        return g;
+    }
+
+    static Cache& cache() {
+        thread_local Cache c;
+        return c;
+    }
+
+    // 先从全局链表批量取回，全局链表也为空时切一个新slab；slab在进程生命周期内一直复用，不归还系统
+    static void refill(Cache& c, int cls) {
+        {
+            Global& g = global();
+            std::lock_guard<std::mutex> lock(g.mtx);
+            while(g.head[cls] && c.count[cls] < cache_max(cls) / 2) {
+                Block* b = g.head[cls];
+                g.head[cls] = b->next;
+                b->next = c.head[cls];
+                c.head[cls] = b;
+                ++c.count[cls];
+            }
+        }
+        if(c.head[cls]) return;
+
+        size_t block = class_size(cls);
+        size_t slab_size = block > SLAB_SIZE ? block : SLAB_SIZE;
+        char* slab = static_cast<char*>(::operator new(slab_size));
+        for(size_t off = 0; off + block <= slab_size; off += block) {
+            Block* b = reinterpret_cast<Block*>(slab + off);
+            b->next = c.head[cls];
+            c.head[cls] = b;
+            ++c.count[cls];
+        }
+    }
+
+    static void flush(Cache& c, int cls, size_t n) {
+        if(n == 0) return;
+        Global& g = global();
+        std::lock_guard<std::mutex> lock(g.mtx);
+        while(c.head[cls] && n-- > 0) {
+            Block* b = c.head[cls];
+            c.head[cls] = b->next;
+            b->next = g.head[cls];
+            g.head[cls] = b;
+            --c.count[cls];
+        }
+    }
+};
+
+
+// 单个连接的可增长字节缓冲区，[rpos_, wpos_)为已收到但还没处理的数据
+// 数据全部处理完时读写位置归零；空缓冲区可以release把块还给slab，空闲连接不占内存
+class ConnBuffer {
+public:
+    ConnBuffer() = default;
+    ~ConnBuffer() { release(); }
+
+    ConnBuffer(const ConnBuffer&) = delete;
+    ConnBuffer& operator=(const ConnBuffer&) = delete;
+
+    ConnBuffer(ConnBuffer&& other) noexcept
+        : buf_(other.buf_), cls_(other.cls_), rpos_(other.rpos_), wpos_(other.wpos_) {
+        other.buf_ = nullptr;
+        other.cls_ = -1;
+        other.rpos_ = other.wpos_ = 0;
+    }
+
+    ConnBuffer& operator=(ConnBuffer&& other) noexcept {
+        if(this != &other) {
+            release();
+            std::swap(buf_, other.buf_);
+            std::swap(cls_, other.cls_);
+            std::swap(rpos_, other.rpos_);
+            std::swap(wpos_, other.wpos_);
+        }
+        return *this;
+    }
+
+    char* data() { return buf_ + rpos_; }
+    const char* data() const { return buf_ + rpos_; }
+    size_t size() const { return wpos_ - rpos_; }
+    bool empty() const { return wpos_ == rpos_; }
+    size_t capacity() const { return cls_ < 0 ? 0 : BufferSlab::class_size(cls_); }
+
+    // 尾部可写空间，写入后调用commit
+    char* write_ptr() { return buf_ + wpos_; }
+    size_t writable() const { return capacity() - wpos_; }
+    void commit(size_t n) { wpos_ += n; }
+
+    // 丢弃开头n字节已处理的数据
+    void consume(size_t n) {
+        rpos_ += n;
+        if(rpos_ >= wpos_) rpos_ = wpos_ = 0;
+    }
+
+    // 保证尾部至少有n字节可写：先把未处理的数据移到开头，仍然不够再换成更大一级的块
+    // 总量超过BufferSlab::MAX_SIZE时返回false
+    bool reserve(size_t n) {
+        if(writable() >= n) return true;
+        size_t used = size();
+        int cls = BufferSlab::class_of(used + n);
+        if(cls < 0) return false;
+        if(cls == cls_) {
+            std::memmove(buf_, buf_ + rpos_, used);
+        }
+        else {
+            char* buf = BufferSlab::allocate(cls);
+            if(used > 0) std::memcpy(buf, buf_ + rpos_, used);
+            if(buf_) BufferSlab::deallocate(buf_, cls_);
+            buf_ = buf;
+            cls_ = cls;
+        }
+        rpos_ = 0;
+        wpos_ = used;
+        return true;
+    }
+
+    bool append(const void* p, size_t n) {
+        if(!reserve(n)) return false;
+        std::memcpy(write_ptr(), p, n);
+        commit(n);
+        return true;
+    }
+
+    // 把块还给slab，未处理的数据一并丢弃
+    void release() {
+        if(buf_) BufferSlab::deallocate(buf_, cls_);
+        buf_ = nullptr;
+        cls_ = -1;
+        rpos_ = wpos_ = 0;
+    }
+
+    // 数据已经处理完时归还块，连接空闲期间不占用缓冲区
+    void shrink() {
+        if(empty()) release();
+    }
+
+    // 从fd读一次追加到尾部，返回值与recv相同；尾部空间太小时先整理或升级，避免一次只读几个字节
+    // 缓冲区已满且已经是最大一级时返回-1并把errno设为ENOBUFS(上层应当按协议错误关闭连接)
+    ssize_t read_from(int fd, int flags = 0) {
+        if(writable() < READ_MIN && !reserve(READ_MIN) && writable() == 0) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        ssize_t n = recv(fd, write_ptr(), writable(), flags);
+        if(n > 0) commit(static_cast<size_t>(n));
+        return n;
+    }
+
+    // 把缓冲区中的数据尽量写到fd，已写出的部分从缓冲区丢弃，返回值与send相同
+    // 非阻塞socket上可能只写出一部分，剩下的留在缓冲区中等待下一次写
+    ssize_t write_to(int fd, int flags = 0) {
+        ssize_t n = send(fd, data(), size(), flags);
+        if(n > 0) consume(static_cast<size_t>(n));
+        return n;
+    }
+
+private:
+    static constexpr size_t READ_MIN = 512;  // 每次recv至少提供的空间
+
+    char* buf_ = nullptr;
+    int cls_ = -1;
+    size_t rpos_ = 0;
+    size_t wpos_ = 0;
+};
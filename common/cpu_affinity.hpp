@@ -0,0 +1,25 @@
+#pragma once
+// 线程绑核
+// 每个事件循环线程固定在一个CPU上，配合SO_REUSEPORT让同一条流的处理始终留在同一个核，
+// 减少缓存失效和跨核迁移；非Linux平台没有pthread_setaffinity_np，直接忽略
+
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 把当前线程绑定到第cpu个CPU(超过核数时取模)，成功返回true
+inline bool pin_current_thread(unsigned cpu) {
+#ifdef __linux__
+    unsigned ncpu = std::thread::hardware_concurrency();
+    if(ncpu == 0) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % ncpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,74 @@
+#pragma once
+// 长度前缀分帧
+// 每一帧为[varint长度][内容]，长度用LEB128编码：每字节低7位为数据，最高位为1表示后面还有字节，
+// 小于128字节的消息只多1字节开销；TCP把多条消息合并或拆开都不影响解析
+// 解码器直接在ConnBuffer上工作：一次recv可以解出多帧，不完整的帧留在缓冲区等下一次recv；
+// 编码器把多条回复追加到同一个输出缓冲区，处理完一批请求后一次send写出
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "conn_buffer.hpp"
+
+class FrameDecoder {
+public:
+    enum Status {
+        FRAME,      // 取出了一帧
+        NEED_MORE,  // 缓冲区中没有完整的帧
+        BAD_FRAME,  // 长度前缀非法或超过上限，应当关闭连接
+    };
+
+    static constexpr size_t MAX_VARINT = 5;                                      // 32位长度最多5字节
+    static constexpr size_t DEFAULT_MAX_FRAME = BufferSlab::MAX_SIZE - MAX_VARINT;  // 整帧能放进一个最大级别的缓冲区
+
+    explicit FrameDecoder(size_t max_frame = DEFAULT_MAX_FRAME) : max_frame_(max_frame) {}
+
+    // 从in开头取出一帧并把它从缓冲区丢弃
+    // payload指向缓冲区内部，在下一次向in写入(read_from/reserve/append)之前有效
+    Status next(ConnBuffer& in, std::string_view& payload) const {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(in.data());
+        size_t size = in.size();
+        uint64_t len = 0;
+        size_t header = 0;
+        while(true) {
+            if(header == size) return NEED_MORE;
+            if(header == MAX_VARINT) return BAD_FRAME;
+            unsigned char byte = p[header];
+            len |= static_cast<uint64_t>(byte & 0x7F) << (7 * header);
+            ++header;
+            if((byte & 0x80) == 0) break;
+        }
+        if(len > max_frame_) return BAD_FRAME;
+        if(size - header < len) {
+            in.reserve(header + len - size);  // 提前准备好整帧所需的空间，后续recv不用再搬移
+            return NEED_MORE;
+        }
+        payload = std::string_view(in.data() + header, static_cast<size_t>(len));
+        in.consume(header + static_cast<size_t>(len));
+        return FRAME;
+    }
+
+private:
+    size_t max_frame_;
+};
+
+// 把长度前缀写到buf，返回写入的字节数(最多FrameDecoder::MAX_VARINT)
+inline size_t encode_varint(uint32_t n, char* buf) {
+    size_t i = 0;
+    while(n >= 0x80) {
+        buf[i++] = static_cast<char>((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+    buf[i++] = static_cast<char>(n);
+    return i;
+}
+
+// 追加一帧到out，out超过最大缓冲区时返回false
+inline bool encode_frame(ConnBuffer& out, const void* data, size_t n) {
+    char header[FrameDecoder::MAX_VARINT];
+    size_t header_len = encode_varint(static_cast<uint32_t>(n), header);
+    if(!out.reserve(header_len + n)) return false;
+    out.append(header, header_len);
+    out.append(data, n);
+    return true;
+}
@@ -0,0 +1,230 @@
+#pragma once
+// 热重启：运行中的服务器把监听socket交给新执行的程序，自己停止accept，处理完已有连接后退出
+// 直接关闭旧进程再启动新进程时，监听socket随旧进程一起关闭，accept队列中还没取走的连接被重置，
+// 新进程bind之前到达的连接被拒绝；这里监听socket本身从不关闭，只是换了一个进程accept：
+//   1. 旧进程创建一对Unix域socket(SOCK_SEQPACKET)，fork后子进程把其中一端放在fd 3上，
+//      以原来的命令行参数exec启动时的程序文件，环境变量HOT_RESTART_FD=3
+//   2. 旧进程用SCM_RIGHTS把所有监听socket发给新进程，新进程收下后不再socket/bind/listen
+//   3. 新进程的事件循环启动后回复READY；在此之前两个进程同时在同一个socket上accept，连接不会丢失
+//   4. 旧进程收到READY后停止accept、排空已有连接后退出；新进程启动失败(退出或超时)时旧进程照常服务
+// 多个SO_REUSEPORT监听socket全部交出，内核按四元组分配连接的分组保持不变，已经排队的连接由新进程取走
+// 已建立的连接不转交，由旧进程处理完；两个进程各自拥有自己的连接，新进程不需要任何旧进程的状态
+//
+// 启动时的程序文件从/proc/self/exe读出路径保存下来：升级时新版本以rename替换该路径，
+// 这时/proc/self/exe指向的是已被替换的旧文件，exec保存的路径得到的才是新版本
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+const char* const HOT_RESTART_ENV = "HOT_RESTART_FD";
+const int HOT_RESTART_CHILD_FD = 3;     // 新进程中控制连接的fd号
+const size_t HANDOFF_MAX_FDS = 64;      // 一条消息最多携带的fd数(内核上限为SCM_MAX_FD=253)
+
+// 控制连接上的消息，每条消息携带count个fd，remaining为之后还有多少个
+struct HandoffMessage {
+    static constexpr uint32_t MAGIC = 0x48525354;  // "HRST"
+    uint32_t magic;
+    uint32_t count;
+    uint32_t remaining;
+};
+const char HANDOFF_READY = 'R';
+
+// 通过SCM_RIGHTS发送fds，失败返回false(errno)
+inline bool send_fds(int sock, const std::vector<int>& fds) {
+    size_t sent = 0;
+    do {
+        size_t n = std::min(fds.size() - sent, HANDOFF_MAX_FDS);
+        HandoffMessage m{HandoffMessage::MAGIC, static_cast<uint32_t>(n), static_cast<uint32_t>(fds.size() - sent - n)};
+        iovec iov{&m, sizeof(m)};
+        alignas(cmsghdr) char control[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if(n > 0) {
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(n * sizeof(int));
+            cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_SOCKET;
+            cm->cmsg_type = SCM_RIGHTS;
+            cm->cmsg_len = CMSG_LEN(n * sizeof(int));
+            memcpy(CMSG_DATA(cm), fds.data() + sent, n * sizeof(int));
+        }
+        ssize_t r;
+        while((r = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+        if(r != static_cast<ssize_t>(sizeof(m))) return false;
+        sent += n;
+    } while(sent < fds.size());
+    return true;
+}
+
+// 接收send_fds发出的所有fd，收到的fd带有FD_CLOEXEC；失败时关闭已收到的fd并返回false
+inline bool recv_fds(int sock, std::vector<int>& fds) {
+    std::vector<int> received;
+    auto fail = [&received](int err) {
+        for(int fd : received) close(fd);
+        errno = err;
+        return false;
+    };
+    while(true) {
+        HandoffMessage m{};
+        iovec iov{&m, sizeof(m)};
+        alignas(cmsghdr) char control[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t r;
+        while((r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+        if(r < 0) return fail(errno);
+        // 先收下消息中的fd，即使消息本身不合法也要关闭它们
+        size_t got = 0;
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+            size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for(size_t i = 0; i < n; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+                received.push_back(fd);
+            }
+            got += n;
+        }
+        if(r == 0) return fail(ECONNRESET);
+        if(r != static_cast<ssize_t>(sizeof(m)) || m.magic != HandoffMessage::MAGIC ||
+           (msg.msg_flags & MSG_CTRUNC) || got != m.count) return fail(EPROTO);
+        if(m.remaining == 0) break;
+    }
+    fds.insert(fds.end(), received.begin(), received.end());
+    return true;
+}
+
+// 启动时的程序路径，热重启时exec它；在main开头调用一次保存下来
+inline const std::string& executable_path() {
+    static const std::string path = [] {
+        char buf[PATH_MAX];
+        ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+        return n > 0 ? std::string(buf, n) : std::string("/proc/self/exe");
+    }();
+    return path;
+}
+
+
+// 新进程一侧：由热重启启动时从旧进程接收监听socket，就绪后通知旧进程
+class Takeover {
+public:
+    // 读取并清除HOT_RESTART_FD，之后这个进程自己再热重启时不会带上它
+    Takeover() {
+        const char* v = getenv(HOT_RESTART_ENV);
+        if(v) {
+            fd_ = atoi(v);
+            unsetenv(HOT_RESTART_ENV);
+            fcntl(fd_, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    ~Takeover() {
+        if(fd_ >= 0) close(fd_);
+    }
+    Takeover(const Takeover&) = delete;
+    Takeover& operator=(const Takeover&) = delete;
+
+    bool requested() const { return fd_ >= 0; }
+
+    // 收下旧进程的所有监听socket，失败返回false(errno)
+    bool receive(std::vector<int>& fds) { return recv_fds(fd_, fds); }
+
+    // 事件循环已经开始accept，通知旧进程停止accept；控制连接随之关闭
+    bool ready() {
+        ssize_t n = write(fd_, &HANDOFF_READY, 1);
+        close(fd_);
+        fd_ = -1;
+        return n == 1;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+
+// 旧进程一侧：以argv启动新程序并交出fds，新进程在timeout_ms内回复READY时返回true，pid为新进程
+// 任何一步失败返回false，新进程(如果已启动)被杀死并回收，调用方继续使用fds照常服务
+// 子进程在fork之后只调用异步信号安全的函数，可以在多线程的进程中使用
+inline bool hot_restart(const std::vector<int>& fds, char* const argv[], int timeout_ms, pid_t& pid) {
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return false;
+
+    // 环境变量在fork之前准备好：去掉已有的HOT_RESTART_FD，加上新的
+    std::string env_fd = std::string(HOT_RESTART_ENV) + "=" + std::to_string(HOT_RESTART_CHILD_FD);
+    std::vector<char*> envp;
+    size_t prefix = strlen(HOT_RESTART_ENV);
+    for(char** e = environ; *e; ++e) {
+        if(strncmp(*e, HOT_RESTART_ENV, prefix) == 0 && (*e)[prefix] == '=') continue;
+        envp.push_back(*e);
+    }
+    envp.push_back(&env_fd[0]);
+    envp.push_back(nullptr);
+    const char* exe = executable_path().c_str();
+    long max_fd = sysconf(_SC_OPEN_MAX);
+
+    pid = fork();
+    if(pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if(pid == 0) {
+        // 恢复信号屏蔽字(signalfd屏蔽的信号会被exec继承)，控制连接放到fd 3，关闭其余所有fd：
+        // 旧进程的客户端连接和监听socket不应泄漏到新进程，监听socket只经由SCM_RIGHTS交出
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        if(sv[1] == HOT_RESTART_CHILD_FD) fcntl(sv[1], F_SETFD, 0);
+        else if(dup2(sv[1], HOT_RESTART_CHILD_FD) < 0) _exit(127);
+#ifdef SYS_close_range
+        if(syscall(SYS_close_range, HOT_RESTART_CHILD_FD + 1, ~0U, 0) < 0)
+#endif
+        {
+            for(long fd = HOT_RESTART_CHILD_FD + 1; fd < max_fd; ++fd) close(static_cast<int>(fd));
+        }
+        execve(exe, argv, envp.data());
+        _exit(127);
+    }
+
+    close(sv[1]);
+    int sock = sv[0];
+    bool ok = send_fds(sock, fds);
+    if(ok) {
+        // 等待READY；新进程退出时控制连接的另一端随之关闭，poll立即返回，不需要等到超时
+        pollfd pfd{sock, POLLIN, 0};
+        int r;
+        while((r = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {}
+        char c = 0;
+        ssize_t n = r > 0 ? read(sock, &c, 1) : -1;
+        ok = n == 1 && c == HANDOFF_READY;
+        if(r == 0) errno = ETIMEDOUT;
+        else if(n == 0) errno = ECONNRESET;  // 新进程没有就绪就退出了
+    }
+    int saved_errno = errno;
+    close(sock);
+    if(!ok) {
+        kill(pid, SIGKILL);
+        while(waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+        errno = saved_errno;
+    }
+    return ok;
+}
@@ -0,0 +1,348 @@
+#pragma once
+// io_uring的最小封装，直接使用系统调用，不依赖liburing
+// IoUring: 提交队列(SQ)和完成队列(CQ)是与内核共享的两个环，填好的提交项只是写进内存，
+//          submit_and_wait用一次io_uring_enter把积累的所有提交项交给内核并等待完成，
+//          for_each_cqe遍历已完成的项；一轮事件循环无论提交和收割多少个操作都只有一次系统调用
+// BufferRing: 注册给内核的提供缓冲区环，recv不用事先指定缓冲区，数据到达时内核从环中取一个，
+//             完成项里带回缓冲区编号，处理完后recycle放回环中；空闲连接不占用接收缓冲区
+// 基于它们的TCP服务器事件循环见uring_loop.hpp
+//
+// 内核要求: 多shot accept 5.19，提供缓冲区环和多shot recv 6.0；
+// io_uring_setup失败(内核太旧、被sysctl或seccomp禁用)或者缓冲区环注册失败时，调用方回退到epoll
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/socket.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <csignal>
+#include <ctime>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// 操作类型编码在user_data的低8位，高位是fd；连接的所有操作完成之前fd不会关闭，所以(fd, 类型)是唯一的
+enum UringOp : uint8_t {
+    URING_ACCEPT = 1,  // 多shot accept，res为新连接的fd
+    URING_RECV,        // 多shot recv，res为字节数，数据在提供缓冲区中
+    URING_SEND,        // sendmsg(MSG_WAITALL)，res为写出的字节数
+    URING_SHUTDOWN,    // 链接在最后一个send之后的shutdown
+    URING_CANCEL,      // 取消操作本身的完成项，忽略
+    URING_WAKEUP,      // 退出通知fd上的poll
+    URING_DRAIN,       // 停止accept通知fd上的poll
+};
+
+inline uint64_t uring_data(int fd, UringOp op) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 8) | op;
+}
+inline int uring_fd(uint64_t data) { return static_cast<int>(data >> 8); }
+inline UringOp uring_op(uint64_t data) { return static_cast<UringOp>(data & 0xff); }
+
+
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring() { destroy(); }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // entries为提交队列大小，完成队列是它的4倍(多shot操作一个提交项产生多个完成项)
+    // 优先使用单提交者+延迟task work(6.1)，完成事件只在本线程调用io_uring_enter时处理，不打断正在运行的循环
+    // 失败返回false并设置errno
+    bool init(unsigned entries) {
+        io_uring_params p{};
+        p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        p.cq_entries = entries * 4;
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if(fd < 0 && errno == EINVAL) {
+            p = io_uring_params{};
+            p.flags = IORING_SETUP_CQSIZE;
+            p.cq_entries = entries * 4;
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        }
+        if(fd < 0) return false;
+        ring_fd_ = fd;
+        defer_taskrun_ = p.flags & IORING_SETUP_DEFER_TASKRUN;
+
+        // 等待带超时需要EXT_ARG(5.11)
+        if(!(p.features & IORING_FEAT_EXT_ARG)) {
+            destroy();
+            errno = ENOSYS;
+            return false;
+        }
+
+        sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_map_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if(single_mmap) sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+
+        sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if(sq_map_ == MAP_FAILED) { sq_map_ = nullptr; destroy(); return false; }
+        if(single_mmap) cq_map_ = sq_map_;
+        else {
+            cq_map_ = mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if(cq_map_ == MAP_FAILED) { cq_map_ = nullptr; destroy(); return false; }
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if(sqes == MAP_FAILED) { destroy(); return false; }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_map_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_entries_ = p.sq_entries;
+        // 提交项数组和提交队列一一对应，之后只移动tail
+        unsigned* array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        for(unsigned i = 0; i < sq_entries_; ++i) array[i] = i;
+        sqe_tail_ = *sq_tail_;
+
+        char* cq = static_cast<char*>(cq_map_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    bool valid() const { return ring_fd_ >= 0; }
+    int fd() const { return ring_fd_; }
+
+    // 取一个清零的提交项，提交队列已满时先把已有的提交给内核；失败返回nullptr
+    io_uring_sqe* get_sqe() {
+        if(sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            if(submit_and_wait(0, 0) < 0) return nullptr;
+            if(sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) return nullptr;
+        }
+        io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // 提交所有新的提交项，并等待至少wait_nr个完成项，timeout_ms为-1时不限时
+    // 返回提交的个数，超时和被信号中断返回0，出错返回-1并设置errno
+    int submit_and_wait(unsigned wait_nr, int timeout_ms) {
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned flags = 0;
+        // 延迟task work模式下完成项只在GETEVENTS时产生，所以总是带上
+        if(wait_nr > 0 || defer_taskrun_) flags |= IORING_ENTER_GETEVENTS;
+
+        io_uring_getevents_arg arg{};
+        timespec ts{};
+        void* argp = nullptr;
+        size_t argsz = _NSIG / 8;  // 不带EXT_ARG时这个参数是信号掩码的大小
+        if(wait_nr > 0 && timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            argp = &arg;
+            argsz = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, argp, argsz));
+        if(ret < 0) {
+            if(errno == ETIME || errno == EINTR) return 0;
+            return -1;
+        }
+        return ret;
+    }
+
+    // 对每个已完成的项调用f(const io_uring_cqe&)，返回处理的个数
+    // f中可以继续get_sqe提交新操作，新产生的完成项留到下一轮
+    template <class F>
+    unsigned for_each_cqe(F&& f) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned n = 0;
+        for(; head != tail; ++head, ++n) {
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            f(cqe);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    // 以下各函数填好一个提交项，只在下一次submit_and_wait时交给内核；提交队列满且无法提交时返回false
+
+    // 多shot accept：一个提交项持续接受新连接，每个连接一个完成项，不带F_MORE标志时已停止需要重新提交
+    bool accept_multishot(int fd, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_ACCEPT, fd, data);
+        if(!sqe) return false;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        return true;
+    }
+
+    // 多shot recv：每次有数据时从缓冲区组group中取一个缓冲区，完成项的flags带回缓冲区编号
+    bool recv_multishot(int fd, uint16_t group, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_RECV, fd, data);
+        if(!sqe) return false;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = group;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        return true;
+    }
+
+    // sendmsg，msg在完成之前必须保持有效；link为true时下一个提交项在它成功之后才执行
+    bool sendmsg(int fd, const msghdr* msg, unsigned msg_flags, uint64_t data, bool link = false) {
+        io_uring_sqe* sqe = prep(IORING_OP_SENDMSG, fd, data);
+        if(!sqe) return false;
+        sqe->addr = reinterpret_cast<uint64_t>(msg);
+        sqe->len = 1;
+        sqe->msg_flags = msg_flags;
+        if(link) sqe->flags |= IOSQE_IO_LINK;
+        return true;
+    }
+
+    bool shutdown(int fd, int how, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_SHUTDOWN, fd, data);
+        if(!sqe) return false;
+        sqe->len = static_cast<uint32_t>(how);
+        return true;
+    }
+
+    // 单次poll，fd有events事件时完成
+    bool poll_add(int fd, unsigned events, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_POLL_ADD, fd, data);
+        if(!sqe) return false;
+        sqe->poll32_events = events;
+        return true;
+    }
+
+    // 取消fd上的所有在途操作，被取消的操作以-ECANCELED完成
+    bool cancel_fd(int fd, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_ASYNC_CANCEL, fd, data);
+        if(!sqe) return false;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        return true;
+    }
+
+    // 取消user_data为target的操作
+    bool cancel(uint64_t target, uint64_t data) {
+        io_uring_sqe* sqe = prep(IORING_OP_ASYNC_CANCEL, -1, data);
+        if(!sqe) return false;
+        sqe->addr = target;
+        return true;
+    }
+
+private:
+    int ring_fd_ = -1;
+    bool defer_taskrun_ = false;
+    void* sq_map_ = nullptr;
+    void* cq_map_ = nullptr;
+    size_t sq_map_size_ = 0, cq_map_size_ = 0, sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0, sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;  // 已填好但还没交给内核的提交项到这里为止
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    io_uring_sqe* prep(uint8_t opcode, int fd, uint64_t data) {
+        io_uring_sqe* sqe = get_sqe();
+        if(!sqe) return nullptr;
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = data;
+        return sqe;
+    }
+
+    void destroy() {
+        if(sqes_) munmap(sqes_, sqes_size_);
+        if(cq_map_ && cq_map_ != sq_map_) munmap(cq_map_, cq_map_size_);
+        if(sq_map_) munmap(sq_map_, sq_map_size_);
+        if(ring_fd_ >= 0) close(ring_fd_);
+        sqes_ = nullptr;
+        sq_map_ = cq_map_ = nullptr;
+        ring_fd_ = -1;
+    }
+};
+
+
+// 提供缓冲区环：count个size字节的缓冲区，count必须是2的幂
+class BufferRing {
+public:
+    BufferRing() = default;
+    ~BufferRing() {
+        if(registered_) {
+            io_uring_buf_reg reg{};
+            reg.bgid = group_;
+            syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        }
+        if(bufs_) munmap(bufs_, ring_size_);
+        std::free(buffers_);
+    }
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+    // 分配缓冲区并注册为ring的缓冲区组group，所有缓冲区一开始都在环中；失败返回false并设置errno
+    bool init(const IoUring& ring, uint16_t group, unsigned count, size_t size) {
+        ring_size_ = count * sizeof(io_uring_buf);
+        void* mem = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED) return false;
+        bufs_ = static_cast<io_uring_buf*>(mem);
+        buffers_ = static_cast<char*>(std::aligned_alloc(4096, count * size));
+        if(!buffers_) return false;
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(bufs_);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if(syscall(__NR_io_uring_register, ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+        registered_ = true;
+        ring_fd_ = ring.fd();
+        group_ = group;
+        mask_ = count - 1;
+        size_ = size;
+        for(unsigned i = 0; i < count; ++i) recycle(static_cast<uint16_t>(i));
+        return true;
+    }
+
+    uint16_t group() const { return group_; }
+    const char* data(uint16_t bid) const { return buffers_ + bid * size_; }
+
+    // 把用完的缓冲区放回环中，内核之后可以再次使用
+    void recycle(uint16_t bid) {
+        io_uring_buf* buf = &bufs_[tail_ & mask_];
+        buf->addr = reinterpret_cast<uint64_t>(data(bid));
+        buf->len = static_cast<uint32_t>(size_);
+        buf->bid = bid;
+        // 环的tail与第一项的resv字段重叠(io_uring_buf_ring)
+        __atomic_store_n(&bufs_[0].resv, ++tail_, __ATOMIC_RELEASE);
+    }
+
+    // 从完成项中取出缓冲区编号，没有使用缓冲区时返回false
+    static bool buffer_of(const io_uring_cqe& cqe, uint16_t& bid) {
+        if(!(cqe.flags & IORING_CQE_F_BUFFER)) return false;
+        bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        return true;
+    }
+
+private:
+    // 不用io_uring_buf_ring::bufs：C++中它前面的空结构体占1字节，数组被错位到偏移8
+    io_uring_buf* bufs_ = nullptr;
+    size_t ring_size_ = 0;
+    char* buffers_ = nullptr;
+    int ring_fd_ = -1;
+    bool registered_ = false;
+    uint16_t group_ = 0;
+    uint16_t tail_ = 0;
+    unsigned mask_ = 0;
+    size_t size_ = 0;
+};
+#endif
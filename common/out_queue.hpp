@@ -0,0 +1,221 @@
+#pragma once
+// 连接的发送队列
+// 回复以片段的形式排队：常量数据只记录指针不拷贝，需要拷贝的小片段(帧头等)按顺序存放在一个ConnBuffer中；
+// 可写时把排队的片段组成iovec，一次writev写出一整批，短写时从断点继续，剩下的留在队列里等待下一次可写
+// 大文件可以按片段排入(push_file)，写到它时用sendfile或MSG_ZEROCOPY单独发送，不经过用户态拷贝(见zero_copy.hpp)
+
+#include <cstddef>
+#include <cerrno>
+#include <vector>
+#include <sys/uio.h>
+#include "conn_buffer.hpp"
+#include "zero_copy.hpp"
+
+class OutQueue {
+public:
+    static constexpr int MAX_IOV = 64;  // 单次writev最多的片段数
+
+    // 排入一段不拷贝的数据，data必须在写出之前一直有效(常量或生命周期长于连接的数据)
+    void push_ref(const void* data, size_t n) {
+        if(n == 0) return;
+        segments_.push_back(Segment{static_cast<const char*>(data), n, nullptr, MEMORY});
+        bytes_ += n;
+    }
+
+    // 拷贝一段数据排入队列，拷贝区超过最大缓冲区时返回false
+    bool push_copy(const void* data, size_t n) {
+        if(n == 0) return true;
+        if(!owned_.append(data, n)) return false;
+        segments_.push_back(Segment{nullptr, n, nullptr, MEMORY});
+        bytes_ += n;
+        return true;
+    }
+
+    // 排入整个静态文件，file必须在写出之前一直有效(通常与服务器同生命周期)
+    // SENDFILE/ZEROCOPY时文件内容作为单独的片段发送，它前面的小片段用MSG_MORE写出，和文件数据合并成满的报文
+    void push_file(const StaticFile& file, SendMode mode) {
+        if(file.size() == 0) return;
+        Kind kind = mode == SendMode::SENDFILE ? FILE : mode == SendMode::ZEROCOPY ? ZEROCOPY : MEMORY;
+        segments_.push_back(Segment{file.data(), file.size(), kind == FILE ? &file : nullptr, kind});
+        bytes_ += file.size();
+    }
+
+    bool empty() const { return bytes_ == 0; }
+    size_t bytes() const { return bytes_; }  // 还没写出的字节数
+
+    // 写出队列中的数据，直到全部写完或socket发送缓冲区已满
+    // 返回false表示发生了错误(errno)；EAGAIN不算错误，剩下的数据留在队列中
+    bool flush(int fd) {
+        if(zc_pending()) reap_completions(fd);
+        while(head_ < segments_.size()) {
+            const Segment& s = segments_[head_];
+            ssize_t n;
+            if(s.kind == FILE) n = send_file(fd, s);
+            else if(s.kind == ZEROCOPY && use_zerocopy(fd)) n = send_zerocopy(fd, s);
+            else {
+                struct iovec iov[MAX_IOV];
+                int count = fill_iov(iov, MAX_IOV, true);
+                size_t next = head_ + count;
+                n = next < segments_.size() && is_bulk(segments_[next]) ? send_more(fd, iov, count) : writev(fd, iov, count);
+            }
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                compact();
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            advance(static_cast<size_t>(n));
+        }
+        segments_.clear();
+        head_ = 0;
+        owned_.shrink();
+        return true;
+    }
+
+    // 由调用方自己发起写操作(io_uring)时使用：把队列开头最多max个片段填入iov，返回片段数，
+    // 写操作完成之前不能再向队列中排入数据，完成后用consume丢弃已写出的字节
+    // stop_at_bulk为false时文件片段也按映射的内存填入(普通拷贝发送)
+    int fill_iov(struct iovec* iov, int max, bool stop_at_bulk = false) const {
+        int count = 0;
+        const char* owned = owned_.data();  // 拷贝的片段在owned_中按入队顺序连续存放
+        for(size_t i = head_; i < segments_.size() && count < max; ++i, ++count) {
+            const Segment& s = segments_[i];
+            if(stop_at_bulk && count > 0 && is_bulk(s)) break;
+            iov[count].iov_base = const_cast<char*>(s.ptr ? s.ptr : owned);
+            iov[count].iov_len = s.len;
+            if(!s.ptr) owned += s.len;
+        }
+        return count;
+    }
+
+    size_t segments() const { return segments_.size() - head_; }  // 还没写完的片段数
+
+    void consume(size_t n) {
+        advance(n);
+        if(head_ == segments_.size()) {
+            segments_.clear();
+            head_ = 0;
+            owned_.shrink();
+        }
+        else compact();
+    }
+
+    // 处理POLLERR/EPOLLERR：取走错误队列中的零拷贝完成通知，
+    // 返回true表示错误事件只是完成通知，socket本身没有错误，连接可以继续使用
+    bool completions_only(int fd) {
+        if(zc_sent_ == 0) return false;
+        reap_completions(fd);
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) return false;
+        if(err != 0) errno = err;
+        return err == 0;
+    }
+
+    uint64_t zc_pending() const { return zc_sent_ - zc_done_; }  // 内核还没确认完成的MSG_ZEROCOPY发送次数
+
+private:
+    enum Kind : uint8_t {
+        MEMORY,    // 普通内存，和相邻的内存片段一起writev
+        FILE,      // 文件内容，用sendfile发送
+        ZEROCOPY,  // 用MSG_ZEROCOPY发送，直到内核确认完成前内存不能被修改
+    };
+
+    struct Segment {
+        const char* ptr;          // nullptr表示数据在owned_中；文件片段指向文件映射中的当前位置
+        size_t len;
+        const StaticFile* file;   // FILE片段所属的文件，偏移量为ptr - file->data()
+        Kind kind;
+    };
+
+    // 连接上MSG_ZEROCOPY的状态：第一次用到时才启用；内核报告发送退化为拷贝(如loopback)后不再使用，
+    // 此时零拷贝只增加固定页面和完成通知的开销
+    enum ZcState : uint8_t { ZC_UNKNOWN, ZC_ON, ZC_OFF };
+
+    std::vector<Segment> segments_;  // [head_, size())为还没写完的片段
+    size_t head_ = 0;
+    size_t bytes_ = 0;
+    ConnBuffer owned_;
+    ZcState zc_ = ZC_UNKNOWN;
+    uint64_t zc_sent_ = 0;  // 成功的MSG_ZEROCOPY发送次数，与内核的完成通知序号一一对应
+    uint64_t zc_done_ = 0;  // 已收到完成通知的发送次数
+
+    // 需要单独发送的片段：sendfile，以及连接上仍在使用MSG_ZEROCOPY时的零拷贝片段
+    bool is_bulk(const Segment& s) const {
+        return s.kind == FILE || (s.kind == ZEROCOPY && zc_ != ZC_OFF);
+    }
+
+    // 后面紧跟着文件片段时，这批小片段用MSG_MORE发出，让内核等文件数据一起组成满的报文
+    static ssize_t send_more(int fd, struct iovec* iov, int count) {
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        return sendmsg(fd, &msg, MSG_MORE);
+    }
+
+    static ssize_t send_file(int fd, const Segment& s) {
+#ifdef __linux__
+        off_t offset = s.ptr - s.file->data();
+        ssize_t n = sendfile(fd, s.file->fd(), &offset, s.len);
+        if(n == 0) {  // 文件在服务期间被截断
+            errno = EIO;
+            return -1;
+        }
+        return n;
+#else
+        return write(fd, s.ptr, s.len);
+#endif
+    }
+
+    bool use_zerocopy(int fd) {
+#ifdef __linux__
+        if(zc_ == ZC_UNKNOWN) zc_ = enable_zerocopy(fd) ? ZC_ON : ZC_OFF;
+#else
+        (void)fd;
+        zc_ = ZC_OFF;
+#endif
+        return zc_ == ZC_ON;
+    }
+
+    ssize_t send_zerocopy(int fd, const Segment& s) {
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+        ssize_t n = send(fd, s.ptr, s.len, MSG_ZEROCOPY);
+        if(n >= 0) ++zc_sent_;
+        // ENOBUFS: 未确认的通知超过了optmem限制，这一次退化为普通发送
+        else if(errno == ENOBUFS) n = send(fd, s.ptr, s.len, 0);
+        return n;
+#else
+        return write(fd, s.ptr, s.len);
+#endif
+    }
+
+    void reap_completions(int fd) {
+#ifdef __linux__
+        bool copied = false;
+        zc_done_ += read_zerocopy_completions(fd, copied);
+        if(copied) zc_ = ZC_OFF;
+#else
+        (void)fd;
+#endif
+    }
+
+    // 丢弃已写出的n字节，最后一个片段可能只写出一部分
+    void advance(size_t n) {
+        bytes_ -= n;
+        while(n > 0) {
+            Segment& s = segments_[head_];
+            size_t k = n < s.len ? n : s.len;
+            if(s.ptr) s.ptr += k;
+            else owned_.consume(k);
+            s.len -= k;
+            n -= k;
+            if(s.len == 0) ++head_;
+        }
+    }
+
+    // 已写完的片段过多时移除，避免一直有数据排队的连接让数组无限增长
+    void compact() {
+        if(head_ < MAX_IOV || head_ * 2 < segments_.size()) return;
+        segments_.erase(segments_.begin(), segments_.begin() + head_);
+        head_ = 0;
+    }
+};
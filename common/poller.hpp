@@ -0,0 +1,192 @@
+#pragma once
+// I/O多路复用的简单封装
+// Linux下使用epoll(水平触发，可选EPOLLONESHOT)，其他平台回退到poll
+// 只暴露可读/可写/挂断/错误四种事件，供线程池服务器和多进程服务器的事件循环共用
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+struct PollEvent {
+    int fd;
+    uint32_t events;  // Poller::READABLE | Poller::WRITABLE | Poller::HANGUP | Poller::ERROR
+};
+
+class Poller {
+public:
+    enum : uint32_t {
+        READABLE  = 1u << 0,
+        WRITABLE  = 1u << 1,
+        HANGUP    = 1u << 2,  // 对端关闭
+        ERROR     = 1u << 3,  // socket出错，或者错误队列中有消息(如MSG_ZEROCOPY的完成通知)
+        EXCLUSIVE = 1u << 4,  // 只用于add：多个进程各自的epoll等待同一个监听socket时，每个连接只唤醒其中一个(EPOLLEXCLUSIVE)
+    };
+
+    explicit Poller(int max_events = 1024) : max_events_(max_events) {
+#ifdef __linux__
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        events_.resize(max_events_);
+#endif
+    }
+
+    ~Poller() {
+#ifdef __linux__
+        if(epoll_fd_ >= 0) close(epoll_fd_);
+#endif
+    }
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    bool valid() const {
+#ifdef __linux__
+        return epoll_fd_ >= 0;
+#else
+        return true;
+#endif
+    }
+
+    // oneshot: 事件触发一次后自动停止监听，需要调用modify重新注册(多线程分发时保证同一连接只有一个线程在处理)
+    bool add(int fd, uint32_t interest, bool oneshot = false) {
+#ifdef __linux__
+        epoll_event ev{};
+        ev.events = to_epoll(interest, oneshot);
+        ev.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(static_cast<size_t>(fd) >= slot_of_fd_.size()) slot_of_fd_.resize(fd + 1, -1);
+        if(slot_of_fd_[fd] >= 0) return false;
+        slot_of_fd_[fd] = static_cast<int>(fds_.size());
+        fds_.push_back(pollfd{fd, to_poll(interest), 0});
+        oneshot_.push_back(oneshot);
+        return true;
+#endif
+    }
+
+    // 修改监听事件，线程安全(oneshot模式下用于重新启用fd)
+    bool modify(int fd, uint32_t interest, bool oneshot = false) {
+#ifdef __linux__
+        epoll_event ev{};
+        ev.events = to_epoll(interest, oneshot);
+        ev.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+#else
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(fd < 0 || static_cast<size_t>(fd) >= slot_of_fd_.size() || slot_of_fd_[fd] < 0) return false;
+        fds_[slot_of_fd_[fd]].events = to_poll(interest);
+        oneshot_[slot_of_fd_[fd]] = oneshot;
+        return true;
+#endif
+    }
+
+    // 移除fd，必须在close(fd)之前调用
+    void remove(int fd) {
+#ifdef __linux__
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+#else
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(fd < 0 || static_cast<size_t>(fd) >= slot_of_fd_.size() || slot_of_fd_[fd] < 0) return;
+        size_t slot = slot_of_fd_[fd];
+        size_t last = fds_.size() - 1;
+        slot_of_fd_[fd] = -1;
+        if(slot != last) {  // 与最后一个元素交换，O(1)删除
+            fds_[slot] = fds_[last];
+            oneshot_[slot] = oneshot_[last];
+            slot_of_fd_[fds_[slot].fd] = static_cast<int>(slot);
+        }
+        fds_.pop_back();
+        oneshot_.pop_back();
+#endif
+    }
+
+    // 等待事件，timeout_ms为-1表示无限等待
+    // 返回就绪事件数，被信号中断返回0，出错返回-1
+    int wait(std::vector<PollEvent>& out, int timeout_ms) {
+        out.clear();
+#ifdef __linux__
+        int n = epoll_wait(epoll_fd_, events_.data(), max_events_, timeout_ms);
+        if(n < 0) return errno == EINTR ? 0 : -1;
+        for(int i = 0; i < n; ++i) {
+            out.push_back(PollEvent{events_[i].data.fd, from_epoll(events_[i].events)});
+        }
+        return n;
+#else
+        // poll期间其他线程可能修改注册表，所以在快照上调用poll
+        std::vector<pollfd> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            snapshot = fds_;
+        }
+        int n = poll(snapshot.data(), snapshot.size(), timeout_ms);
+        if(n < 0) return errno == EINTR ? 0 : -1;
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(const pollfd& pfd : snapshot) {
+            if(pfd.revents == 0) continue;
+            int slot = static_cast<size_t>(pfd.fd) < slot_of_fd_.size() ? slot_of_fd_[pfd.fd] : -1;
+            if(slot < 0 || fds_[slot].events == 0) continue;  // 已被移除或oneshot已触发
+            out.push_back(PollEvent{pfd.fd, from_poll(pfd.revents)});
+            if(oneshot_[slot]) fds_[slot].events = 0;
+            if(static_cast<int>(out.size()) >= max_events_) break;
+        }
+        return static_cast<int>(out.size());
+#endif
+    }
+
+private:
+    int max_events_;
+#ifdef __linux__
+    int epoll_fd_ = -1;
+    std::vector<epoll_event> events_;
+
+    // 只在关心可读时监听对端关闭写方向(EPOLLRDHUP)：半关闭的连接只等待可写把剩余回复发完时，
+    // 水平触发的EPOLLRDHUP会一直就绪，导致事件循环空转
+    static uint32_t to_epoll(uint32_t interest, bool oneshot) {
+        uint32_t ev = 0;
+        if(interest & READABLE) ev |= EPOLLIN | EPOLLRDHUP;
+        if(interest & WRITABLE) ev |= EPOLLOUT;
+#ifdef EPOLLEXCLUSIVE
+        if(interest & EXCLUSIVE) ev = (ev & ~EPOLLRDHUP) | EPOLLEXCLUSIVE;  // EPOLLEXCLUSIVE不能和EPOLLRDHUP一起使用
+#endif
+        if(oneshot) ev |= EPOLLONESHOT;
+        return ev;
+    }
+
+    static uint32_t from_epoll(uint32_t ev) {
+        uint32_t out = 0;
+        if(ev & EPOLLIN) out |= READABLE;
+        if(ev & EPOLLOUT) out |= WRITABLE;
+        if(ev & (EPOLLHUP | EPOLLRDHUP)) out |= HANGUP;
+        if(ev & EPOLLERR) out |= ERROR;
+        return out;
+    }
+#else
+    std::mutex mtx_;
+    std::vector<pollfd> fds_;
+    std::vector<bool> oneshot_;
+    std::vector<int> slot_of_fd_;
+
+    static short to_poll(uint32_t interest) {
+        short ev = 0;
+        if(interest & READABLE) ev |= POLLIN;
+        if(interest & WRITABLE) ev |= POLLOUT;
+        return ev;
+    }
+
+    static uint32_t from_poll(short ev) {
+        uint32_t out = 0;
+        if(ev & POLLIN) out |= READABLE;
+        if(ev & POLLOUT) out |= WRITABLE;
+        if(ev & (POLLHUP | POLLNVAL)) out |= HANGUP;
+        if(ev & POLLERR) out |= ERROR;
+        return out;
+    }
+#endif
+};
@@ -0,0 +1,363 @@
+#pragma once
+// 基于UDP的可靠有序消息
+// 每个消息占一个数据报(不分片，最长MAX_PAYLOAD字节)，带32位序号；接收方按序号重排后按发送顺序交付，重复的丢弃
+// 每个数据报的头部都带有确认信息：ack为接收方下一个期望的序号(之前的都已交付)，
+// sack为ack之后64个序号的位图(选择确认)，有数据要发时确认直接捎带在数据报上，否则单独发一个纯确认
+// 发送方最多有window个未确认的消息(滑动窗口)，其余在队列中等待窗口
+// 重传：每个未确认的消息有自己的超时时间，RTO按RFC 6298由往返时间估计(重传过的消息不采样)，超时重传时指数退避；
+//      某个消息之后已有3个以上的消息被选择确认、并且它已经发出超过1.25倍往返时间时立即重传一次(快速重传)，不等超时
+// ReliableChannel不做任何I/O：调用方把收到的数据报交给on_packet，调用flush取出要发的数据报自己发出去，
+// 用next_timeout决定下一次什么时候调用flush，所以可以嵌进任何事件循环，一个socket可以服务很多个对端
+// 被动方(服务器)的通道不假定双方都从序号0开始，而是从对端的第一个数据报中取得起始序号：
+// 数据报带有发送方最早的未确认序号(收到的消息之前的都已交付)，ack是对端下一个期望的序号；
+// 服务器因为空闲丢弃了某个客户端的状态后，客户端继续发送的消息在新的通道上照常交付
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <arpa/inet.h>
+
+struct ReliableOptions {
+    unsigned window = 64;             // 最多未确认的消息数，向下取到2的幂，不超过ReliableChannel::MAX_WINDOW
+    uint32_t rto_initial_ms = 100;    // 还没有往返时间样本时的RTO
+    uint32_t rto_min_ms = 10;
+    uint32_t rto_max_ms = 2000;
+    unsigned max_retransmits = 15;    // 同一个消息超时重传超过这个次数时认为对端已不可达
+    bool passive = false;             // 被动方：起始序号取自对端的第一个数据报，而不是0
+};
+
+class ReliableChannel {
+public:
+    static constexpr size_t HEADER_SIZE = 24;
+    static constexpr size_t MAX_PAYLOAD = 1200;  // 加上头部后在以太网MTU以内，不会被IP分片
+    static constexpr unsigned MAX_WINDOW = 64;   // sack位图只能覆盖ack之后的64个序号
+
+    using Options = ReliableOptions;
+
+    explicit ReliableChannel(uint32_t conn_id, const Options& opt = Options())
+        : opt_(opt), conn_id_(conn_id), rto_ms_(opt.rto_initial_ms) {
+        // 槽位按序号取模，窗口取2的幂，序号回绕时下标仍然连续
+        if(opt_.window > MAX_WINDOW) opt_.window = MAX_WINDOW;
+        unsigned w = 1;
+        while(w * 2 <= opt_.window) w *= 2;
+        opt_.window = w;
+        send_.resize(opt_.window);
+        recv_.resize(opt_.window);
+        ack_pkt_.resize(HEADER_SIZE);
+        synced_ = !opt_.passive;
+    }
+
+    // 检查数据报是否是本协议的，并取出连接id；服务器用它找到数据报所属的ReliableChannel
+    static bool parse_conn_id(const char* pkt, size_t len, uint32_t& conn_id) {
+        if(len < HEADER_SIZE || static_cast<unsigned char>(pkt[0]) != MAGIC) return false;
+        conn_id = get32(pkt + 4);
+        return true;
+    }
+
+    uint32_t conn_id() const { return conn_id_; }
+
+    // 发送一个消息，超过MAX_PAYLOAD或连接已失败时返回false；窗口已满时先排队，数据在flush时才发出
+    bool send(const void* data, size_t len) {
+        if(len > MAX_PAYLOAD || failed_) return false;
+        if(pending_.empty() && in_flight() < opt_.window) {
+            push_slot(data, len);
+        }
+        else {
+            pending_.emplace_back(static_cast<const char*>(data), len);
+        }
+        return true;
+    }
+
+    // 处理一个收到的数据报，按顺序对每个可以交付的消息调用deliver(const char* data, size_t len)
+    // deliver中可以调用send(比如直接回复)；数据报不属于这个连接时返回false
+    template <class F>
+    bool on_packet(const char* pkt, size_t len, uint64_t now_ms, F&& deliver) {
+        uint32_t id;
+        if(!parse_conn_id(pkt, len, id) || id != conn_id_) return false;
+        uint8_t flags = static_cast<uint8_t>(pkt[1]);
+        if(!synced_) {
+            // 纯确认不带序号，等到第一个数据报再确定起始序号
+            if(!(flags & FLAG_DATA)) return true;
+            sync(get32(pkt + 8) - get16(pkt + 2), get32(pkt + 12));
+        }
+        on_ack(get32(pkt + 12), get64(pkt + 16), now_ms);
+        if(flags & FLAG_DATA) {
+            on_data(get32(pkt + 8), pkt + HEADER_SIZE, len - HEADER_SIZE, deliver);
+        }
+        return true;
+    }
+
+    // 取出现在要发的数据报(新消息、超时或快速重传、确认)，对每个调用emit(const char* data, size_t len)
+    // emit拿到的缓冲区在下一次调用这个对象的非const方法之前有效，可以先排进UdpSendBatch再统一发送
+    template <class E>
+    void flush(uint64_t now_ms, E&& emit) {
+        if(failed_) return;
+        // 窗口有空位时把排队的消息移进去
+        while(!pending_.empty() && in_flight() < opt_.window) {
+            push_slot(pending_.front().data(), pending_.front().size());
+            pending_.pop_front();
+        }
+
+        for(uint32_t seq = snd_una_; seq != snd_nxt_; ++seq) {
+            SendSlot& s = send_[seq % opt_.window];
+            if(s.sacked) continue;
+            bool timeout = !s.need_send && s.deadline_ms <= now_ms;
+            if(!s.need_send && !timeout) continue;
+            if(timeout) {
+                if(++s.timeouts > opt_.max_retransmits) {
+                    failed_ = true;
+                    return;
+                }
+                s.retransmitted = true;
+                ++retransmits_;
+            }
+            put16(&s.pkt[2], static_cast<uint16_t>(seq - snd_una_));  // 窗口不超过64，差值放得下
+            put_ack(&s.pkt[0]);
+            emit(s.pkt.data(), s.pkt.size());
+            s.need_send = false;
+            s.sent_ms = now_ms;
+            s.deadline_ms = now_ms + backoff(s.timeouts);
+            ack_pending_ = false;  // 确认已经捎带出去了
+        }
+
+        if(ack_pending_) {
+            ack_pkt_[0] = static_cast<char>(MAGIC);
+            ack_pkt_[1] = 0;
+            ack_pkt_[2] = ack_pkt_[3] = 0;
+            put32(&ack_pkt_[4], conn_id_);
+            put32(&ack_pkt_[8], 0);
+            put_ack(&ack_pkt_[0]);
+            emit(ack_pkt_.data(), ack_pkt_.size());
+            ack_pending_ = false;
+        }
+    }
+
+    // 距离下一次需要调用flush的毫秒数，没有需要发送或等待确认的数据时返回-1
+    int next_timeout(uint64_t now_ms) const {
+        if(failed_) return -1;
+        if(ack_pending_ || (!pending_.empty() && in_flight() < opt_.window)) return 0;
+        uint64_t earliest = UINT64_MAX;
+        for(uint32_t seq = snd_una_; seq != snd_nxt_; ++seq) {
+            const SendSlot& s = send_[seq % opt_.window];
+            if(s.sacked) continue;
+            if(s.need_send) return 0;
+            if(s.deadline_ms < earliest) earliest = s.deadline_ms;
+        }
+        if(earliest == UINT64_MAX) return -1;
+        if(earliest <= now_ms) return 0;
+        uint64_t wait = earliest - now_ms;
+        return wait > INT32_MAX ? INT32_MAX : static_cast<int>(wait);
+    }
+
+    bool failed() const { return failed_; }                                   // 重传次数超限，对端不可达
+    bool idle() const { return snd_una_ == snd_nxt_ && pending_.empty(); }  // 发出的消息都已确认
+    unsigned in_flight() const { return snd_nxt_ - snd_una_; }
+    size_t queued() const { return pending_.size(); }
+    uint32_t rto_ms() const { return rto_ms_; }
+    uint64_t retransmits() const { return retransmits_; }
+
+private:
+    static constexpr unsigned char MAGIC = 0xA7;
+    static constexpr uint8_t FLAG_DATA = 1;
+    static constexpr uint32_t FAST_RETRANSMIT_THRESHOLD = 3;
+
+    // 头部(网络字节序): [0]魔数 [1]标志 [2-3]序号减去发送方最早的未确认序号(纯确认为0)
+    //                  [4-7]连接id [8-11]序号 [12-15]ack [16-23]sack位图
+    struct SendSlot {
+        std::string pkt;            // 头部+消息，槽位复用时保留容量
+        uint64_t sent_ms = 0;       // 最近一次发送的时间
+        uint64_t deadline_ms = 0;   // 超时重传的时间
+        unsigned timeouts = 0;      // 超时重传的次数
+        bool need_send = false;     // 新消息或快速重传，下一次flush发出
+        bool sacked = false;        // 已被选择确认，不再重传
+        bool retransmitted = false; // 重传过的消息不采样往返时间(Karn算法)
+        bool fast_retransmitted = false;
+    };
+
+    struct RecvSlot {
+        std::string data;
+        bool present = false;
+    };
+
+    Options opt_;
+    uint32_t conn_id_;
+
+    // 发送方
+    uint32_t snd_una_ = 0;  // 最早的未确认序号
+    uint32_t snd_nxt_ = 0;  // 下一个新消息的序号
+    std::vector<SendSlot> send_;
+    std::deque<std::string> pending_;  // 等待窗口的消息
+    uint32_t rto_ms_;
+    double srtt_ms_ = 0;
+    double rttvar_ms_ = 0;
+    bool has_rtt_ = false;
+    uint64_t retransmits_ = 0;
+    bool failed_ = false;
+
+    // 接收方
+    uint32_t rcv_next_ = 0;  // 下一个要交付的序号
+    std::vector<RecvSlot> recv_;
+    bool ack_pending_ = false;
+    std::string ack_pkt_;
+    bool synced_;            // 起始序号已经确定(主动方一开始就是0)
+
+    // 序号回绕后仍然正确的比较
+    static bool seq_lt(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+    static void put16(char* p, uint16_t v) {
+        v = htons(v);
+        memcpy(p, &v, 2);
+    }
+    static uint16_t get16(const char* p) {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return ntohs(v);
+    }
+    static void put32(char* p, uint32_t v) {
+        v = htonl(v);
+        memcpy(p, &v, 4);
+    }
+    static uint32_t get32(const char* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return ntohl(v);
+    }
+    static void put64(char* p, uint64_t v) {
+        put32(p, static_cast<uint32_t>(v >> 32));
+        put32(p + 4, static_cast<uint32_t>(v));
+    }
+    static uint64_t get64(const char* p) {
+        return (static_cast<uint64_t>(get32(p)) << 32) | get32(p + 4);
+    }
+
+    // 被动方收到第一个数据报：rcv_base之前的消息对端已经确认，snd_base是对端期望的下一个序号
+    // 这时还没有发出任何消息(回复只在交付之后产生)，所以直接移动两个方向的起点
+    void sync(uint32_t rcv_base, uint32_t snd_base) {
+        rcv_next_ = rcv_base;
+        snd_una_ = snd_nxt_ = snd_base;
+        synced_ = true;
+    }
+
+    void push_slot(const void* data, size_t len) {
+        uint32_t seq = snd_nxt_++;
+        SendSlot& s = send_[seq % opt_.window];
+        s.pkt.resize(HEADER_SIZE + len);
+        s.pkt[0] = static_cast<char>(MAGIC);
+        s.pkt[1] = static_cast<char>(FLAG_DATA);
+        s.pkt[2] = s.pkt[3] = 0;
+        put32(&s.pkt[4], conn_id_);
+        put32(&s.pkt[8], seq);
+        if(len) memcpy(&s.pkt[HEADER_SIZE], data, len);
+        s.timeouts = 0;
+        s.need_send = true;
+        s.sacked = false;
+        s.retransmitted = false;
+        s.fast_retransmitted = false;
+    }
+
+    // 把当前的接收状态写进头部的ack和sack
+    void put_ack(char* pkt) const {
+        uint64_t sack = 0;
+        for(unsigned i = 0; i + 1 < opt_.window && i < 64; ++i) {
+            if(recv_[(rcv_next_ + 1 + i) % opt_.window].present) sack |= uint64_t(1) << i;
+        }
+        put32(pkt + 12, rcv_next_);
+        put64(pkt + 16, sack);
+    }
+
+    uint32_t backoff(unsigned timeouts) const {
+        uint64_t rto = rto_ms_;
+        for(unsigned i = 0; i < timeouts && rto < opt_.rto_max_ms; ++i) rto <<= 1;
+        return rto < opt_.rto_max_ms ? static_cast<uint32_t>(rto) : opt_.rto_max_ms;
+    }
+
+    // RFC 6298
+    void sample_rtt(uint64_t rtt_ms) {
+        double r = static_cast<double>(rtt_ms);
+        if(!has_rtt_) {
+            srtt_ms_ = r;
+            rttvar_ms_ = r / 2;
+            has_rtt_ = true;
+        }
+        else {
+            rttvar_ms_ = 0.75 * rttvar_ms_ + 0.25 * (srtt_ms_ > r ? srtt_ms_ - r : r - srtt_ms_);
+            srtt_ms_ = 0.875 * srtt_ms_ + 0.125 * r;
+        }
+        double rto = srtt_ms_ + (4 * rttvar_ms_ > 1 ? 4 * rttvar_ms_ : 1);
+        if(rto < opt_.rto_min_ms) rto = opt_.rto_min_ms;
+        if(rto > opt_.rto_max_ms) rto = opt_.rto_max_ms;
+        rto_ms_ = static_cast<uint32_t>(rto);
+    }
+
+    void on_ack(uint32_t ack, uint64_t sack, uint64_t now_ms) {
+        // 累计确认：ack之前的都已交付
+        if(seq_lt(snd_una_, ack) && !seq_lt(snd_nxt_, ack)) {
+            for(; snd_una_ != ack; ++snd_una_) {
+                SendSlot& s = send_[snd_una_ % opt_.window];
+                if(!s.sacked && !s.retransmitted) sample_rtt(now_ms - s.sent_ms);
+            }
+        }
+        if(sack == 0) return;
+
+        // 选择确认
+        uint32_t highest = snd_una_;
+        bool any = false;
+        for(unsigned i = 0; i < 64; ++i) {
+            if(!(sack & (uint64_t(1) << i))) continue;
+            uint32_t seq = ack + 1 + i;
+            if(seq_lt(seq, snd_una_) || !seq_lt(seq, snd_nxt_)) continue;
+            SendSlot& s = send_[seq % opt_.window];
+            if(!s.sacked) {
+                if(!s.retransmitted && !s.need_send) sample_rtt(now_ms - s.sent_ms);
+                s.sacked = true;
+            }
+            highest = seq;
+            any = true;
+        }
+        if(!any) return;
+
+        // 快速重传：后面已经有足够多的消息到达，而且这个消息发出后已经超过1.25倍平滑往返时间，很可能丢了
+        // 时间条件避免把乱序到达误判为丢包(与RACK相同的思路)，往返时间很小时退化为只看序号
+        uint64_t reorder_ms = static_cast<uint64_t>(srtt_ms_ * 1.25);
+        for(uint32_t seq = snd_una_; seq_lt(seq, highest); ++seq) {
+            SendSlot& s = send_[seq % opt_.window];
+            if(s.sacked || s.need_send || s.fast_retransmitted) continue;
+            if(highest - seq < FAST_RETRANSMIT_THRESHOLD) break;
+            if(now_ms - s.sent_ms < reorder_ms) continue;
+            s.fast_retransmitted = true;
+            s.retransmitted = true;
+            s.need_send = true;
+            ++retransmits_;
+        }
+    }
+
+    template <class F>
+    void on_data(uint32_t seq, const char* data, size_t len, F& deliver) {
+        ack_pending_ = true;  // 重复的和超出窗口的也要确认，对端可能没收到之前的确认
+        if(seq_lt(seq, rcv_next_) || seq - rcv_next_ >= opt_.window) return;
+
+        if(seq == rcv_next_) {
+            // 正好是下一个：直接从数据报交付，不拷贝
+            ++rcv_next_;
+            deliver(data, len);
+        }
+        else {
+            RecvSlot& r = recv_[seq % opt_.window];
+            if(!r.present) {
+                r.data.assign(data, len);
+                r.present = true;
+            }
+            return;
+        }
+        // 交付之前乱序到达、现在已经连续的消息
+        while(recv_[rcv_next_ % opt_.window].present) {
+            RecvSlot& r = recv_[rcv_next_ % opt_.window];
+            r.present = false;
+            ++rcv_next_;
+            deliver(r.data.data(), r.data.size());
+        }
+    }
+};
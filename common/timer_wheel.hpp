@@ -0,0 +1,258 @@
+#pragma once
+// 分层时间轮
+// 6层，每层64个槽：第0层每槽1个tick，第L层每槽64^L个tick，一共覆盖2^36个tick(1ms一个tick时约两年)
+// 定时器按到期时间与当前时间的差放进对应层的槽里，第0层转完一圈时把上一层当前槽里的定时器重新分配到下层(cascade)，
+// 所以添加、重置、取消都是O(1)，一次推进只处理真正到期或需要下移的槽
+// 每层用一个64位的位图记录非空的槽，计算下一次需要醒来的时间只要每层一次位运算，
+// 事件循环把它作为poll/epoll_wait的超时，没有定时器到期时不会周期性唤醒
+// 节点放在按下标复用的数组中，链表用下标连接；TimerId带有代数，已到期或已取消的id再次使用时直接忽略
+// 不是线程安全的，每个事件循环各自持有一个
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <utility>
+
+class TimerWheel {
+public:
+    using TimerId = uint64_t;                  // 高32位为代数，低32位为节点下标
+    static constexpr TimerId INVALID_TIMER = 0;  // 代数从1开始，0永远不是有效的id
+
+    explicit TimerWheel(uint32_t tick_ms = 1, uint64_t now_ms = clock_ms())
+        : tick_ms_(tick_ms ? tick_ms : 1), base_ms_(now_ms) {
+        for(uint32_t& h : heads_) h = NIL;
+    }
+
+    // 单调时钟的毫秒数
+    static uint64_t clock_ms() {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 添加一个从now_ms起delay_ms后到期的定时器，到期时把data交给advance的回调
+    TimerId add(uint64_t delay_ms, uint64_t data, uint64_t now_ms = clock_ms()) {
+        uint32_t idx;
+        if(free_ != NIL) {
+            idx = free_;
+            free_ = nodes_[idx].next;
+        }
+        else {
+            idx = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+        }
+        Node& n = nodes_[idx];
+        n.data = data;
+        n.expire = expire_of(delay_ms, now_ms);
+        link(idx);
+        ++count_;
+        return (static_cast<TimerId>(n.gen) << 32) | idx;
+    }
+
+    // 把定时器改为从now_ms起delay_ms后到期，id已失效时返回false
+    bool reset(TimerId id, uint64_t delay_ms, uint64_t now_ms = clock_ms()) {
+        uint32_t idx;
+        if(!valid(id, idx)) return false;
+        unlink(idx);
+        nodes_[idx].expire = expire_of(delay_ms, now_ms);
+        link(idx);
+        return true;
+    }
+
+    // 取消定时器，id已失效(已到期或已取消)时什么也不做
+    void cancel(TimerId id) {
+        uint32_t idx;
+        if(!valid(id, idx)) return;
+        unlink(idx);
+        release(idx);
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    // 距离下一次需要调用advance的毫秒数，可以直接作为poll/epoll_wait的超时；没有定时器时返回-1
+    // 上层的槽需要下移时也会返回，所以可能比真正的到期时间早醒来，但不会晚
+    int next_timeout(uint64_t now_ms = clock_ms()) const {
+        if(count_ == 0) return -1;
+        uint64_t due_ms = base_ms_ + (now_ + ticks_until_next()) * tick_ms_;
+        if(due_ms <= now_ms) return 0;
+        uint64_t wait = due_ms - now_ms;
+        return wait > INT32_MAX ? INT32_MAX : static_cast<int>(wait);
+    }
+
+    // 推进到now_ms，对每个到期的定时器调用on_expire(TimerId, data)
+    // 回调中可以添加、重置、取消任意定时器，包括同一批中还没回调的
+    template <class F>
+    void advance(uint64_t now_ms, F&& on_expire) {
+        if(now_ms < base_ms_) return;
+        uint64_t target = (now_ms - base_ms_) / tick_ms_;
+        while(now_ <= target) {
+            if(count_ == 0) {
+                now_ = target + 1;
+                break;
+            }
+            // 中间没有需要处理的槽时直接跳过，长时间空闲后推进也不用逐个tick走
+            uint64_t skip = ticks_until_next();
+            if(now_ + skip > target) {
+                now_ = target + 1;
+                break;
+            }
+            now_ += skip;
+
+            // 低层转完一圈时，把上层当前槽里的定时器重新分配到下层
+            for(int level = 1; level < LEVELS; ++level) {
+                uint64_t shift = SLOT_BITS * level;
+                if(now_ & ((uint64_t(1) << shift) - 1)) break;
+                cascade(level, static_cast<uint32_t>((now_ >> shift) & SLOT_MASK));
+            }
+
+            // 先把到期的槽整体移到PENDING链表再推进当前时间，回调中新加的0延迟定时器会留到下一个tick，不会在这里死循环
+            uint32_t slot = static_cast<uint32_t>(now_ & SLOT_MASK);
+            move_slot(slot, PENDING);
+            ++now_;
+            while(heads_[PENDING] != NIL) {
+                uint32_t idx = heads_[PENDING];
+                TimerId id = (static_cast<TimerId>(nodes_[idx].gen) << 32) | idx;
+                uint64_t data = nodes_[idx].data;
+                unlink(idx);
+                release(idx);
+                on_expire(id, data);
+            }
+        }
+    }
+
+    template <class F>
+    void advance(F&& on_expire) { advance(clock_ms(), std::forward<F>(on_expire)); }
+
+private:
+    static constexpr int LEVELS = 6;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELAY = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr uint32_t PENDING = LEVELS * SLOTS;  // 正在回调的到期定时器
+    static constexpr uint32_t FREE = PENDING + 1;        // 节点不在任何链表中
+
+    struct Node {
+        uint64_t expire = 0;  // 到期的tick
+        uint64_t data = 0;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;  // 空闲节点用它串成空闲链表
+        uint32_t slot = FREE;
+        uint32_t gen = 1;
+    };
+
+    uint32_t tick_ms_;
+    uint64_t base_ms_;   // tick 0对应的时间
+    uint64_t now_ = 0;   // 下一个要处理的tick
+    size_t count_ = 0;
+    std::vector<Node> nodes_;
+    uint32_t free_ = NIL;
+    uint32_t heads_[LEVELS * SLOTS + 1];
+    uint64_t occupied_[LEVELS] = {};  // 每层非空槽的位图
+
+    // 到期时间向上取整到tick，不会早于now_ms + delay_ms到期，最多晚一个tick
+    // 按调用时的时钟而不是上次advance的时间计算，事件循环阻塞了多久都不会让定时器提前到期
+    uint64_t expire_of(uint64_t delay_ms, uint64_t now_ms) const {
+        if(delay_ms > MAX_DELAY * tick_ms_) delay_ms = MAX_DELAY * tick_ms_;
+        uint64_t due_ms = (now_ms > base_ms_ ? now_ms - base_ms_ : 0) + delay_ms;
+        uint64_t expire = (due_ms + tick_ms_ - 1) / tick_ms_;
+        if(expire > now_ && expire - now_ > MAX_DELAY) expire = now_ + MAX_DELAY;
+        return expire;
+    }
+
+    bool valid(TimerId id, uint32_t& idx) const {
+        idx = static_cast<uint32_t>(id);
+        return idx < nodes_.size() && nodes_[idx].gen == static_cast<uint32_t>(id >> 32) &&
+               nodes_[idx].slot != FREE;
+    }
+
+    // 按到期时间与当前时间的差选择层和槽，已经过期的放到当前槽
+    uint32_t slot_of(uint64_t expire) const {
+        if(expire <= now_) return static_cast<uint32_t>(now_ & SLOT_MASK);
+        uint64_t delta = expire - now_;
+        int level = 0;
+        while(level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) ++level;
+        return level * SLOTS + static_cast<uint32_t>((expire >> (SLOT_BITS * level)) & SLOT_MASK);
+    }
+
+    void link(uint32_t idx) { push(idx, slot_of(nodes_[idx].expire)); }
+
+    void push(uint32_t idx, uint32_t slot) {
+        Node& n = nodes_[idx];
+        n.slot = slot;
+        n.prev = NIL;
+        n.next = heads_[slot];
+        if(n.next != NIL) nodes_[n.next].prev = idx;
+        heads_[slot] = idx;
+        if(slot < PENDING) occupied_[slot / SLOTS] |= uint64_t(1) << (slot % SLOTS);
+    }
+
+    void unlink(uint32_t idx) {
+        Node& n = nodes_[idx];
+        if(n.prev != NIL) nodes_[n.prev].next = n.next;
+        else heads_[n.slot] = n.next;
+        if(n.next != NIL) nodes_[n.next].prev = n.prev;
+        if(n.slot < PENDING && heads_[n.slot] == NIL) {
+            occupied_[n.slot / SLOTS] &= ~(uint64_t(1) << (n.slot % SLOTS));
+        }
+        n.slot = FREE;
+    }
+
+    void release(uint32_t idx) {
+        Node& n = nodes_[idx];
+        ++n.gen;
+        if(n.gen == 0) n.gen = 1;
+        n.next = free_;
+        free_ = idx;
+        --count_;
+    }
+
+    // 把第0层的slot整个挂到dst链表
+    void move_slot(uint32_t slot, uint32_t dst) {
+        while(heads_[slot] != NIL) {
+            uint32_t idx = heads_[slot];
+            unlink(idx);
+            push(idx, dst);
+        }
+    }
+
+    // 把第level层的槽里的定时器按新的当前时间重新放置，它们都会落到更低的层
+    void cascade(int level, uint32_t index) {
+        uint32_t slot = level * SLOTS + index;
+        uint32_t idx = heads_[slot];
+        heads_[slot] = NIL;
+        occupied_[level] &= ~(uint64_t(1) << index);
+        while(idx != NIL) {
+            uint32_t next = nodes_[idx].next;
+            link(idx);
+            idx = next;
+        }
+    }
+
+    static int ctz(uint64_t x) { return __builtin_ctzll(x); }
+
+    static uint64_t rotr(uint64_t x, unsigned r) {
+        r &= 63;
+        return r ? (x >> r) | (x << (64 - r)) : x;
+    }
+
+    // 从now_起到下一个需要处理的tick(第0层有定时器的槽，或者上层有定时器的槽需要下移)的tick数
+    uint64_t ticks_until_next() const {
+        uint64_t best = UINT64_MAX;
+        if(occupied_[0]) {
+            best = ctz(rotr(occupied_[0], static_cast<unsigned>(now_ & SLOT_MASK)));
+        }
+        for(int level = 1; level < LEVELS; ++level) {
+            if(!occupied_[level]) continue;
+            // 第level层的槽s在tick k*64^level处下移，其中k与s模64同余
+            unsigned shift = SLOT_BITS * level;
+            uint64_t first = (now_ + (uint64_t(1) << shift) - 1) >> shift;  // 不早于now_的第一个下移点
+            uint64_t k = first + ctz(rotr(occupied_[level], static_cast<unsigned>(first & SLOT_MASK)));
+            uint64_t delta = (k << shift) - now_;
+            if(delta < best) best = delta;
+        }
+        return best;
+    }
+};
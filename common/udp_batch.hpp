@@ -0,0 +1,235 @@
+#pragma once
+// UDP批量收发
+// UdpRecvBatch: 预先分配N个定长槽位和对应的mmsghdr/iovec/地址数组，一次recvmmsg最多收N个数据报，
+//               每次调用复用同一组槽位，收包路径上没有内存分配和清零
+// UdpSendBatch: 积累最多N个待发送的数据报(只记录指针和目标地址，不拷贝内容)，一次sendmmsg发出
+// 一次系统调用处理一批数据报，系统调用和上下文切换的开销被整批分摊
+// GSO/GRO(Linux 4.18/5.0起): 发送时一个消息携带多个等长的段，通过UDP_SEGMENT告诉内核段长，
+//                           整个消息只走一遍协议栈，到网卡(或环回设备)时才切成多个数据报；
+//                           开启UDP_GRO的socket接收时内核把同一条流连续的数据报合并成一个缓冲区，
+//                           段长通过UDP_GRO控制消息返回，由应用自己切分
+
+#include <cstddef>
+#include <cerrno>
+#include <vector>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+// 一个GSO消息最多携带的段数(内核的UDP_MAX_SEGMENTS)和总长度上限(IP包长度上限减去IP头和UDP头)
+constexpr unsigned UDP_GSO_MAX_SEGMENTS = 64;
+constexpr size_t UDP_GSO_MAX_BYTES = 65535 - 20 - 8;
+
+// 段长为segment_size时一个GSO消息最多能携带的段数
+inline unsigned udp_gso_max_segments(size_t segment_size) {
+    if(segment_size == 0) return 1;
+    size_t n = UDP_GSO_MAX_BYTES / segment_size;
+    if(n == 0) return 1;
+    return n < UDP_GSO_MAX_SEGMENTS ? static_cast<unsigned>(n) : UDP_GSO_MAX_SEGMENTS;
+}
+
+// 在socket上开启UDP_GRO，内核不支持时返回false
+inline bool enable_udp_gro(int fd) {
+#ifdef __linux__
+    int on = 1;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+// 探测内核是否支持UDP_SEGMENT：支持时getsockopt能读到当前的段长(默认0)
+inline bool udp_gso_supported(int fd) {
+#ifdef __linux__
+    int val = 0;
+    socklen_t len = sizeof(val);
+    return getsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+class UdpRecvBatch {
+public:
+    static constexpr size_t DEFAULT_SLOT_SIZE = 2048;  // 能容纳以太网MTU以内的数据报
+    static constexpr size_t GRO_SLOT_SIZE = 65536;     // 开启GRO时一个槽位要能放下合并后的缓冲区
+
+    // gro为true时每个槽位附带一个控制消息缓冲区，用来接收UDP_GRO的段长；socket上还需要enable_udp_gro
+    explicit UdpRecvBatch(unsigned capacity = 64, size_t slot_size = DEFAULT_SLOT_SIZE, bool gro = false)
+        : slot_size_(slot_size), buf_(capacity * slot_size), msgs_(capacity), iov_(capacity), addrs_(capacity),
+          control_size_(gro ? CMSG_SPACE(sizeof(int)) : 0), control_(capacity * control_size_) {
+        for(unsigned i = 0; i < capacity; ++i) {
+            iov_[i].iov_base = buf_.data() + i * slot_size_;
+            iov_[i].iov_len = slot_size_;
+        }
+    }
+
+    UdpRecvBatch(const UdpRecvBatch&) = delete;
+    UdpRecvBatch& operator=(const UdpRecvBatch&) = delete;
+
+    // 收一批数据报，返回个数，出错返回-1(errno)
+    // 默认MSG_WAITFORONE：阻塞到至少有一个数据报，然后把已经到达的全部取走而不再等待
+    int recv(int fd, int flags = MSG_WAITFORONE) {
+        // recvmmsg会改写msg_namelen和msg_flags，每次调用前重新设置
+        for(size_t i = 0; i < msgs_.size(); ++i) {
+            msghdr& h = msgs_[i].msg_hdr;
+            h.msg_name = &addrs_[i];
+            h.msg_namelen = sizeof(sockaddr_in);
+            h.msg_iov = &iov_[i];
+            h.msg_iovlen = 1;
+            h.msg_control = control_size_ ? control_.data() + i * control_size_ : nullptr;
+            h.msg_controllen = control_size_;
+            h.msg_flags = 0;
+        }
+        int n = recvmmsg(fd, msgs_.data(), static_cast<unsigned>(msgs_.size()), flags, nullptr);
+        count_ = n > 0 ? static_cast<unsigned>(n) : 0;
+        return n;
+    }
+
+    unsigned size() const { return count_; }
+    unsigned capacity() const { return static_cast<unsigned>(msgs_.size()); }
+
+    const char* data(unsigned i) const { return static_cast<const char*>(iov_[i].iov_base); }
+    size_t len(unsigned i) const { return msgs_[i].msg_len; }
+    const sockaddr_in& addr(unsigned i) const { return addrs_[i]; }
+    bool truncated(unsigned i) const { return msgs_[i].msg_hdr.msg_flags & MSG_TRUNC; }  // 数据报比槽位大，尾部被丢弃
+
+    // 第i个槽位由GRO合并时返回段长，除最后一段外每段都是这个长度；没有合并时返回0，整个槽位是一个数据报
+    size_t segment_size(unsigned i) const {
+#ifdef __linux__
+        if(control_size_ == 0) return 0;
+        msghdr& h = const_cast<msghdr&>(msgs_[i].msg_hdr);
+        for(cmsghdr* c = CMSG_FIRSTHDR(&h); c != nullptr; c = CMSG_NXTHDR(&h, c)) {
+            if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                int seg;
+                memcpy(&seg, CMSG_DATA(c), sizeof(seg));
+                return seg > 0 ? static_cast<size_t>(seg) : 0;
+            }
+        }
+#else
+        (void)i;
+#endif
+        return 0;
+    }
+
+    // 第i个槽位包含的数据报个数
+    unsigned segments(unsigned i) const {
+        size_t seg = segment_size(i);
+        size_t n = len(i);
+        return seg == 0 || n == 0 ? 1 : static_cast<unsigned>((n + seg - 1) / seg);
+    }
+
+private:
+    size_t slot_size_;
+    std::vector<char> buf_;  // capacity个槽位连续存放
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iov_;
+    std::vector<sockaddr_in> addrs_;
+    size_t control_size_;
+    std::vector<char> control_;
+    unsigned count_ = 0;
+};
+
+
+class UdpSendBatch {
+public:
+    explicit UdpSendBatch(unsigned capacity = 64)
+        : msgs_(capacity), iov_(capacity), addrs_(capacity), control_(capacity * CONTROL_SIZE) {}
+
+    UdpSendBatch(const UdpSendBatch&) = delete;
+    UdpSendBatch& operator=(const UdpSendBatch&) = delete;
+
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == msgs_.size(); }
+    unsigned size() const { return count_; }
+
+    // 排入一个数据报，data在flush之前必须有效；to会被拷贝，可以指向马上要被复用的接收槽位
+    // segment_size非0时这是一个GSO消息：内核把data按segment_size切成多个数据报发给to，
+    // 段数不能超过udp_gso_max_segments(segment_size)
+    // 已满时先调用flush
+    void add(const sockaddr_in& to, const void* data, size_t len, size_t segment_size = 0) {
+        addrs_[count_] = to;
+        iov_[count_].iov_base = const_cast<void*>(data);
+        iov_[count_].iov_len = len;
+        msghdr& h = msgs_[count_].msg_hdr;
+        h.msg_name = &addrs_[count_];
+        h.msg_namelen = sizeof(sockaddr_in);
+        h.msg_iov = &iov_[count_];
+        h.msg_iovlen = 1;
+        h.msg_control = nullptr;
+        h.msg_controllen = 0;
+        h.msg_flags = 0;
+#ifdef __linux__
+        if(segment_size != 0 && segment_size < len) {
+            char* control = control_.data() + count_ * CONTROL_SIZE;
+            memset(control, 0, CONTROL_SIZE);
+            h.msg_control = control;
+            h.msg_controllen = CONTROL_SIZE;
+            cmsghdr* c = CMSG_FIRSTHDR(&h);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t seg = static_cast<uint16_t>(segment_size);
+            memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+        }
+#else
+        (void)segment_size;
+#endif
+        ++count_;
+    }
+
+    // 已connect的socket不需要目标地址
+    void add(const void* data, size_t len, size_t segment_size = 0) {
+        add(sockaddr_in{}, data, len, segment_size);
+        msgs_[count_ - 1].msg_hdr.msg_name = nullptr;
+        msgs_[count_ - 1].msg_hdr.msg_namelen = 0;
+    }
+
+    // 发出所有排队的数据报，返回成功发出的个数；sendmmsg在中途出错时跳过出错的那个继续发送
+    // (UDP本身不保证送达，发不出去的数据报直接丢弃)，非阻塞socket遇到EAGAIN时丢弃剩余的数据报
+    // 返回后队列总是清空，出错时errno保留最后一次的错误
+    unsigned flush(int fd, int flags = 0) {
+        unsigned sent = 0;
+        unsigned pos = 0;
+        while(pos < count_) {
+            int n = sendmmsg(fd, msgs_.data() + pos, count_ - pos, flags);
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+                ++pos;  // 第一个数据报出错(例如目标不可达)，跳过它
+                continue;
+            }
+            sent += static_cast<unsigned>(n);
+            pos += static_cast<unsigned>(n);
+        }
+        count_ = 0;
+        return sent;
+    }
+
+private:
+    static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iov_;
+    std::vector<sockaddr_in> addrs_;
+    std::vector<char> control_;  // 每个消息一个UDP_SEGMENT控制消息的位置
+    unsigned count_ = 0;
+};
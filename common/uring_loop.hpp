@@ -0,0 +1,478 @@
+#pragma once
+// 基于io_uring的TCP服务器事件循环(完成模型)
+// epoll告诉我们"哪个fd可以读写了"，再由我们调用accept/recv/send；这里直接把操作本身提交给内核：
+//   一个多shot accept接受所有新连接，每个连接一个多shot recv，数据到达时内核从共享的提供缓冲区环中取缓冲区，
+//   回复用sendmsg(MSG_WAITALL)发出，短写由内核自己继续；最后一批回复后面可以链接一个shutdown
+// 一轮循环中处理完成项时产生的所有新操作只是写进提交队列，下一次等待时和收割完成项合并成一次io_uring_enter
+//
+// 背压：发送积压超过high_watermark时取消该连接的recv，取消生效之前已经收到的数据连同提供缓冲区留在连接上，
+//       不处理也不还给内核，积压降下来后再按顺序处理；缓冲区环被取空时其他连接的recv以ENOBUFS结束，
+//       这些连接等到有缓冲区归还时再重新提交，而不是立即重试
+// 一个连接的在途操作全部完成之前，连接的内存(sendmsg引用的iovec和数据)和fd都不能释放
+//
+// Handler需要提供:
+//   void on_open(int fd, Conn& conn)                    新连接，conn.addr已填好
+//   bool on_input(int fd, Conn& conn)                   处理conn.in中的数据，回复排入conn.out，返回false立即关闭连接
+//   bool on_eof(int fd, Conn& conn)                     对端关闭了写方向，返回true表示写完已排队的回复再关闭
+//   bool close_after_send(const Conn& conn)             不再读取，写完已排队的回复后关闭(如Connection: close)
+//   void on_close(int fd, Conn& conn, CloseReason why)  连接关闭之前调用
+//   uint64_t timeout(const Conn& conn, bool writing)    下一次超时的毫秒数，writing表示还有回复没写完
+// Conn需要有 sockaddr_in addr、ConnBuffer in、OutQueue out 三个成员
+
+#include "io_uring.hpp"
+
+#ifdef HAVE_IO_URING
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include "out_queue.hpp"
+#include "timer_wheel.hpp"
+
+// 一个连接在io_uring上的收发状态：最多一个多shot recv和一个sendmsg在途，记录在途操作数
+// 发送用两个队列交替：out继续接收新的回复，sending是在途sendmsg引用的数据，完成之前不能修改
+class UringConn {
+public:
+    bool recv_armed() const { return recv_armed_; }
+    bool closing() const { return closing_; }
+    unsigned inflight() const { return inflight_; }
+    bool shut_down() const { return shutdown_sent_; }                   // 已经提交了shutdown
+    bool finished() const { return shutdown_done_ && inflight_ == 0; }  // shutdown和其他操作都已完成
+    size_t pending_bytes(const OutQueue& out) const { return out.bytes() + sending_.bytes(); }
+
+    bool arm_recv(IoUring& ring, int fd, uint16_t group) {
+        if(recv_armed_ || closing_ || shutdown_sent_) return true;
+        if(!ring.recv_multishot(fd, group, uring_data(fd, URING_RECV))) return false;
+        recv_armed_ = true;
+        ++inflight_;
+        return true;
+    }
+
+    // 停止接收，recv以-ECANCELED完成后recv_armed才变为false
+    bool pause_recv(IoUring& ring, int fd) {
+        if(!recv_armed_ || cancel_requested_) return true;
+        cancel_requested_ = true;
+        return ring.cancel(uring_data(fd, URING_RECV), uring_data(fd, URING_CANCEL));
+    }
+
+    // recv完成项，不带F_MORE时多shot已经停止
+    void on_recv(const io_uring_cqe& cqe) {
+        if(cqe.flags & IORING_CQE_F_MORE) return;
+        recv_armed_ = false;
+        cancel_requested_ = false;
+        --inflight_;
+    }
+
+    // 没有在途的sendmsg时，把out中排队的回复全部交给内核
+    // shutdown_after为true时在最后一个sendmsg后面链接shutdown，全部写出后关闭两个方向，在途的recv也会看到EOF
+    bool send(IoUring& ring, int fd, OutQueue& out, bool shutdown_after = false) {
+        if(send_inflight_ || closing_ || shutdown_sent_) return true;
+        if(sending_.empty()) {
+            if(out.empty()) return shutdown_after ? submit_shutdown(ring, fd) : true;
+            std::swap(out, sending_);
+        }
+        msg_ = msghdr{};
+        msg_.msg_iov = iov_;
+        msg_.msg_iovlen = sending_.fill_iov(iov_, OutQueue::MAX_IOV);
+        // 片段超过MAX_IOV时本次只写出一部分，剩下的在完成后继续，这时还不能链接shutdown
+        bool link = shutdown_after && out.empty() && sending_.segments() <= OutQueue::MAX_IOV;
+        if(!ring.sendmsg(fd, &msg_, MSG_WAITALL | MSG_NOSIGNAL, uring_data(fd, URING_SEND), link)) return false;
+        send_inflight_ = true;
+        ++inflight_;
+        return link ? submit_shutdown(ring, fd) : true;
+    }
+
+    // send完成项，出错(对端已关闭等)时返回false并设置errno
+    bool on_send(const io_uring_cqe& cqe) {
+        send_inflight_ = false;
+        --inflight_;
+        if(cqe.res < 0) {
+            errno = -cqe.res;
+            return false;
+        }
+        sending_.consume(static_cast<size_t>(cqe.res));
+        return true;
+    }
+
+    // shutdown完成项，前面链接的sendmsg失败时以-ECANCELED完成
+    void on_shutdown() {
+        shutdown_done_ = true;
+        --inflight_;
+    }
+
+    // 开始关闭：取消所有在途操作，之后只等待它们的完成项
+    void begin_close(IoUring& ring, int fd) {
+        if(closing_) return;
+        closing_ = true;
+        if(inflight_ > 0) ring.cancel_fd(fd, uring_data(fd, URING_CANCEL));
+    }
+
+    // 因背压留在连接上的提供缓冲区，按收到的顺序排列
+    void hold(uint16_t bid, uint32_t len) { held_.emplace_back(bid, len); }
+    bool holding() const { return !held_.empty(); }
+    std::pair<uint16_t, uint32_t> take_held() {
+        std::pair<uint16_t, uint32_t> front = held_.front();
+        held_.pop_front();
+        return front;
+    }
+
+private:
+    OutQueue sending_;
+    struct iovec iov_[OutQueue::MAX_IOV];
+    msghdr msg_{};
+    std::deque<std::pair<uint16_t, uint32_t>> held_;
+    unsigned inflight_ = 0;  // 已提交、还没收到最后一个完成项的操作数
+    bool recv_armed_ = false;
+    bool cancel_requested_ = false;
+    bool send_inflight_ = false;
+    bool shutdown_sent_ = false;
+    bool shutdown_done_ = false;
+    bool closing_ = false;
+
+    bool submit_shutdown(IoUring& ring, int fd) {
+        if(!ring.shutdown(fd, SHUT_RDWR, uring_data(fd, URING_SHUTDOWN))) return false;
+        shutdown_sent_ = true;
+        ++inflight_;
+        return true;
+    }
+};
+
+
+enum CloseReason {
+    CLOSE_EOF,       // 对端关闭
+    CLOSE_TIMEOUT,   // 读/写/空闲超时
+    CLOSE_ERROR,     // 收发出错或者请求非法，错误已经输出
+    CLOSE_DONE,      // 写完最后的回复后正常关闭
+    CLOSE_SHUTDOWN,  // 服务器退出
+};
+
+template <class Conn, class Handler>
+class UringLoop {
+public:
+    // entries为提交队列大小；每个事件循环buffer_count个buffer_size字节的接收缓冲区(buffer_count为2的幂)
+    UringLoop(Handler& handler, size_t high_watermark, unsigned entries = 1024,
+              unsigned buffer_count = 1024, size_t buffer_size = 4096)
+        : handler_(handler), high_watermark_(high_watermark), entries_(entries),
+          buffer_count_(buffer_count), buffer_size_(buffer_size) {}
+
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    // 创建io_uring和缓冲区环，提交listen_fd上的多shot accept和wakeup_fd上的poll
+    // drain_fd可读时停止accept(取消多shot accept)，已有连接全部关闭后run返回；-1表示不使用
+    // 返回false并设置errno表示内核不支持，调用方应当回退到epoll
+    bool init(int listen_fd, int wakeup_fd, int drain_fd = -1) {
+        if(!ring_.init(entries_) || !buffers_.init(ring_, 0, buffer_count_, buffer_size_)) return false;
+        listen_fd_ = listen_fd;
+        wakeup_fd_ = wakeup_fd;
+        drain_fd_ = drain_fd;
+        if(!ring_.accept_multishot(listen_fd_, uring_data(listen_fd_, URING_ACCEPT)) ||
+           !ring_.poll_add(wakeup_fd_, POLLIN, uring_data(wakeup_fd_, URING_WAKEUP)) ||
+           (drain_fd_ >= 0 && !ring_.poll_add(drain_fd_, POLLIN, uring_data(drain_fd_, URING_DRAIN)))) {
+            errno = EBUSY;
+            return false;
+        }
+        accept_armed_ = wakeup_armed_ = true;
+        drain_armed_ = drain_fd_ >= 0;
+        return true;
+    }
+
+    // 运行直到running变为false(同时通知wakeup_fd)，或者停止accept后已有连接全部结束，
+    // 退出前取消所有在途操作并关闭所有连接
+    void run(const std::atomic<bool>& running) {
+        running_ = &running;
+        while(running && !(draining_ && conns_.empty())) {
+            // 提交上一轮积累的所有操作，并等待至少一个完成项；超时时间为最近一个连接定时器的到期时间
+            if(ring_.submit_and_wait(1, timers_.next_timeout()) < 0) {
+                std::cerr << "[ERROR] ";
+                perror("Io_uring Enter Failed");
+                continue;
+            }
+            ++enters_;
+            recycled_ = false;
+            ring_.for_each_cqe([this](const io_uring_cqe& cqe) { on_complete(cqe); });
+            if(recycled_ && !starved_.empty()) rearm_starved();
+            timers_.advance([this](TimerWheel::TimerId, uint64_t fd) { on_timeout(static_cast<int>(fd)); });
+        }
+        shutdown();
+    }
+
+    uint64_t enters() const { return enters_; }            // io_uring_enter的次数
+    uint64_t completions() const { return completions_; }  // 处理的完成项个数
+
+private:
+    struct Entry {
+        Conn conn;
+        UringConn io;
+        TimerWheel::TimerId timer = TimerWheel::INVALID_TIMER;
+        bool eof = false;      // 对端已关闭写方向，写完回复后关闭
+        bool starved = false;  // recv因缓冲区环为空而停止，等待缓冲区归还
+    };
+
+    Handler& handler_;
+    const size_t high_watermark_;
+    const unsigned entries_, buffer_count_;
+    const size_t buffer_size_;
+    IoUring ring_;
+    BufferRing buffers_;
+    int listen_fd_ = -1, wakeup_fd_ = -1, drain_fd_ = -1;
+    bool accept_armed_ = false, wakeup_armed_ = false, drain_armed_ = false;
+    bool draining_ = false;  // 已停止accept，只处理已有连接
+    const std::atomic<bool>* running_ = nullptr;
+    std::unordered_map<int, Entry> conns_;  // 在途操作引用Entry中的内存，unordered_map增删时不移动已有元素
+    TimerWheel timers_;
+    std::vector<int> starved_;
+    bool recycled_ = false;  // 本轮有缓冲区归还
+    uint64_t enters_ = 0, completions_ = 0;
+
+    void recycle(uint16_t bid) {
+        buffers_.recycle(bid);
+        recycled_ = true;
+    }
+
+    void release_held(Entry& e) {
+        while(e.io.holding()) recycle(e.io.take_held().first);
+    }
+
+    void on_complete(const io_uring_cqe& cqe) {
+        ++completions_;
+        int fd = uring_fd(cqe.user_data);
+        switch(uring_op(cqe.user_data)) {
+        case URING_WAKEUP:
+            wakeup_armed_ = false;  // 退出通知，回到循环条件检查running
+            return;
+        case URING_DRAIN:
+            // 一次性的poll，不再重新提交(通知fd保持可读)；取消accept后监听socket上的新连接留给其他进程
+            drain_armed_ = false;
+            if(cqe.res < 0) return;  // 关闭时被取消
+            draining_ = true;
+            if(accept_armed_) ring_.cancel_fd(listen_fd_, uring_data(listen_fd_, URING_CANCEL));
+            return;
+        case URING_CANCEL:
+            return;
+        case URING_ACCEPT:
+            on_accept(cqe);
+            return;
+        default:
+            break;
+        }
+
+        auto it = conns_.find(fd);
+        if(it == conns_.end()) return;
+        Entry& e = it->second;
+        switch(uring_op(cqe.user_data)) {
+        case URING_RECV:
+            on_recv(fd, e, cqe);
+            break;
+        case URING_SEND:
+            if(!e.io.on_send(cqe)) {
+                if(!e.io.closing()) {
+                    std::cerr << "[ERROR] ";
+                    perror("Send Failed");
+                    close_conn(fd, e, CLOSE_ERROR);
+                }
+            }
+            else if(!e.io.closing()) update(fd, e);
+            break;
+        case URING_SHUTDOWN:
+            e.io.on_shutdown();
+            if(!e.io.closing()) update(fd, e);
+            break;
+        default:
+            break;
+        }
+        reap(fd);
+    }
+
+    void on_accept(const io_uring_cqe& cqe) {
+        if(!(cqe.flags & IORING_CQE_F_MORE)) {
+            accept_armed_ = *running_ && !draining_ &&
+                            ring_.accept_multishot(listen_fd_, uring_data(listen_fd_, URING_ACCEPT));
+        }
+        if(cqe.res < 0) {
+            if(cqe.res != -ECANCELED) std::cerr << "[ERROR] " << "Accept Failed: " << strerror(-cqe.res) << std::endl;
+            return;
+        }
+        int fd = cqe.res;
+        if(!*running_) {
+            close(fd);
+            return;
+        }
+        // 多shot accept的所有连接共用一个地址缓冲区，不能可靠地带回对端地址，改用getpeername
+        Entry& e = conns_[fd];
+        socklen_t addr_len = sizeof(e.conn.addr);
+        getpeername(fd, (struct sockaddr*)&e.conn.addr, &addr_len);
+        e.timer = timers_.add(handler_.timeout(e.conn, false), fd);
+        handler_.on_open(fd, e.conn);
+        update(fd, e);
+        reap(fd);
+    }
+
+    void on_recv(int fd, Entry& e, const io_uring_cqe& cqe) {
+        uint16_t bid = 0;
+        bool has_buffer = BufferRing::buffer_of(cqe, bid);
+        e.io.on_recv(cqe);
+        if(e.io.closing()) {
+            if(has_buffer) recycle(bid);
+            return;
+        }
+        if(cqe.res > 0 && has_buffer) {
+            // 积压过多或者前面还有没处理的数据时先留着，保持顺序
+            if(e.io.holding() || e.io.pending_bytes(e.conn.out) >= high_watermark_) {
+                e.io.hold(bid, static_cast<uint32_t>(cqe.res));
+            }
+            else {
+                bool ok = feed(fd, e, buffers_.data(bid), static_cast<size_t>(cqe.res));
+                recycle(bid);
+                if(!ok) return;
+            }
+            update(fd, e);
+            return;
+        }
+        if(has_buffer) recycle(bid);
+        if(cqe.res == 0) {
+            if(e.eof || e.io.shut_down()) update(fd, e);  // 自己的shutdown引起的EOF
+            else if(handler_.on_eof(fd, e.conn)) {
+                e.eof = true;
+                update(fd, e);
+            }
+            else close_conn(fd, e, CLOSE_EOF);
+        }
+        else if(cqe.res == -ENOBUFS) {
+            if(!e.starved) {
+                e.starved = true;
+                starved_.push_back(fd);
+            }
+            update(fd, e);
+        }
+        else if(cqe.res == -ECANCELED) {
+            update(fd, e);
+        }
+        else {
+            std::cerr << "[ERROR] " << "Received Failed: " << strerror(-cqe.res) << std::endl;
+            close_conn(fd, e, CLOSE_ERROR);
+        }
+    }
+
+    // 把收到的数据交给Handler，失败时关闭连接并返回false
+    bool feed(int fd, Entry& e, const char* data, size_t n) {
+        if(!e.conn.in.append(data, n)) {
+            std::cerr << "[ERROR] " << "客户端 " << fd << " 未处理的请求过多" << std::endl;
+            close_conn(fd, e, CLOSE_ERROR);
+            return false;
+        }
+        if(!handler_.on_input(fd, e.conn)) {
+            close_conn(fd, e, CLOSE_ERROR);
+            return false;
+        }
+        return true;
+    }
+
+    bool submit_failed(int fd, Entry& e) {
+        std::cerr << "[ERROR] " << "Io_uring Submit Failed" << std::endl;
+        close_conn(fd, e, CLOSE_ERROR);
+        return false;
+    }
+
+    // 处理完一个完成项后：发送排队的回复，积压降下来时处理留下的数据，按状态暂停或恢复接收，重新设置定时器
+    void update(int fd, Entry& e) {
+        if(!e.io.send(ring_, fd, e.conn.out)) {
+            submit_failed(fd, e);
+            return;
+        }
+        bool stop_reading = handler_.close_after_send(e.conn);
+        while(!stop_reading && e.io.holding() && e.io.pending_bytes(e.conn.out) < high_watermark_) {
+            std::pair<uint16_t, uint32_t> held = e.io.take_held();
+            bool ok = feed(fd, e, buffers_.data(held.first), held.second);
+            recycle(held.first);
+            if(!ok) return;
+            if(!e.io.send(ring_, fd, e.conn.out)) {
+                submit_failed(fd, e);
+                return;
+            }
+            stop_reading = handler_.close_after_send(e.conn);
+        }
+        if(stop_reading) release_held(e);  // 之后收到的数据直接丢弃
+
+        size_t pending = e.io.pending_bytes(e.conn.out);
+        bool ok = true;
+        if(stop_reading || e.eof) {
+            ok = e.io.pause_recv(ring_, fd);
+            if(ok && !e.io.holding()) {
+                ok = e.io.send(ring_, fd, e.conn.out, true);
+                if(ok && e.io.finished()) {
+                    close_conn(fd, e, CLOSE_DONE);
+                    return;
+                }
+            }
+        }
+        else if(pending >= high_watermark_ || e.io.holding()) ok = e.io.pause_recv(ring_, fd);
+        else if(!e.starved) ok = e.io.arm_recv(ring_, fd, buffers_.group());
+        if(!ok) {
+            submit_failed(fd, e);
+            return;
+        }
+        timers_.reset(e.timer, handler_.timeout(e.conn, pending > 0));
+    }
+
+    void rearm_starved() {
+        std::vector<int> starved;
+        starved.swap(starved_);
+        for(int fd : starved) {
+            auto it = conns_.find(fd);
+            if(it == conns_.end()) continue;
+            it->second.starved = false;
+            if(!it->second.io.closing()) update(fd, it->second);
+            reap(fd);
+        }
+    }
+
+    void on_timeout(int fd) {
+        auto it = conns_.find(fd);
+        if(it == conns_.end() || it->second.io.closing()) return;
+        close_conn(fd, it->second, CLOSE_TIMEOUT);
+        reap(fd);
+    }
+
+    // 开始关闭连接，fd和内存在最后一个在途操作完成后由reap释放
+    void close_conn(int fd, Entry& e, CloseReason why) {
+        if(e.io.closing()) return;
+        handler_.on_close(fd, e.conn, why);
+        timers_.cancel(e.timer);
+        e.timer = TimerWheel::INVALID_TIMER;
+        release_held(e);
+        e.io.begin_close(ring_, fd);
+    }
+
+    // 在途操作全部完成后才能close，否则fd号可能被新连接复用，旧操作的完成项会被当成新连接的
+    void reap(int fd) {
+        auto it = conns_.find(fd);
+        if(it == conns_.end() || !it->second.io.closing() || it->second.io.inflight() > 0) return;
+        close(fd);
+        conns_.erase(it);
+    }
+
+    void shutdown() {
+        std::vector<int> fds;
+        for(auto& conn : conns_) {
+            close_conn(conn.first, conn.second, CLOSE_SHUTDOWN);
+            fds.push_back(conn.first);
+        }
+        for(int fd : fds) reap(fd);
+        if(accept_armed_) ring_.cancel_fd(listen_fd_, uring_data(listen_fd_, URING_CANCEL));
+        if(wakeup_armed_) ring_.cancel_fd(wakeup_fd_, uring_data(wakeup_fd_, URING_CANCEL));
+        if(drain_armed_) ring_.cancel_fd(drain_fd_, uring_data(drain_fd_, URING_CANCEL));
+        while(!conns_.empty() || accept_armed_ || wakeup_armed_ || drain_armed_) {
+            if(ring_.submit_and_wait(1, -1) < 0) {
+                std::cerr << "[ERROR] ";
+                perror("Io_uring Enter Failed");
+                break;
+            }
+            ring_.for_each_cqe([this](const io_uring_cqe& cqe) { on_complete(cqe); });
+        }
+    }
+};
+#endif
@@ -0,0 +1,144 @@
+#pragma once
+// 事件循环的唤醒通道
+// WakeupChannel: 一个可以放进poll/epoll/select的fd，其他线程(或信号处理函数)调用notify使它变为可读，
+//                Linux下使用eventfd，其他平台使用self-pipe
+//                用作退出通知时不要drain：fd一直保持可读，所有监听它的线程都会被唤醒(广播)
+// SignalChannel: 把信号变成fd上的可读事件，事件循环像处理socket一样处理信号，不再需要周期性地检查标志
+//                Linux下使用signalfd，其他平台由信号处理函数把信号编号写入self-pipe
+//                必须在创建其他线程之前构造，屏蔽的信号会被之后创建的线程和fork的子进程继承
+
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include <initializer_list>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif
+
+class WakeupChannel {
+public:
+    WakeupChannel() {
+#ifdef __linux__
+        read_fd_ = write_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        int fds[2];
+        if(pipe(fds) == 0) {
+            for(int fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            read_fd_ = fds[0];
+            write_fd_ = fds[1];
+        }
+#endif
+    }
+
+    ~WakeupChannel() {
+        if(read_fd_ >= 0) close(read_fd_);
+        if(write_fd_ >= 0 && write_fd_ != read_fd_) close(write_fd_);
+    }
+
+    WakeupChannel(const WakeupChannel&) = delete;
+    WakeupChannel& operator=(const WakeupChannel&) = delete;
+
+    bool valid() const { return read_fd_ >= 0; }
+    int fd() const { return read_fd_; }  // 加入poll/epoll/select监听可读
+
+    // 唤醒等待fd的线程，异步信号安全；计数器或管道已满时说明已经处于可读状态，忽略EAGAIN
+    void notify() const {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t n = write(write_fd_, &one, sizeof(one));
+#else
+        char one = 1;
+        ssize_t n = write(write_fd_, &one, 1);
+#endif
+        (void)n;
+    }
+
+    // 清除可读状态，之后的notify会再次唤醒
+    void drain() const {
+        char buf[64];
+        while(read(read_fd_, buf, sizeof(buf)) > 0) {}
+    }
+
+private:
+    int read_fd_ = -1;
+    int write_fd_ = -1;
+};
+
+
+class SignalChannel {
+public:
+    // 在当前线程屏蔽signals并创建接收它们的fd
+    explicit SignalChannel(std::initializer_list<int> signals) {
+        sigemptyset(&mask_);
+        for(int sig : signals) sigaddset(&mask_, sig);
+#ifdef __linux__
+        pthread_sigmask(SIG_BLOCK, &mask_, nullptr);
+        fd_ = signalfd(-1, &mask_, SFD_NONBLOCK | SFD_CLOEXEC);
+#else
+        int fds[2];
+        if(pipe(fds) != 0) return;
+        for(int fd : fds) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        fd_ = fds[0];
+        pipe_write_fd() = fds[1];
+        struct sigaction sa{};
+        sa.sa_handler = [](int sig) {
+            int saved_errno = errno;
+            unsigned char c = static_cast<unsigned char>(sig);
+            ssize_t n = write(pipe_write_fd(), &c, 1);
+            (void)n;
+            errno = saved_errno;
+        };
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        for(int sig : signals) sigaction(sig, &sa, nullptr);
+#endif
+    }
+
+    ~SignalChannel() {
+        if(fd_ >= 0) close(fd_);
+    }
+
+    SignalChannel(const SignalChannel&) = delete;
+    SignalChannel& operator=(const SignalChannel&) = delete;
+
+    bool valid() const { return fd_ >= 0; }
+    int fd() const { return fd_; }  // 加入poll/epoll/select监听可读
+
+    // 取出一个待处理的信号，没有时返回0
+    int next() const {
+#ifdef __linux__
+        signalfd_siginfo info;
+        ssize_t n = read(fd_, &info, sizeof(info));
+        return n == static_cast<ssize_t>(sizeof(info)) ? static_cast<int>(info.ssi_signo) : 0;
+#else
+        unsigned char c;
+        return read(fd_, &c, 1) == 1 ? c : 0;
+#endif
+    }
+
+    // fork出的子进程如果要执行其他程序或者恢复默认的信号处理，先解除屏蔽
+    void unblock() const {
+        pthread_sigmask(SIG_UNBLOCK, &mask_, nullptr);
+    }
+
+private:
+    int fd_ = -1;
+    sigset_t mask_;
+
+#ifndef __linux__
+    static int& pipe_write_fd() {
+        static int fd = -1;
+        return fd;
+    }
+#endif
+};
@@ -0,0 +1,129 @@
+#pragma once
+// 大响应的零拷贝发送
+// 普通的send/writev要把用户内存中的数据拷贝进socket缓冲区，响应越大，这次拷贝占的CPU越多；
+// 这里提供两种不经过这次拷贝的发送方式，由OutQueue在写出时使用(见OutQueue::push_file)：
+//   sendfile    : 数据来自文件，内核直接把页缓存中的页面挂到socket上，用户态不接触数据
+//   MSG_ZEROCOPY: 数据在用户内存中(这里是文件的只读映射)，内核固定(pin)这些页面直接发送，
+//                 对端确认后在socket的错误队列中放入完成通知，收到通知之前这段内存不能被修改；
+//                 固定页面和处理通知本身也有开销，只适合几十KB以上的数据；
+//                 发往本机(loopback)的数据内核仍然会拷贝，并在通知中标记SO_EE_CODE_ZEROCOPY_COPIED
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
+
+// 大块数据的发送方式
+enum class SendMode {
+    COPY,      // writev，和其他回复一样拷贝
+    SENDFILE,  // sendfile，从页缓存直接发送
+    ZEROCOPY,  // send(MSG_ZEROCOPY)，发送映射的页面，通过错误队列确认完成
+};
+
+// 从命令行选项解析发送方式，不认识时返回false
+inline bool parse_send_mode(const std::string& name, SendMode& mode) {
+    if(name == "copy") mode = SendMode::COPY;
+    else if(name == "sendfile") mode = SendMode::SENDFILE;
+    else if(name == "zerocopy") mode = SendMode::ZEROCOPY;
+    else return false;
+    return true;
+}
+
+// 只读打开并映射的静态文件，在服务器的整个生命周期内不变，所有线程共享
+// sendfile使用fd和显式的偏移量(不改变文件偏移)，多个线程可以同时发送；拷贝和MSG_ZEROCOPY使用映射
+// 服务期间文件不能被修改或截断，否则发出的数据不确定(访问截断部分的映射还会触发SIGBUS)
+class StaticFile {
+public:
+    StaticFile() = default;
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+
+    ~StaticFile() {
+        if(data_) munmap(data_, size_);
+        if(fd_ >= 0) close(fd_);
+    }
+
+    // 失败返回false，errno为失败原因
+    bool open(const char* path) {
+        fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+        if(fd_ < 0) return false;
+        struct stat st;
+        if(fstat(fd_, &st) < 0) return false;
+        if(!S_ISREG(st.st_mode)) {
+            errno = EINVAL;
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if(size_ == 0) return true;  // 空文件不能映射，也没有数据要发
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED | MAP_POPULATE, fd_, 0);
+        if(p == MAP_FAILED) return false;
+        data_ = static_cast<char*>(p);
+        return true;
+    }
+
+    bool valid() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#ifdef __linux__
+// 在socket上启用MSG_ZEROCOPY，内核不支持时返回false(此时MSG_ZEROCOPY标志会被忽略)
+inline bool enable_zerocopy(int fd) {
+#ifdef SO_ZEROCOPY
+    int one = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+// 取走fd错误队列中的所有零拷贝完成通知
+// 每次成功的MSG_ZEROCOPY发送占一个序号，内核把连续完成的序号合并成一个通知[ee_info, ee_data]，
+// 返回这些通知覆盖的发送次数；任何一次发送被内核退化为拷贝时copied置为true
+inline uint32_t read_zerocopy_completions(int fd, bool& copied) {
+    uint32_t completed = 0;
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    while(true) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if(errno == EINTR) continue;
+            break;  // EAGAIN: 队列已空
+        }
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if(err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+            completed += err.ee_data - err.ee_info + 1;
+            if(err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied = true;
+        }
+    }
+#else
+    (void)fd;
+    (void)copied;
+#endif
+    return completed;
+}
+#endif
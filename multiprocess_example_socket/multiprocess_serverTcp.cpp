@@ -6,62 +6,166 @@
 #include <arpa/inet.h>         // IP地址转换函数：inet_pton()、inet_ntop()等
 #include <unistd.h>            // POSIX系统服务：close()、read()、write()、fork()等
 #include <signal.h>            // 信号处理函数：signal()、sigaction()等
-#include <sys/ipc.h>           // IPC键值生成和权限控制：ftok()等
-#include <sys/shm.h>           // 共享内存操作：shmget()、shmat()、shmdt()等
 #include <sys/msg.h>           // 消息队列操作：msgget()、msgsnd()、msgrcv()等
+#include <fcntl.h>             // 文件控制选项：fcntl()，把监听socket设为非阻塞
+#include <vector>              // C++动态数组容器，记录子进程PID
+#include <chrono>              // 单调时钟，计算连接的空闲超时
+#include <algorithm>           // std::find
+#include <functional>          // 子进程退出的回调
+#include <string>              // 解析命令行参数
+#include <unordered_map>       // worker进程的连接表
+#ifdef __linux__
+#include <sys/prctl.h>         // prctl(PR_SET_PDEATHSIG)：父进程退出时通知worker
+#endif
+#include "../common/conn_buffer.hpp"  // 按大小分级复用的连接缓冲区
+#include "../common/out_queue.hpp"    // worker进程的发送队列
+#include "../common/poller.hpp"       // worker进程的事件循环
+#include "../common/timer_wheel.hpp"  // worker进程的连接超时
+#include "../common/wakeup.hpp"       // signalfd
+#ifdef __linux__
+#include "../common/hot_restart.hpp"  // 热重启时把监听socket交给新进程
+#endif
+#include "shm_stats.hpp"              // 共享内存统计段：shmget()、shmat()
+
+// 用法: ./multiprocess_serverTcp [fork|prefork] [N]
+//   fork    : 默认模式，父进程accept，每个连接fork一个子进程处理，连接断开后子进程退出，
+//             建立连接的代价包含一次完整的进程创建(复制页表等)
+//   prefork : 启动时fork N个常驻的worker进程(默认CPU核数)，它们继承同一个监听socket，
+//             各自用epoll(EPOLLEXCLUSIVE，每个新连接只唤醒一个worker)accept并在自己的事件循环中处理所有连接；
+//             父进程只负责监督：worker退出或崩溃时重新fork一个补上，启动后很快就退出的worker延迟重启，避免循环崩溃；
+//             收到SIGINT/SIGTERM时通知所有worker退出并等待它们结束
+//
+// 统计：启动时创建System V共享内存统计段(见shm_stats.hpp)，prefork模式下每个worker一个槽位，
+// fork模式下所有连接子进程共用槽位0；子进程直接更新自己的计数器(连接、请求、字节数、服务时间直方图)，
+// 父进程收到SIGUSR1或关闭时打印，运行期间也可以用 ./stats [间隔秒数] 在外部查看
+// 信号通过signalfd作为事件处理：父进程的select同时等待监听socket和信号，
+// SIGCHLD时回收子进程，SIGINT/SIGTERM时停止接受连接并通知子进程退出；
+// 子进程继承屏蔽字和signalfd，在同一个select中等待客户端数据和退出信号，不再需要每秒醒来检查标志
+//
+// 平滑退出：SIGQUIT时父进程停止接受连接并把SIGQUIT转发给子进程，worker停止accept，已有连接处理到对端关闭后退出，
+// 父进程最多等待DRAIN_TIMEOUT_MS，之后按SIGTERM强制关闭剩余的子进程
+// 热重启(Linux)：SIGUSR2时父进程以同样的参数exec启动时的程序文件，把监听socket交给新进程(见common/hot_restart.hpp)，
+// 新进程就绪后旧进程按上面的方式平滑退出；监听socket始终没有关闭，升级期间不会有被拒绝的连接，
+// 新旧两批worker短暂地同时在同一个socket上accept。新进程创建同一个key的统计段时会删除旧段，
+// 排空中的旧worker继续写已删除的旧段，stats工具看到的是新进程的统计
+bool stop_server = false;
+bool drain_server = false;    // 收到SIGQUIT或热重启成功：停止accept，等待已有连接结束
+bool restart_server = false;  // 收到SIGUSR2，由父进程的主循环处理
+std::vector<pid_t> child_pids;
+StatsRegion* stats_region = nullptr;  // 共享内存统计段，创建失败时为空
+WorkerStats local_stats;              // 没有统计段时计数器写到这里(只在本进程内可见)
 
+const int PORT = 8080;
+const int LISTEN_BACKLOG = SOMAXCONN;    // 已完成连接队列的最大长度
+const long IDLE_TIMEOUT_MS = 60 * 1000;  // 客户端超过该时间没有发送数据时关闭连接
+const int ACCEPT_BATCH = 64;             // worker一次唤醒最多accept的连接数，剩下的留给其他worker
+const size_t OUTPUT_HIGH_WATERMARK = 256 * 1024;  // worker中发送队列超过该值时暂停读取该连接
+const long MIN_WORKER_LIFETIME_MS = 1000;  // 存活时间短于该值就退出的worker视为启动即崩溃
+const long RESPAWN_DELAY_MS = 1000;        // 启动即崩溃的worker延迟这么久再重启
+const long DRAIN_TIMEOUT_MS = 30 * 1000;   // 平滑退出时等待子进程处理完已有连接的最长时间
+const int HOT_RESTART_TIMEOUT_MS = 10 * 1000;  // 热重启时等待新进程就绪的最长时间
+const char* const RESPONSE = "Message received by child process";
+
+// 单调时钟的毫秒数
+long monotonic_ms(){
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
 
-// 信号处理函数：Ctrl+C退出进程
-volatile sig_atomic_t stop_server = 0;
-std::vector<pid_t> child_pids;
-void sigint_handle(int sig){
-    stop_server = 1;
-    std::cout << "\n收到关闭信号, 正在关闭进程..." << std::endl;
+// 单调时钟的微秒数，用于统计请求的服务时间
+uint64_t monotonic_us(){
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
-const int PORT = 8080;
-const int BUFFER_SIZE = 1024;
+// 槽位index的计数器
+WorkerStats& stats_slot(int index){
+    if(stats_region && static_cast<uint32_t>(index) < stats_region->slots()) return stats_region->slot(index);
+    return local_stats;
+}
 
-// 信号处理函数：回收僵尸进程
-void sigchld_handler(int sig){
-    int saved_errno = errno;
-    while(waitpid(-1, NULL, WNOHANG) > 0);
-    errno = saved_errno;
+// 处理signalfd中所有待处理的信号：回收僵尸进程并从child_pids中移除，再把退出状态交给on_exit；
+// 收到SIGINT/SIGTERM时设置stop_server，SIGQUIT时设置drain_server，SIGUSR2时设置restart_server
+void handle_signals(const SignalChannel& signals, const std::function<void(pid_t, int)>& on_exit = nullptr){
+    int sig;
+    while((sig = signals.next()) != 0){
+        if(sig == SIGCHLD){
+            // 多个SIGCHLD可能合并成一个，循环回收所有已退出的子进程
+            pid_t pid;
+            int status;
+            while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+                auto it = std::find(child_pids.begin(), child_pids.end(), pid);
+                if(it != child_pids.end()) child_pids.erase(it);
+                if(on_exit) on_exit(pid, status);
+            }
+        }
+        else if(sig == SIGINT || sig == SIGTERM){
+            if(!stop_server) std::cout << "\n收到关闭信号, 正在关闭进程..." << std::endl;
+            stop_server = true;
+        }
+        else if(sig == SIGQUIT){
+            if(!drain_server) std::cout << "\n收到平滑退出信号, 停止接受新连接..." << std::endl;
+            drain_server = true;
+        }
+        else if(sig == SIGUSR2){
+            restart_server = true;
+        }
+        else if(sig == SIGUSR1 && stats_region){
+            print_stats(*stats_region, std::cout);
+        }
+    }
 }
 
 // 子进程处理函数
-void handle_client(int client_fd, sockaddr_in client_addr){
+void handle_client(int client_fd, sockaddr_in client_addr, const SignalChannel& signals){
     // 1. 获取客户端IP
     char client_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
 
     std::cout << "Child process PID: " << getpid() << " handle client "
             << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
+    WorkerStats& stats = stats_slot(0);  // 所有连接子进程共用槽位0
+    stats.open_connection();
 
     // 全双工通信：可以同时收发
-    char buffer[BUFFER_SIZE];
+    ConnBuffer in;
     fd_set read_fds;
+    long deadline = monotonic_ms() + IDLE_TIMEOUT_MS;
+    int signal_fd = signals.fd();
 
     while(!stop_server){
         FD_ZERO(&read_fds);
         FD_SET(client_fd, &read_fds);
+        FD_SET(signal_fd, &read_fds);
 
-        // 设置超时，避免拥塞
-        struct timeval tv = {1, 0}; // 1秒超时
+        // 一直等到空闲截止时间，超过截止时间还没有数据就关闭连接；退出信号会提前唤醒
+        long remaining = deadline - monotonic_ms();
+        if(remaining <= 0){
+            std::cout << "Client idle timeout!" << std::endl;
+            break;
+        }
+        struct timeval tv = {remaining / 1000, (remaining % 1000) * 1000};
 
-        int ready = select(client_fd + 1, &read_fds, NULL, NULL, &tv);
+        int ready = select((client_fd > signal_fd ? client_fd : signal_fd) + 1, &read_fds, NULL, NULL, &tv);
 
         if(ready < 0){
+            if(errno == EINTR) continue;
             perror("select error");
             break;
         }
         else if(ready == 0){
-            // 超时，继续循环
+            // 超时，回到循环开头检查截止时间
+            continue;
+        }
+
+        if(FD_ISSET(signal_fd, &read_fds)){
+            handle_signals(signals);
             continue;
         }
 
         if (FD_ISSET(client_fd, &read_fds)){
-            ssize_t bytes_read = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
+            ssize_t bytes_read = in.read_from(client_fd);
+            uint64_t received_us = monotonic_us();
 
             if(bytes_read <= 0){
                 if(bytes_read == 0){
@@ -73,109 +177,263 @@ void handle_client(int client_fd, sockaddr_in client_addr){
                 break;
             }
 
-            buffer[bytes_read] = '\0';
-            std::cout << "Child Process " << getpid() << " received:" << buffer << std::endl;
+            std::cout << "Child Process " << getpid() << " received:";
+            std::cout.write(in.data(), in.size()) << std::endl;
             std::cout << std::endl;
+            in.consume(in.size());
+            deadline = monotonic_ms() + IDLE_TIMEOUT_MS;
             
             // 发送响应
-            const char* response = "Message received by child process";
-            send(client_fd, response, sizeof(response), 0);
+            ssize_t sent = send(client_fd, RESPONSE, strlen(RESPONSE), 0);
+            WorkerStats::add(stats.requests);
+            WorkerStats::add(stats.bytes_in, bytes_read);
+            if(sent > 0) WorkerStats::add(stats.bytes_out, sent);
+            stats.record_latency(monotonic_us() - received_us);
         }
     }
 
+    stats.close_connection();
     close(client_fd);
     std::cout << "Child process " << getpid() << " exiting" << std::endl;
     exit(0);
 }
 
-int main(){
-    // 注册信号处理，退出进程
-    signal(SIGINT, sigint_handle);
-
-    // 1. 创建socket
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if(server_fd == -1){
-        perror("Socket Create Failed!");
-        return -1;
+// prefork模式中worker的一个连接
+struct WorkerConn{
+    sockaddr_in addr{};
+    ConnBuffer in;
+    OutQueue out;
+    TimerWheel::TimerId timer = TimerWheel::INVALID_TIMER;  // 空闲超时
+};
+
+// prefork模式的worker进程：在继承来的监听socket上accept，所有连接在同一个事件循环中处理，直到收到退出信号
+// 收到SIGQUIT后停止accept，已有连接全部结束时退出；ready_fd不为-1时开始accept后向它写一个字节通知父进程
+void run_worker(int server_fd, int index, const SignalChannel& signals, int ready_fd){
+    pid_t pid = getpid();
+    Poller poller;
+    if(!poller.valid() || !poller.add(server_fd, Poller::READABLE | Poller::EXCLUSIVE) ||
+       !poller.add(signals.fd(), Poller::READABLE)){
+        perror("Worker Poller Failed!");
+        exit(1);
     }
-    std::cout << "Create Socket success!" << std::endl;
-    std::cout << "Pid : " << getpid() << std::endl;
-
-    // 2. 设置地址重用
-    int opt = 1;
-    if ((setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)){
-        perror("Setsockopt Failed!");
+    std::cout << "Worker " << index << " PID: " << pid << " started" << std::endl;
+    if(ready_fd >= 0){
+        char c = 1;
+        if(write(ready_fd, &c, 1) != 1) perror("Worker Ready Notify Failed!");
+        close(ready_fd);
+    }
+    WorkerStats& stats = stats_slot(index);
+    stats.pid.store(pid, std::memory_order_relaxed);
+
+    std::unordered_map<int, WorkerConn> conns;
+    TimerWheel timers;
+    std::vector<uint64_t> received_us;  // 本次可读事件中每条请求读到的时间，回复写出后记录服务时间
+    auto close_conn = [&](int fd){
+        auto it = conns.find(fd);
+        if(it == conns.end()) return;
+        stats.close_connection();
+        timers.cancel(it->second.timer);
+        poller.remove(fd);
+        close(fd);
+        conns.erase(it);
+    };
+    auto on_timeout = [&](TimerWheel::TimerId, uint64_t fd){
+        std::cout << "Worker " << index << " client idle timeout!" << std::endl;
+        close_conn(static_cast<int>(fd));  // 定时器已释放，cancel不会生效
+    };
+
+    // 读完当前所有数据，每次读到的数据回复一次，发送队列积压过多时停止读取；返回false表示应当关闭连接
+    auto on_readable = [&](int fd, WorkerConn& conn) -> bool {
+        while(conn.out.bytes() < OUTPUT_HIGH_WATERMARK){
+            ssize_t bytes_read = conn.in.read_from(fd);
+            if(bytes_read > 0){
+                received_us.push_back(monotonic_us());
+                WorkerStats::add(stats.bytes_in, bytes_read);
+                std::cout << "Worker " << index << " (" << pid << ") received:";
+                std::cout.write(conn.in.data(), conn.in.size()) << std::endl;
+                conn.in.consume(conn.in.size());
+                conn.out.push_ref(RESPONSE, strlen(RESPONSE));
+                continue;
+            }
+            if(bytes_read == 0){
+                std::cout << "Client disconnected!" << std::endl;
+                return false;
+            }
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            perror("Recv Failed!");
+            return false;
+        }
+        return true;
+    };
+
+    // 停止accept：监听socket可能已经交给了新进程，关闭本进程的fd不会把它从epoll中移除
+    // (epoll跟踪的是打开的文件，其他进程还持有它)，必须先显式删除
+    bool accepting = true;
+    auto stop_accepting = [&](){
+        poller.remove(server_fd);
         close(server_fd);
-        return -1;
+        accepting = false;
+        std::cout << "Worker " << index << " PID: " << pid << " stop accepting, " << conns.size() << " connections left" << std::endl;
+    };
+
+    std::vector<PollEvent> events;
+    while(!stop_server && (accepting || !conns.empty())){
+        if(poller.wait(events, timers.next_timeout()) < 0){
+            perror("Worker Wait Failed!");
+            break;
+        }
+        for(const PollEvent& ev : events){
+            if(ev.fd == signals.fd()){
+                handle_signals(signals);
+                if(drain_server && accepting) stop_accepting();
+                continue;
+            }
+            if(ev.fd == server_fd){
+                if(!accepting) continue;  // 同一批事件中停止accept之前取出的
+                // 监听socket是非阻塞的：其他worker可能先取走了连接，EAGAIN时直接返回
+                for(int i = 0; i < ACCEPT_BATCH; ++i){
+                    sockaddr_in client_addr;
+                    socklen_t client_len = sizeof(client_addr);
+                    int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+                    if(client_fd < 0){
+                        if(errno == EINTR || errno == ECONNABORTED) continue;
+                        if(errno != EAGAIN && errno != EWOULDBLOCK) perror("Accept Failed!");
+                        break;
+                    }
+                    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK);
+                    fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+                    if(!poller.add(client_fd, Poller::READABLE)){
+                        perror("Worker Poller Add Failed!");
+                        close(client_fd);
+                        continue;
+                    }
+                    WorkerConn& conn = conns[client_fd];
+                    conn.addr = client_addr;
+                    stats.open_connection();
+                    conn.timer = timers.add(IDLE_TIMEOUT_MS, client_fd);
+
+                    char client_ip[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+                    std::cout << "Worker " << index << " (" << pid << ") handle client "
+                              << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
+                }
+                continue;
+            }
+
+            auto it = conns.find(ev.fd);
+            if(it == conns.end()) continue;
+            WorkerConn& conn = it->second;
+            bool ok = !(ev.events & Poller::ERROR);
+            received_us.clear();
+            if(ok && (ev.events & (Poller::READABLE | Poller::HANGUP))) ok = on_readable(ev.fd, conn);
+            size_t queued = conn.out.bytes();
+            if(ok && queued > 0 && !conn.out.flush(ev.fd)){
+                perror("Send Failed!");
+                ok = false;
+            }
+            // 回复已交给内核(或排入发送队列)，这批请求的服务时间从各自读到的时刻算起
+            if(!received_us.empty()){
+                uint64_t now = monotonic_us();
+                for(uint64_t t : received_us) stats.record_latency(now - t);
+                WorkerStats::add(stats.requests, received_us.size());
+            }
+            WorkerStats::add(stats.bytes_out, queued - conn.out.bytes());
+            if(!ok){
+                close_conn(ev.fd);
+                continue;
+            }
+            // 发送队列非空时监听可写，积压过多时停止监听可读
+            uint32_t interest = 0;
+            if(conn.out.bytes() < OUTPUT_HIGH_WATERMARK) interest |= Poller::READABLE;
+            if(!conn.out.empty()) interest |= Poller::WRITABLE;
+            poller.modify(ev.fd, interest);
+            timers.reset(conn.timer, IDLE_TIMEOUT_MS);
+        }
+        timers.advance(on_timeout);
     }
 
-    // 3. 绑定地址
-    sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_port = htons(PORT);
-    address.sin_addr.s_addr = INADDR_ANY;
+    std::cout << "Worker " << index << " PID: " << pid << " exiting, closing " << conns.size() << " connections" << std::endl;
+    for(auto& entry : conns) close(entry.first);
+    if(accepting) close(server_fd);
+    exit(0);
+}
 
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0){
-        perror("Bind failed!");
-        close(server_fd);
+// 在worker槽位index上fork一个worker进程，返回它的pid，失败返回-1
+pid_t spawn_worker(int server_fd, int index, const SignalChannel& signals, int ready_fd = -1){
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if(pid < 0){
+        perror("Fork Failed!");
         return -1;
     }
-    std::cout << "Bind the PORT" << PORT << std::endl;
-
-    // 4. 监听
-    if(listen(server_fd, 10) < 0){
-        perror("Listen failed!");
-        close(server_fd);
-        return -1;
+    if(pid == 0){
+#ifdef __linux__
+        // 父进程被强制杀死时worker也收到SIGTERM退出，不会作为孤儿继续占用端口
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if(getppid() != master) exit(0);  // fork之后、prctl之前父进程已经退出
+#endif
+        run_worker(server_fd, index, signals, ready_fd);  // 不会返回
     }
-    std::cout << "Server PID: " << getpid() << " listening on port " << PORT << std::endl;
-
-    // 5. 设置信号处理，避免僵尸进程
-    struct sigaction sa;
-    sa.__sigaction_u.__sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask); // 清空sa_mask
-    sigaddset(&sa.sa_mask, SIGINT);  // 额外阻塞 SIGINT, 为了能在Ctrl+C时，也可以正常处理回收子进程
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    child_pids.push_back(pid);
+    return pid;
+}
 
-    if(sigaction(SIGCHLD, &sa, NULL) == -1){
-        perror("sigaction()");
-        close(server_fd);
-        return -1;
+// 父进程收到SIGUSR2：把监听socket交给新执行的服务器进程，新进程就绪后设置drain_server，失败时继续服务
+void hot_restart_server(int server_fd, char* argv[]){
+    restart_server = false;
+#ifdef __linux__
+    if(drain_server) return;
+    std::cout << "收到SIGUSR2, 热重启: " << executable_path() << std::endl;
+    pid_t pid;
+    if(hot_restart({server_fd}, argv, HOT_RESTART_TIMEOUT_MS, pid)){
+        std::cout << "新进程 " << pid << " 已接管监听socket, 停止接受新连接" << std::endl;
+        drain_server = true;
+    }
+    else{
+        perror("Hot Restart Failed!");
+        std::cout << "继续服务" << std::endl;
     }
+#else
+    (void)server_fd;
+    (void)argv;
+    std::cout << "当前平台不支持热重启" << std::endl;
+#endif
+}
 
-    // 设置监听socket I/O复用，避免阻塞主循环
+// fork模式：父进程accept，每个连接一个子进程
+void run_fork_per_connection(int server_fd, const SignalChannel& signals, char* argv[]){
+    // 设置监听socket和signalfd I/O复用，没有连接和信号时一直阻塞
     fd_set read_fd;
+    int signal_fd = signals.fd();
 
     // 5. 主循环
-    while(!stop_server){
+    while(!stop_server && !drain_server){
 
-        // 设置监听socket I/O复用，避免阻塞主循环
         FD_ZERO(&read_fd);
         FD_SET(server_fd, &read_fd);
-        struct timeval tv = {1, 0}; // 1秒超时
-        int ready = select(server_fd + 1, &read_fd, NULL, NULL, &tv);
+        FD_SET(signal_fd, &read_fd);
+        int ready = select((server_fd > signal_fd ? server_fd : signal_fd) + 1, &read_fd, NULL, NULL, NULL);
         if(ready < 0){
-            if(!stop_server) perror("Select Failed!");
-            else if(stop_server) break; // 避免select失败后，陷入死循环
-            continue;
-        }
-        else if(ready == 0){
-            // 超时，继续循环
-            continue;
+            if(errno == EINTR) continue;
+            perror("Select Failed!");
+            break; // 避免select失败后，陷入死循环
         }
 
-        if(!FD_ISSET(server_fd, &read_fd)){
-            perror("FD_ISSET Failed!");
-            if(stop_server) break; // 避免FD_ISSET失败后，陷入死循环
-            continue;
+        // 5.0 信号：回收子进程、退出或者热重启
+        if(FD_ISSET(signal_fd, &read_fd)){
+            handle_signals(signals);
+            if(restart_server) hot_restart_server(server_fd, argv);
+            if(stop_server || drain_server) break;
         }
+        if(!FD_ISSET(server_fd, &read_fd)) continue;
 
         // 5.1 连接客户端
         sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
         if(client_fd < 0){
-            if(errno == EINTR && stop_server == 0) continue; // 被信号中断
+            if(errno == EINTR) continue; // 被信号中断
             perror("Accept Failed!");
             continue;
         }
@@ -190,7 +448,7 @@ int main(){
             close(server_fd); // 子进程不需要监听socket
             
             // 处理客户端
-            handle_client(client_fd, client_addr);
+            handle_client(client_fd, client_addr, signals);
             // 不会执行到这里，因为handle_client里面会exit退出子进程
 
         }else { // 父进程
@@ -199,21 +457,282 @@ int main(){
             std::cout << "Created child process " << pid << std::endl;
         }
     }
+}
+
+// 第一批worker通过ready_pipe报告已经开始accept，读到n个字节或者所有写端都已关闭(worker启动失败退出)时返回启动成功的个数
+int wait_workers_ready(int ready_pipe[2], int n){
+    close(ready_pipe[1]);
+    int started = 0;
+    char buf[64];
+    while(started < n){
+        ssize_t r = read(ready_pipe[0], buf, sizeof(buf));
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) break;
+        started += static_cast<int>(r);
+    }
+    close(ready_pipe[0]);
+    return started;
+}
+
+// prefork模式：父进程fork出n个worker后只等待信号，worker退出时在同一个槽位上重新fork
+// on_ready不为空时(热重启启动)，等第一批worker都开始accept之后调用它
+void run_prefork(int server_fd, int n, const SignalChannel& signals, char* argv[], const std::function<void()>& on_ready){
+    // 监听socket设为非阻塞：所有worker共享它，被唤醒的worker去accept时连接可能已被别人取走
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct Worker{
+        pid_t pid = -1;         // -1表示槽位空着，等待重启
+        long started_ms = 0;
+        long respawn_at = 0;    // 槽位空着时的重启时间
+    };
+    std::vector<Worker> workers(n);
+    int ready_pipe[2] = {-1, -1};
+    if(on_ready){
+        if(pipe(ready_pipe) < 0){
+            perror("Ready Pipe Failed!");
+            ready_pipe[0] = ready_pipe[1] = -1;
+        }
+        else{
+            fcntl(ready_pipe[0], F_SETFD, FD_CLOEXEC);
+            fcntl(ready_pipe[1], F_SETFD, FD_CLOEXEC);
+        }
+    }
+    auto start = [&](int i){
+        workers[i].pid = spawn_worker(server_fd, i, signals, ready_pipe[1]);
+        if(workers[i].pid > 0) stats_slot(i).pid.store(workers[i].pid, std::memory_order_relaxed);
+        workers[i].started_ms = monotonic_ms();
+        workers[i].respawn_at = workers[i].started_ms + RESPAWN_DELAY_MS;  // fork失败时稍后重试
+    };
+    for(int i = 0; i < n; ++i) start(i);
+    std::cout << "Server PID: " << getpid() << " started " << n << " workers" << std::endl;
+    if(ready_pipe[0] >= 0){
+        // 之后重启的worker不再报告
+        int started = wait_workers_ready(ready_pipe, n);
+        ready_pipe[1] = -1;
+        // 一个worker都没有启动时不通知，旧进程等待超时后杀死本进程并继续服务
+        if(started > 0) on_ready();
+        else std::cout << "没有worker启动成功, 不通知旧进程" << std::endl;
+    }
+    else if(on_ready){
+        on_ready();  // 管道创建失败，无法确认worker的状态
+    }
+
+    // worker退出：记录原因，空出槽位；存活时间太短的延迟重启
+    auto on_exit = [&](pid_t pid, int status){
+        for(int i = 0; i < n; ++i){
+            Worker& w = workers[i];
+            if(w.pid != pid) continue;
+            w.pid = -1;
+            // worker已经不在了，父进程接管它的槽位：它的连接都随进程关闭了
+            WorkerStats& slot = stats_slot(i);
+            slot.pid.store(0, std::memory_order_relaxed);
+            slot.active.store(0, std::memory_order_relaxed);
+            if(stop_server || drain_server) return;
+            WorkerStats::add(slot.restarts);
+            if(WIFSIGNALED(status)){
+                std::cout << "Worker " << pid << " 被信号 " << WTERMSIG(status) << " 终止" << std::endl;
+            }
+            else{
+                std::cout << "Worker " << pid << " 退出, 状态码 " << WEXITSTATUS(status) << std::endl;
+            }
+            long now = monotonic_ms();
+            w.respawn_at = now - w.started_ms < MIN_WORKER_LIFETIME_MS ? now + RESPAWN_DELAY_MS : now;
+            return;
+        }
+    };
+
+    fd_set read_fd;
+    int signal_fd = signals.fd();
+    while(!stop_server && !drain_server){
+        // 重启空着的槽位，select的超时取最近一个延迟重启的时间，没有时一直阻塞
+        long now = monotonic_ms();
+        long wait_ms = -1;
+        for(int i = 0; i < n; ++i){
+            if(workers[i].pid >= 0) continue;
+            if(workers[i].respawn_at <= now){
+                std::cout << "重启worker槽位 " << i << std::endl;
+                start(i);
+                if(workers[i].pid >= 0) continue;
+            }
+            long remaining = workers[i].respawn_at - now;
+            if(wait_ms < 0 || remaining < wait_ms) wait_ms = remaining;
+        }
+
+        FD_ZERO(&read_fd);
+        FD_SET(signal_fd, &read_fd);
+        struct timeval tv = {wait_ms / 1000, (wait_ms % 1000) * 1000};
+        int ready = select(signal_fd + 1, &read_fd, NULL, NULL, wait_ms < 0 ? NULL : &tv);
+        if(ready < 0){
+            if(errno == EINTR) continue;
+            perror("Select Failed!");
+            break;
+        }
+        if(ready > 0) handle_signals(signals, on_exit);
+        if(restart_server) hot_restart_server(server_fd, argv);
+    }
+}
+
+// 平滑退出：通知子进程停止接受连接，等待它们处理完已有连接退出，最多等待DRAIN_TIMEOUT_MS或者收到SIGINT/SIGTERM
+void drain_children(const SignalChannel& signals){
+    std::cout << "等待 " << child_pids.size() << " 个子进程处理完已有连接" << std::endl;
+    for(pid_t pid : child_pids){
+        kill(pid, SIGQUIT);
+    }
+    long deadline = monotonic_ms() + DRAIN_TIMEOUT_MS;
+    fd_set read_fd;
+    int signal_fd = signals.fd();
+    while(!child_pids.empty() && !stop_server){
+        long wait_ms = deadline - monotonic_ms();
+        if(wait_ms <= 0){
+            std::cout << "排空超时, 关闭剩余的 " << child_pids.size() << " 个子进程" << std::endl;
+            break;
+        }
+        FD_ZERO(&read_fd);
+        FD_SET(signal_fd, &read_fd);
+        struct timeval tv = {wait_ms / 1000, (wait_ms % 1000) * 1000};
+        int ready = select(signal_fd + 1, &read_fd, NULL, NULL, &tv);
+        if(ready < 0){
+            if(errno == EINTR) continue;
+            perror("Select Failed!");
+            break;
+        }
+        if(ready > 0) handle_signals(signals);
+        restart_server = false;  // 已经在退出，忽略
+    }
+}
+
+// 创建监听socket: 设置地址重用、绑定端口并开始监听，失败返回-1
+int create_listen_socket(){
+    // 1. 创建socket
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(server_fd == -1){
+        perror("Socket Create Failed!");
+        return -1;
+    }
+    std::cout << "Create Socket success!" << std::endl;
+    std::cout << "Pid : " << getpid() << std::endl;
+
+    // 2. 设置地址重用
+    int opt = 1;
+    if ((setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)){
+        perror("Setsockopt Failed!");
+        close(server_fd);
+        return -1;
+    }
+
+    // 3. 绑定地址
+    sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    address.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0){
+        perror("Bind failed!");
+        close(server_fd);
+        return -1;
+    }
+    std::cout << "Bind the PORT" << PORT << std::endl;
+
+    // 4. 监听
+    if(listen(server_fd, LISTEN_BACKLOG) < 0){
+        perror("Listen failed!");
+        close(server_fd);
+        return -1;
+    }
+    std::cout << "Server PID: " << getpid() << " listening on port " << PORT << std::endl;
+    return server_fd;
+}
+
+
+int main(int argc, char* argv[]){
+    std::string mode = argc > 1 ? argv[1] : "fork";
+    if(mode != "fork" && mode != "prefork"){
+        std::cerr << "未知模式: " << mode << "，用法: " << argv[0] << " [fork|prefork] [N]" << std::endl;
+        return -1;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = argc > 2 ? std::stoi(argv[2]) : static_cast<int>(cpus > 0 ? cpus : 1);
+    if(workers <= 0) workers = 1;
+
+#ifdef __linux__
+    executable_path();  // 记下启动时的程序路径，热重启时exec它
+    Takeover takeover;  // 由热重启启动时，监听socket从旧进程接收
+#endif
+    // 屏蔽退出和子进程信号，改为从signalfd读取，子进程继承屏蔽字和signalfd
+    // SIGUSR1：父进程打印统计；SIGQUIT：平滑退出；SIGUSR2：热重启
+    SignalChannel signals({SIGINT, SIGTERM, SIGCHLD, SIGUSR1, SIGQUIT, SIGUSR2});
+    if(!signals.valid()){
+        perror("Signalfd Failed!");
+        return -1;
+    }
+
+    // 1~4. 创建监听socket；热重启时直接使用旧进程交出的监听socket，它的accept队列中可能已经有等待的连接
+    int server_fd = -1;
+#ifdef __linux__
+    if(takeover.requested()){
+        std::vector<int> fds;
+        if(!takeover.receive(fds) || fds.empty()){
+            perror("Receive Listen Socket Failed!");
+            return -1;
+        }
+        server_fd = fds[0];
+        for(size_t i = 1; i < fds.size(); ++i) close(fds[i]);
+        std::cout << "Server PID: " << getpid() << " took over listening socket from old process" << std::endl;
+    }
+#endif
+    if(server_fd < 0) server_fd = create_listen_socket();
+    if(server_fd < 0) return -1;
+
+    // 统计段在fork之前创建，所有子进程继承映射
+    StatsRegion stats;
+    if(stats.create(stats_key(PORT), mode == "prefork" ? workers : 1)){
+        stats.header().master_pid = getpid();
+        stats.header().started_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        stats_region = &stats;
+    }
+    else{
+        perror("Create Stats Segment Failed!");
+    }
+
+    // 通知旧进程停止接受连接：prefork模式在worker都开始accept之后，fork模式在父进程开始accept之前
+    // (这时到达的连接排在accept队列中，主循环马上取走)
+    std::function<void()> notify_ready;
+#ifdef __linux__
+    if(takeover.requested()){
+        notify_ready = [&takeover](){
+            if(!takeover.ready()) perror("Notify Old Process Failed!");
+        };
+    }
+#endif
+
+    // 5. 主循环
+    if(mode == "prefork") run_prefork(server_fd, workers, signals, argv, notify_ready);
+    else{
+        if(notify_ready) notify_ready();
+        run_fork_per_connection(server_fd, signals, argv);
+    }
 
     std::cout << "正在关闭服务器..." << std::endl;
-    std::cout << "等待 " << child_pids.size() << " 个子进程关闭" << std::endl;
 
     // 6. 关闭监听socket
     close(server_fd);
     std::cout << "Close server socket success" << std::endl;
 
-    // 等待所有子进程结束
+    if(drain_server && !stop_server) drain_children(signals);
+    std::cout << "等待 " << child_pids.size() << " 个子进程关闭" << std::endl;
+
+    // 通知还在处理连接的子进程退出，再等待它们结束
+    for(pid_t pid : child_pids){
+        kill(pid, SIGTERM);
+    }
     for(pid_t pid : child_pids){
         int status;
         waitpid(pid, &status, 0);
-        std::cout << "子进程: " << getpid() << " 已结束" << std::endl;
+        std::cout << "子进程: " << pid << " 已结束" << std::endl;
     }
 
+    if(stats_region) print_stats(*stats_region, std::cout);
     std::cout << "服务器关闭" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+#pragma once
+// 多进程服务器的共享内存统计段(System V共享内存)
+// 父进程在fork之前创建，子进程继承映射，每个worker只写自己的槽位；父进程和外部的stats工具直接读取，
+// 不需要任何IPC往返，也不会打扰worker
+// 每个槽位按缓存行(64字节)对齐，不同worker的计数器不在同一缓存行上，互相之间没有伪共享；
+// 计数器用relaxed原子操作更新：热路径上只是对本进程独占缓存行的一次原子加，没有系统调用和锁
+// 读者看到的是各计数器各自的最新值，不是同一时刻的快照，用于监控足够
+//
+// 布局: [StatsHeader][WorkerStats × slots]，段的key由端口决定(stats_key)，stats工具用同样的端口找到它
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <ostream>
+#include <string>
+#include <iomanip>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+const size_t CACHE_LINE = 64;
+const int LATENCY_BUCKETS = 24;  // 桶i为[2^i, 2^(i+1))微秒，桶0还包括0~1微秒，最后一个桶包括所有更大的值
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "共享内存中的计数器必须是无锁的(与地址无关)");
+
+// 一个worker的计数器，只有该worker写
+struct alignas(CACHE_LINE) WorkerStats {
+    std::atomic<int64_t> pid;            // 当前占用该槽位的进程，0表示空
+    std::atomic<uint64_t> restarts;      // 槽位上的worker被重启的次数
+    std::atomic<uint64_t> connections;   // 累计接受的连接
+    std::atomic<int64_t> active;         // 当前打开的连接
+    std::atomic<uint64_t> requests;      // 处理的请求(每次读到的数据为一条)
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<uint64_t> latency[LATENCY_BUCKETS];  // 请求的服务时间：读到请求到回复交给内核(或排入发送队列)
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void open_connection() {
+        add(connections);
+        active.fetch_add(1, std::memory_order_relaxed);
+    }
+    void close_connection() { active.fetch_sub(1, std::memory_order_relaxed); }
+
+    static int bucket_of(uint64_t us) {
+        int b = us < 2 ? 0 : 63 - __builtin_clzll(us);
+        return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+    }
+
+    void record_latency(uint64_t us) { add(latency[bucket_of(us)]); }
+
+    static uint64_t get(const std::atomic<uint64_t>& counter) { return counter.load(std::memory_order_relaxed); }
+};
+
+struct alignas(CACHE_LINE) StatsHeader {
+    static constexpr uint32_t MAGIC = 0x53545453;  // "STTS"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;           // 槽位数(worker数)
+    uint32_t slot_size;       // sizeof(WorkerStats)，读者据此检查布局是否一致
+    int64_t master_pid;
+    int64_t started_ms;       // 服务器启动时间(CLOCK_REALTIME毫秒)
+};
+
+// 统计段的key：ftok需要一个双方都知道的文件，这里直接用端口区分不同的服务器实例
+inline key_t stats_key(int port) { return static_cast<key_t>(0x53540000 + port); }
+
+// 已映射的统计段
+class StatsRegion {
+public:
+    StatsRegion() = default;
+    StatsRegion(const StatsRegion&) = delete;
+    StatsRegion& operator=(const StatsRegion&) = delete;
+    ~StatsRegion() { detach(); }
+
+    // 服务器创建：已存在的同名段(上次异常退出留下的)先删除，新段由内核清零；失败返回false(errno)
+    bool create(key_t key, uint32_t slots) {
+        size_t size = sizeof(StatsHeader) + slots * sizeof(WorkerStats);
+        id_ = shmget(key, size, IPC_CREAT | IPC_EXCL | 0644);
+        if(id_ < 0 && errno == EEXIST) {
+            int old = shmget(key, 0, 0);
+            if(old >= 0) shmctl(old, IPC_RMID, nullptr);
+            id_ = shmget(key, size, IPC_CREAT | IPC_EXCL | 0644);
+        }
+        if(id_ < 0 || !map(false)) return false;
+        header_->magic = StatsHeader::MAGIC;
+        header_->version = StatsHeader::VERSION;
+        header_->slots = slots;
+        header_->slot_size = sizeof(WorkerStats);
+        owner_ = true;
+        return true;
+    }
+
+    // 外部工具只读映射已有的段，布局不一致时返回false
+    bool attach(key_t key) {
+        id_ = shmget(key, 0, 0);
+        if(id_ < 0 || !map(true)) return false;
+        if(header_->magic != StatsHeader::MAGIC || header_->version != StatsHeader::VERSION ||
+           header_->slot_size != sizeof(WorkerStats)) {
+            detach();
+            errno = EPROTO;
+            return false;
+        }
+        return true;
+    }
+
+    // 创建者负责删除：标记为删除后，所有进程都解除映射时内核才真正释放
+    // fork出的子进程继承映射，但它们以exit退出，不会析构父进程栈上的StatsRegion
+    void detach() {
+        if(!header_) return;
+        shmdt(header_);
+        if(owner_) shmctl(id_, IPC_RMID, nullptr);
+        header_ = nullptr;
+        owner_ = false;
+    }
+
+    bool valid() const { return header_ != nullptr; }
+    StatsHeader& header() const { return *header_; }
+    uint32_t slots() const { return header_->slots; }
+    WorkerStats& slot(uint32_t i) const { return reinterpret_cast<WorkerStats*>(header_ + 1)[i]; }
+
+private:
+    int id_ = -1;
+    StatsHeader* header_ = nullptr;
+    bool owner_ = false;
+
+    bool map(bool readonly) {
+        void* p = shmat(id_, nullptr, readonly ? SHM_RDONLY : 0);
+        if(p == reinterpret_cast<void*>(-1)) return false;
+        header_ = static_cast<StatsHeader*>(p);
+        return true;
+    }
+};
+
+// 直方图的百分位数，返回所在桶的上界(微秒)
+inline uint64_t latency_percentile(const uint64_t (&hist)[LATENCY_BUCKETS], double p) {
+    uint64_t total = 0;
+    for(uint64_t n : hist) total += n;
+    if(total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total);
+    uint64_t seen = 0;
+    for(int b = 0; b < LATENCY_BUCKETS; ++b) {
+        seen += hist[b];
+        if(seen > rank) return uint64_t(2) << b;
+    }
+    return uint64_t(2) << (LATENCY_BUCKETS - 1);
+}
+
+// 每个槽位一行，最后一行为合计；父进程和stats工具共用
+inline void print_stats(const StatsRegion& region, std::ostream& os) {
+    os << std::left << std::setw(6) << "slot" << std::setw(9) << "pid" << std::setw(9) << "restarts"
+       << std::setw(12) << "conns" << std::setw(8) << "active" << std::setw(12) << "requests"
+       << std::setw(14) << "bytes_in" << std::setw(14) << "bytes_out" << std::setw(10) << "p50(us)"
+       << "p99(us)" << std::endl;
+    uint64_t total_hist[LATENCY_BUCKETS] = {};
+    uint64_t conns = 0, requests = 0, bytes_in = 0, bytes_out = 0, restarts = 0;
+    int64_t active = 0;
+    auto row = [&os](const std::string& name, int64_t pid, uint64_t restarts, uint64_t conns, int64_t active,
+                     uint64_t requests, uint64_t in, uint64_t out, const uint64_t (&hist)[LATENCY_BUCKETS]) {
+        os << std::left << std::setw(6) << name << std::setw(9) << pid << std::setw(9) << restarts
+           << std::setw(12) << conns << std::setw(8) << active << std::setw(12) << requests
+           << std::setw(14) << in << std::setw(14) << out << std::setw(10) << latency_percentile(hist, 50)
+           << latency_percentile(hist, 99) << std::endl;
+    };
+    for(uint32_t i = 0; i < region.slots(); ++i) {
+        const WorkerStats& w = region.slot(i);
+        uint64_t hist[LATENCY_BUCKETS];
+        for(int b = 0; b < LATENCY_BUCKETS; ++b) {
+            hist[b] = WorkerStats::get(w.latency[b]);
+            total_hist[b] += hist[b];
+        }
+        int64_t slot_active = w.active.load(std::memory_order_relaxed);
+        row(std::to_string(i), w.pid.load(std::memory_order_relaxed), WorkerStats::get(w.restarts),
+            WorkerStats::get(w.connections), slot_active, WorkerStats::get(w.requests),
+            WorkerStats::get(w.bytes_in), WorkerStats::get(w.bytes_out), hist);
+        restarts += WorkerStats::get(w.restarts);
+        conns += WorkerStats::get(w.connections);
+        active += slot_active;
+        requests += WorkerStats::get(w.requests);
+        bytes_in += WorkerStats::get(w.bytes_in);
+        bytes_out += WorkerStats::get(w.bytes_out);
+    }
+    row("total", region.header().master_pid, restarts, conns, active, requests, bytes_in, bytes_out, total_hist);
+}
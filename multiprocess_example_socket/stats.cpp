@@ -0,0 +1,58 @@
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal> // 信号处理
+#include "shm_stats.hpp"
+
+// 查看多进程服务器的共享内存统计段，只读映射，不和服务器进程有任何交互
+// 用法: ./stats [间隔秒数] [端口]
+//   不带参数时打印一次；指定间隔时每隔若干秒打印一次，并给出这段时间内的请求速率和吞吐量，Ctrl+C退出
+// 编译: g++ -std=c++17 -O2 stats.cpp -o stats
+
+volatile sig_atomic_t stop_stats = 0;
+
+int main(int argc, char* argv[]){
+    int interval = argc > 1 ? std::stoi(argv[1]) : 0;
+    int port = argc > 2 ? std::stoi(argv[2]) : 8080;
+
+    StatsRegion region;
+    if(!region.attach(stats_key(port))){
+        perror("Attach Stats Segment Failed! (服务器是否在运行?)");
+        return -1;
+    }
+    std::cout << "服务器PID: " << region.header().master_pid << "，槽位数: " << region.slots() << std::endl;
+
+    signal(SIGINT, [](int){ stop_stats = 1; });
+    uint64_t last_requests = 0, last_bytes = 0;
+    bool first = true;
+    auto last_time = std::chrono::steady_clock::now();
+    while(true){
+        print_stats(region, std::cout);
+        if(interval <= 0) break;
+
+        uint64_t requests = 0, bytes = 0;
+        for(uint32_t i = 0; i < region.slots(); ++i){
+            requests += WorkerStats::get(region.slot(i).requests);
+            bytes += WorkerStats::get(region.slot(i).bytes_in) + WorkerStats::get(region.slot(i).bytes_out);
+        }
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_time).count();
+        if(!first){
+            std::cout << "请求/s: " << static_cast<uint64_t>((requests - last_requests) / elapsed)
+                      << "  字节/s: " << static_cast<uint64_t>((bytes - last_bytes) / elapsed) << std::endl;
+        }
+        std::cout << std::endl;
+        last_requests = requests;
+        last_bytes = bytes;
+        last_time = now;
+        first = false;
+
+        for(int i = 0; i < interval * 10 && !stop_stats; ++i){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if(stop_stats) break;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// HTTP/1.1请求解析和预先序列化的静态响应
+// 解析器直接在连接缓冲区上工作，请求行和头部都是指向缓冲区的string_view，不拷贝；
+// 请求不完整时记住已经扫描过的位置，收到更多数据后从断点继续查找头部结束标记
+// 一次解析一个请求，调用方丢弃已解析的字节后继续解析，即可处理流水线请求
+// 请求体只支持Content-Length，Transfer-Encoding(分块上传)返回NOT_IMPLEMENTED
+
+
+struct HttpHeader{
+    std::string_view name;
+    std::string_view value;
+};
+
+struct HttpRequest{
+    static constexpr size_t MAX_HEADERS = 32;
+
+    std::string_view method;
+    std::string_view target;
+    int minor_version = 1;          // HTTP/1.x
+    HttpHeader headers[MAX_HEADERS];
+    size_t header_count = 0;
+    std::string_view body;
+    bool keep_alive = true;
+
+    // 按名字查找头部(不区分大小写)，不存在时返回空
+    std::string_view header(std::string_view name) const;
+};
+
+
+// 不区分大小写比较ASCII字符串
+inline bool http_iequals(std::string_view a, std::string_view b){
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); ++i){
+        char x = a[i], y = b[i];
+        if(x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if(y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if(x != y) return false;
+    }
+    return true;
+}
+
+inline std::string_view HttpRequest::header(std::string_view name) const{
+    for(size_t i = 0; i < header_count; ++i){
+        if(http_iequals(headers[i].name, name)) return headers[i].value;
+    }
+    return std::string_view();
+}
+
+
+class HttpParser{
+public:
+    enum Status{
+        COMPLETE,          // 解析出一个完整的请求
+        NEED_MORE,         // 数据不完整，等待更多数据
+        BAD_REQUEST,       // 格式错误 -> 400
+        HEADER_TOO_LARGE,  // 请求行+头部超过MAX_HEADER_BYTES或头部过多 -> 431
+        BODY_TOO_LARGE,    // 请求体超过上限 -> 413
+        NOT_IMPLEMENTED,   // 不支持的Transfer-Encoding -> 501
+    };
+
+    static constexpr size_t MAX_HEADER_BYTES = 8 * 1024;
+    static constexpr size_t DEFAULT_MAX_BODY = 48 * 1024;  // 整个请求要能放进一个最大级别的连接缓冲区
+
+    explicit HttpParser(size_t max_body = DEFAULT_MAX_BODY) : max_body_(max_body){}
+
+    // 解析data开头的一个请求；COMPLETE时consumed为整个请求(含请求体)的字节数，
+    // req中的string_view都指向data，调用方丢弃这些字节之前有效
+    Status parse(const char* data, size_t size, HttpRequest& req, size_t& consumed){
+        std::string_view buf(data, size);
+
+        // 1. 跳过请求之间多余的空行(RFC 7230 3.5)
+        size_t start = 0;
+        while(start + 1 < size && data[start] == '\r' && data[start + 1] == '\n') start += 2;
+
+        // 2. 从上次扫描到的位置继续查找头部结束标记，已经扫描过的部分不再重复扫描
+        size_t from = scanned_ > start + 3 ? scanned_ - 3 : start;
+        size_t end = buf.find("\r\n\r\n", from);
+        if(end == std::string_view::npos){
+            scanned_ = size;
+            return size - start > MAX_HEADER_BYTES ? HEADER_TOO_LARGE : NEED_MORE;
+        }
+        size_t header_end = end + 4;
+        if(header_end - start > MAX_HEADER_BYTES) return HEADER_TOO_LARGE;
+        scanned_ = end;  // 请求体不完整时下次直接从这里找到结束标记
+
+        // 3. 请求行: METHOD SP request-target SP HTTP/1.x
+        size_t line_end = buf.find("\r\n", start);
+        std::string_view line = buf.substr(start, line_end - start);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if(sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1) return BAD_REQUEST;
+        req.method = line.substr(0, sp1);
+        req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        std::string_view version = line.substr(sp2 + 1);
+        if(version.size() != 8 || version.substr(0, 7) != "HTTP/1." ||
+           (version[7] != '0' && version[7] != '1')){
+            return BAD_REQUEST;
+        }
+        req.minor_version = version[7] - '0';
+
+        // 4. 头部: name ":" OWS value OWS
+        req.header_count = 0;
+        size_t content_length = 0;
+        bool has_length = false;
+        bool close = false, keep_alive = false;
+        size_t pos = line_end + 2;
+        while(pos < end + 2){
+            size_t eol = buf.find("\r\n", pos);
+            std::string_view field = buf.substr(pos, eol - pos);
+            pos = eol + 2;
+
+            size_t colon = field.find(':');
+            if(colon == 0 || colon == std::string_view::npos || field[0] == ' ' || field[0] == '\t'){
+                return BAD_REQUEST;  // 缺少冒号或者是已废弃的折行
+            }
+            std::string_view name = field.substr(0, colon);
+            if(name.back() == ' ' || name.back() == '\t') return BAD_REQUEST;
+            std::string_view value = trim(field.substr(colon + 1));
+            if(req.header_count == HttpRequest::MAX_HEADERS) return HEADER_TOO_LARGE;
+            req.headers[req.header_count++] = HttpHeader{name, value};
+
+            if(http_iequals(name, "content-length")){
+                size_t n;
+                if(!parse_size(value, n) || (has_length && n != content_length)) return BAD_REQUEST;
+                content_length = n;
+                has_length = true;
+            }
+            else if(http_iequals(name, "transfer-encoding")){
+                return NOT_IMPLEMENTED;
+            }
+            else if(http_iequals(name, "connection")){
+                scan_connection(value, close, keep_alive);
+            }
+        }
+
+        // HTTP/1.1默认保持连接，HTTP/1.0需要显式的Connection: keep-alive
+        req.keep_alive = req.minor_version == 1 ? !close : (keep_alive && !close);
+
+        // 5. 请求体
+        if(content_length > max_body_) return BODY_TOO_LARGE;
+        if(size - header_end < content_length) return NEED_MORE;
+        req.body = buf.substr(header_end, content_length);
+        consumed = header_end + content_length;
+        scanned_ = 0;
+        return COMPLETE;
+    }
+
+private:
+    size_t max_body_;
+    size_t scanned_ = 0;  // data中已确认不含头部结束标记的前缀长度
+
+    static std::string_view trim(std::string_view s){
+        while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while(!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    static bool parse_size(std::string_view s, size_t& out){
+        if(s.empty() || s.size() > 15) return false;
+        size_t n = 0;
+        for(char c : s){
+            if(c < '0' || c > '9') return false;
+            n = n * 10 + (c - '0');
+        }
+        out = n;
+        return true;
+    }
+
+    // Connection头是逗号分隔的选项列表
+    static void scan_connection(std::string_view value, bool& close, bool& keep_alive){
+        while(!value.empty()){
+            size_t comma = value.find(',');
+            std::string_view token = trim(value.substr(0, comma));
+            if(http_iequals(token, "close")) close = true;
+            else if(http_iequals(token, "keep-alive")) keep_alive = true;
+            if(comma == std::string_view::npos) break;
+            value.remove_prefix(comma + 1);
+        }
+    }
+};
+
+
+// 预先序列化好的响应，处理请求时只把指针放进发送队列，不做任何格式化
+// Content-Length在构造时按实际内容计算
+class StaticResponse{
+public:
+    StaticResponse(const char* status, const char* body, bool keep_alive){
+        std::string_view b(body);
+        text_ = header(status, "text/plain", b.size(), keep_alive);
+        header_len_ = text_.size();
+        text_.append(b);
+    }
+
+    // 只有头部的响应，content_length字节的正文由调用方单独排入发送队列(例如sendfile发送的文件)
+    StaticResponse(const char* status, const char* content_type, size_t content_length, bool keep_alive)
+        : text_(header(status, content_type, content_length, keep_alive)), header_len_(text_.size()){}
+
+    std::string_view full() const { return text_; }
+    std::string_view head() const { return std::string_view(text_).substr(0, header_len_); }  // HEAD请求只发头部
+
+private:
+    std::string text_;
+    size_t header_len_;
+
+    static std::string header(const char* status, const char* content_type, size_t content_length, bool keep_alive){
+        return std::string("HTTP/1.1 ") + status + "\r\n"
+             + "Content-Type: " + content_type + "\r\n"
+             + "Content-Length: " + std::to_string(content_length) + "\r\n"
+             + (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n")
+             + "\r\n";
+    }
+};
@@ -0,0 +1,90 @@
+#include <iostream>            // C++标准输入输出流，用于控制台输入输出
+#include <cstdio>              // fopen()、fread()
+#include <cstring>             // memcmp()
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "logger.hpp"          // 二进制日志格式定义和格式化函数
+
+// 二进制日志解码工具：把Logger::Mode::BINARY写出的日志转换成与ASYNC模式相同的文本
+// 用法: ./log_decoder [binlog文件]，省略文件名时从标准输入读取
+// 日志文件使用写出时的本机字节序，需要在同一字节序的机器上解码
+
+
+// 读取n字节，文件在记录中间结束时返回false
+static bool read_exact(FILE* in, void* buf, size_t n){
+    return fread(buf, 1, n, in) == n;
+}
+
+
+int main(int argc, char* argv[]){
+    FILE* in = stdin;
+    if(argc > 1){
+        in = fopen(argv[1], "rb");
+        if(in == nullptr){
+            std::cerr << "[ERROR] ";
+            perror("Open Log File Failed");
+            return -1;
+        }
+    }
+
+    // 1. 校验文件头
+    char magic[sizeof(Logger::BINLOG_MAGIC)];
+    if(!read_exact(in, magic, sizeof(magic)) ||
+       memcmp(magic, Logger::BINLOG_MAGIC, sizeof(magic)) != 0){
+        std::cerr << "[ERROR] 不是二进制日志文件" << std::endl;
+        return -1;
+    }
+
+    // 2. 逐条解码记录，FORMAT记录建立格式表，EVENT记录按格式表格式化
+    struct Format{
+        bool known = false;
+        int level = LOG_LEVEL_INFO;
+        std::string fmt;
+    };
+    std::vector<Format> formats(1 << 16);
+    std::vector<char> payload;
+    char text[Logger::RECORD_MAX];
+    size_t records = 0;
+
+    uint32_t hdr;
+    while(read_exact(in, &hdr, 4)){
+        uint32_t len = hdr & Logger::LEN_MASK;
+        payload.resize(len);
+        if(!read_exact(in, payload.data(), len)){
+            std::cerr << "[ERROR] 日志文件在记录中间结束" << std::endl;
+            break;
+        }
+        ++records;
+
+        if(hdr & Logger::FORMAT_FLAG){
+            if(len < 3) continue;
+            uint16_t id;
+            memcpy(&id, payload.data(), 2);
+            Format& f = formats[id];
+            f.known = true;
+            f.level = static_cast<uint8_t>(payload[2]);
+            f.fmt.assign(payload.data() + 3, len - 3);
+        }
+        else if(hdr & Logger::EVENT_FLAG){
+            if(len < 2) continue;
+            uint16_t id;
+            memcpy(&id, payload.data(), 2);
+            const Format& f = formats[id];
+            if(!f.known){
+                std::cerr << "[ERROR] 未定义的格式编号: " << id << std::endl;
+                continue;
+            }
+            size_t n = Logger::format_event(f.level, f.fmt.c_str(), payload.data() + 2, len - 2,
+                                            text, sizeof(text));
+            fwrite(text, 1, n, stdout);
+        }
+        else{
+            fwrite(payload.data(), 1, len, stdout);  // 文本日志原样输出
+        }
+    }
+
+    if(in != stdin) fclose(in);
+    std::cerr << "[INFO] 共解码 " << records << " 条记录" << std::endl;
+    return 0;
+}
@@ -0,0 +1,639 @@
+#pragma once
+#include <iostream>            // C++标准输入输出流，用于控制台输入输出
+#include <ostream>             // 在固定缓冲区上格式化
+#include <streambuf>
+#include <mutex>               // C++11互斥锁，只用于注册线程缓冲区和唤醒写线程
+#include <condition_variable>  // 写线程空闲时休眠
+#include <thread>              // 后台写线程
+#include <atomic>              // 无锁环形缓冲区的读写位置
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdio>              // snprintf
+#include <cstdint>
+#include <climits>             // IOV_MAX
+#include <utility>             // std::forward
+#include <algorithm>           // std::min
+#include <string>
+#include <string_view>
+#include <type_traits>         // 结构化日志按参数类型编码
+#include <stdexcept>
+#include <unistd.h>            // write()
+#include <fcntl.h>             // open()
+#include <sys/uio.h>           // writev()
+#include <netinet/in.h>        // sockaddr_in
+#include <arpa/inet.h>         // inet_ntop()
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/membarrier.h>  // 写线程休眠前的非对称内存屏障
+#endif
+
+// 日志级别，低于LOG_MIN_LEVEL的调用在编译期被去掉
+// 编译时用 -DLOG_MIN_LEVEL=0 打开debug日志
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_ERROR 2
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+// 结构化日志：调用线程只记录格式编号和参数的原始字节，格式化推迟到写线程(ASYNC)或离线解码工具(BINARY)
+// fmt必须是字符串字面量，其中的{}依次被参数替换；每个调用点第一次执行时注册一次格式串
+// 用法: LOG_EVENT(logger, LOG_LEVEL_INFO, "连接客户端: {}", LogPeer(client_addr));
+#define LOG_EVENT(logger, level, fmt, ...)                                              \
+    do{                                                                                 \
+        if constexpr((level) >= LOG_MIN_LEVEL){                                         \
+            static const uint16_t log_fmt_id_ = Logger::register_format((level), fmt);  \
+            (logger).event(log_fmt_id_, ##__VA_ARGS__);                                 \
+        }                                                                               \
+    }while(0)
+
+// 结构化日志参数：以二进制记录对端地址，格式化时才转换成"ip:port"
+struct LogPeer{
+    uint32_t addr;  // 网络字节序
+    uint16_t port;  // 主机字节序
+    explicit LogPeer(const sockaddr_in& a) : addr(a.sin_addr.s_addr), port(ntohs(a.sin_port)){}
+};
+
+// 线程安全日志
+// ASYNC(默认): 调用线程把日志格式化到自己的单生产者单消费者环形缓冲区后立即返回，不加锁、不做系统调用；
+//              后台写线程轮询所有线程的缓冲区，直接用缓冲区中的记录组成iovec，一次writev批量写出；
+//              同一线程内的日志保持顺序，不同线程之间只保证大致的时间顺序
+// SYNC       : 调用线程格式化后直接write，适合调试时需要日志立即可见的场景
+// BINARY     : 与ASYNC相同的缓冲区和写线程，但结构化日志不格式化，连同格式表原样写出，
+//              由log_decoder离线转换成文本
+class Logger{
+public:
+    enum class Mode { SYNC, ASYNC, BINARY };
+
+    // 二进制日志文件格式：8字节文件头，之后是连续的记录[4字节头][内容]，字节序为本机字节序
+    // 头的低24位是内容长度，高位是记录类型：
+    //   TEXT  : 文本日志，内容就是一行文本
+    //   FORMAT: 格式定义，内容为[2字节格式编号][1字节日志级别][格式串]，在该格式第一次出现之前写出
+    //   EVENT : 结构化日志，内容为[2字节格式编号][参数...]，每个参数为[1字节类型][值]
+    static constexpr char BINLOG_MAGIC[8] = {'B', 'I', 'N', 'L', 'O', 'G', '1', '\n'};
+    static constexpr uint32_t EVENT_FLAG = 0x80000000u;
+    static constexpr uint32_t FORMAT_FLAG = 0x40000000u;
+    static constexpr uint32_t LEN_MASK = 0x00FFFFFFu;
+    static constexpr size_t RECORD_MAX = 1024;        // 单条日志最大长度，超出部分截断
+
+private:
+    static constexpr size_t RING_SIZE = 1 << 18;      // 每个线程的环形缓冲区大小
+    static constexpr int FULL_RETRIES = 256;          // 缓冲区满时让出CPU等待写线程的次数，之后丢弃
+    static constexpr uint32_t WRAP_MARKER = 0xFFFFFFFFu;
+    static constexpr size_t MAX_FORMATS = 4096;       // 结构化日志格式表大小，0号保留给"格式表已满"
+    static constexpr size_t SCRATCH_SIZE = 64 * RECORD_MAX;  // 写线程格式化一批结构化日志用的缓冲区
+
+    // 结构化日志参数类型
+    enum ArgType : uint8_t { ARG_I64 = 1, ARG_U64, ARG_F64, ARG_STR, ARG_PEER };
+
+    struct FormatInfo{
+        int level;
+        const char* fmt;
+    };
+    inline static FormatInfo formats_[MAX_FORMATS] = {{LOG_LEVEL_ERROR, "日志格式表已满"}};
+    inline static uint32_t format_count_ = 1;
+    inline static std::mutex formats_mtx_;
+
+    // 单个线程的环形缓冲区：记录格式为[4字节头][内容]，按4字节对齐，头的含义与二进制日志文件相同；
+    // 尾部空间不够放下一条记录时写入WRAP_MARKER，从头开始写
+    struct alignas(64) Ring{
+        alignas(64) std::atomic<uint64_t> head{0};   // 生产者写入位置
+        alignas(64) std::atomic<uint64_t> tail{0};   // 写线程读取位置
+        uint64_t cached_tail = 0;                    // 生产者缓存的tail，减少跨核读取
+        std::atomic<uint64_t> dropped{0};            // 缓冲区满时丢弃的日志数
+        char data[RING_SIZE];
+    };
+
+    // 在固定数组上格式化，不分配内存
+    class FixedBuf : public std::streambuf{
+    public:
+        void reset(char* buf, size_t n){ setp(buf, buf + n); }
+        size_t size() const { return pptr() - pbase(); }
+    protected:
+        int_type overflow(int_type) override { return traits_type::eof(); }  // 超长截断
+    };
+
+    const Mode mode_;
+    const int fd_;
+    bool owns_fd_ = false;                         // fd_由Logger打开，析构时关闭
+    const uint64_t id_;                            // 实例编号，用于区分线程本地缓存属于哪个Logger
+    std::mutex rings_mtx_;
+    std::vector<std::unique_ptr<Ring>> rings_;     // 所有线程的缓冲区，Logger析构时释放
+    std::atomic<uint64_t> rings_version_{0};
+
+    std::thread writer_;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> writer_sleeping_{false};
+    std::mutex wake_mtx_;
+    std::condition_variable wake_cv_;
+    bool wake_pending_ = false;  // 由wake_mtx_保护，写线程休眠期间收到过唤醒
+    bool membarrier_ = false;    // 可以使用membarrier，写线程空闲时无限休眠
+
+    static uint64_t next_id(){
+        static std::atomic<uint64_t> id{1};
+        return id.fetch_add(1);
+    }
+
+    static size_t align4(size_t n){ return (n + 3) & ~size_t(3); }
+
+    static int open_file(const char* path){
+        if(path == nullptr) return STDOUT_FILENO;
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if(fd < 0){
+            perror("Open Log File Failed");
+            throw std::runtime_error("Failed to open log file");
+        }
+        return fd;
+    }
+
+    static const char* level_tag(int level){
+        if(level <= LOG_LEVEL_DEBUG) return "[DEBUG] ";
+        if(level == LOG_LEVEL_INFO) return "[INFO] ";
+        return "[ERROR] ";
+    }
+
+    static void encode_str(char*& p, char* end, const char* s, size_t n){
+        if(end - p < 3) return;
+        n = std::min(n, static_cast<size_t>(end - p - 3));
+        uint16_t n16 = static_cast<uint16_t>(n);
+        *p = ARG_STR;
+        std::memcpy(p + 1, &n16, 2);
+        std::memcpy(p + 3, s, n);
+        p += 3 + n;
+    }
+
+    // 把一个参数按[类型][值]追加到p，空间不够时丢弃该参数(格式化时对应的{}原样输出)
+    template <typename T>
+    static void encode_arg(char*& p, char* end, const T& v){
+        using U = std::decay_t<T>;
+        if constexpr(std::is_same_v<U, LogPeer>){
+            if(end - p < 7) return;
+            *p = ARG_PEER;
+            std::memcpy(p + 1, &v.addr, 4);
+            std::memcpy(p + 5, &v.port, 2);
+            p += 7;
+        }
+        else if constexpr(std::is_integral_v<U>){
+            if(end - p < 9) return;
+            if constexpr(std::is_signed_v<U>){
+                int64_t x = v;
+                *p = ARG_I64;
+                std::memcpy(p + 1, &x, 8);
+            }
+            else{
+                uint64_t x = v;
+                *p = ARG_U64;
+                std::memcpy(p + 1, &x, 8);
+            }
+            p += 9;
+        }
+        else if constexpr(std::is_floating_point_v<U>){
+            if(end - p < 9) return;
+            double x = v;
+            *p = ARG_F64;
+            std::memcpy(p + 1, &x, 8);
+            p += 9;
+        }
+        else if constexpr(std::is_same_v<U, const char*> || std::is_same_v<U, char*>){
+            encode_str(p, end, v, std::strlen(v));
+        }
+        else if constexpr(std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>){
+            encode_str(p, end, v.data(), v.size());
+        }
+        else{
+            static_assert(sizeof(U) == 0, "LOG_EVENT不支持该参数类型");
+        }
+    }
+
+    // 按格式表格式化一条EVENT记录的内容
+    static size_t format_record(const char* payload, size_t len, char* out, size_t cap){
+        uint16_t id;
+        std::memcpy(&id, payload, 2);
+        const FormatInfo& info = formats_[id < MAX_FORMATS ? id : 0];
+        return format_event(info.level, info.fmt, payload + 2, len - 2, out, cap);
+    }
+
+    // 当前线程在本Logger中的缓冲区，第一次写日志时注册
+    Ring* local_ring(){
+        struct Entry{ uint64_t id; Ring* ring; };
+        thread_local std::vector<Entry> cache;
+        for(const Entry& e : cache){
+            if(e.id == id_) return e.ring;
+        }
+        std::unique_ptr<Ring> ring(new Ring());
+        Ring* raw = ring.get();
+        {
+            std::lock_guard<std::mutex> lock(rings_mtx_);
+            rings_.push_back(std::move(ring));
+        }
+        rings_version_.fetch_add(1, std::memory_order_release);
+        cache.push_back(Entry{id_, raw});
+        return raw;
+    }
+
+    // 生产者：把一条记录放入环形缓冲区
+    // 空间不足时唤醒写线程并短暂让出CPU，仍然不够才丢弃并计数，不会无限阻塞调用线程
+    void push_record(const char* msg, size_t len, uint32_t flags = 0){
+        Ring& r = *local_ring();
+        uint64_t head = r.head.load(std::memory_order_relaxed);
+        size_t idx = head & (RING_SIZE - 1);
+        size_t contiguous = RING_SIZE - idx;
+        size_t need = align4(4 + len);
+        size_t total = need <= contiguous ? need : contiguous + need;  // 需要回绕时尾部空间也要算上
+
+        for(int retry = 0; RING_SIZE - (head - r.cached_tail) < total; ++retry){
+            r.cached_tail = r.tail.load(std::memory_order_acquire);
+            if(RING_SIZE - (head - r.cached_tail) >= total) break;
+            if(retry == FULL_RETRIES){
+                r.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wake_writer();
+            std::this_thread::yield();
+        }
+
+        if(need > contiguous){
+            std::memcpy(r.data + idx, &WRAP_MARKER, 4);
+            head += contiguous;
+            idx = 0;
+        }
+        uint32_t hdr = static_cast<uint32_t>(len) | flags;
+        std::memcpy(r.data + idx, &hdr, 4);
+        std::memcpy(r.data + idx + 4, msg, len);
+        r.head.store(head + need, std::memory_order_release);
+
+        // 与写线程休眠前的membarrier配对：要么这里看到writer_sleeping_，要么写线程看到新的head，唤醒不会丢失
+        // 生产者这边只需要阻止编译器重排，CPU层面的屏障由写线程的membarrier在所有运行中的线程上补上
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if(writer_sleeping_.load(std::memory_order_relaxed)){
+            wake_writer();
+        }
+    }
+
+    void wake_writer(){
+        {
+            std::lock_guard<std::mutex> lock(wake_mtx_);
+            wake_pending_ = true;
+        }
+        wake_cv_.notify_one();
+    }
+
+    // 写线程的重量级屏障：让本进程所有正在运行的线程都执行一次完整的内存屏障
+    bool heavy_barrier() const{
+#ifdef __linux__
+        return membarrier_ && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+        return false;
+#endif
+    }
+
+    static bool register_membarrier(){
+#ifdef __linux__
+        return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // 写线程宣布休眠之后再检查一次是否有新日志或新注册的缓冲区
+    bool has_pending(const std::vector<Ring*>& rings, uint64_t seen_version) const{
+        if(stop_.load(std::memory_order_acquire)) return true;
+        if(rings_version_.load(std::memory_order_acquire) != seen_version) return true;
+        for(Ring* r : rings){
+            if(r->head.load(std::memory_order_acquire) != r->tail.load(std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+    // 把所有iovec完整写出，处理部分写
+    void write_all(struct iovec* iov, int count){
+        while(count > 0){
+            ssize_t n = writev(fd_, iov, count);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                return;  // 输出失败时放弃这一批，不能让写线程卡死
+            }
+            while(count > 0 && static_cast<size_t>(n) >= iov->iov_len){
+                n -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if(count > 0){
+                iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+
+    // 写出写线程自己产生的文本(丢弃统计)，BINARY模式下加上TEXT记录头
+    void write_note(const char* msg, size_t len){
+        uint32_t hdr = static_cast<uint32_t>(len);
+        struct iovec iov[2] = {{&hdr, 4}, {const_cast<char*>(msg), len}};
+        if(mode_ == Mode::BINARY) write_all(iov, 2);
+        else write_all(iov + 1, 1);
+    }
+
+    // 写线程：轮询所有缓冲区，每个缓冲区的已提交记录直接作为iovec批量写出
+    // ASYNC模式下EVENT记录在这里格式化到scratch中；BINARY模式下记录连同头原样写出，
+    // 每种格式第一次出现前先写出它的FORMAT记录
+    void writer_loop(){
+        std::vector<Ring*> rings;
+        uint64_t seen_version = ~uint64_t(0);
+        struct iovec iov[IOV_MAX < 1024 ? IOV_MAX : 1024];
+        const int iov_cap = sizeof(iov) / sizeof(iov[0]) - 1;  // 留一个位置给FORMAT记录
+        std::unique_ptr<char[]> scratch(new char[SCRATCH_SIZE]);
+        std::vector<bool> announced(MAX_FORMATS, false);
+
+        if(mode_ == Mode::BINARY){
+            struct iovec magic = {const_cast<char*>(BINLOG_MAGIC), sizeof(BINLOG_MAGIC)};
+            write_all(&magic, 1);
+        }
+
+        while(true){
+            bool stopping = stop_.load(std::memory_order_acquire);
+            uint64_t version = rings_version_.load(std::memory_order_acquire);
+            if(version != seen_version){
+                std::lock_guard<std::mutex> lock(rings_mtx_);
+                rings.clear();
+                for(auto &r : rings_) rings.push_back(r.get());
+                seen_version = version;
+            }
+
+            size_t written = 0;
+            for(Ring* r : rings){
+                uint64_t tail = r->tail.load(std::memory_order_relaxed);
+                uint64_t head = r->head.load(std::memory_order_acquire);
+                while(tail != head){
+                    int count = 0;
+                    size_t used = 0;  // scratch已用字节数
+                    uint64_t pos = tail;
+                    while(pos != head && count < iov_cap){
+                        size_t idx = pos & (RING_SIZE - 1);
+                        uint32_t hdr;
+                        std::memcpy(&hdr, r->data + idx, 4);
+                        if(hdr == WRAP_MARKER){
+                            pos += RING_SIZE - idx;
+                            continue;
+                        }
+                        uint32_t len = hdr & LEN_MASK;
+                        char* rec = r->data + idx;
+                        if((hdr & EVENT_FLAG) && mode_ != Mode::BINARY){
+                            if(SCRATCH_SIZE - used < RECORD_MAX) break;  // 先写出这一批
+                            size_t n = format_record(rec + 4, len, scratch.get() + used, RECORD_MAX);
+                            iov[count].iov_base = scratch.get() + used;
+                            iov[count].iov_len = n;
+                            used += n;
+                        }
+                        else if(mode_ == Mode::BINARY){
+                            if(hdr & EVENT_FLAG){
+                                uint16_t id;
+                                std::memcpy(&id, rec + 4, 2);
+                                if(id >= MAX_FORMATS) id = 0;
+                                if(!announced[id]){
+                                    if(SCRATCH_SIZE - used < RECORD_MAX) break;
+                                    const FormatInfo& info = formats_[id];
+                                    size_t fmt_len = std::min(std::strlen(info.fmt), RECORD_MAX - 11);
+                                    char* def = scratch.get() + used;
+                                    uint32_t def_hdr = static_cast<uint32_t>(3 + fmt_len) | FORMAT_FLAG;
+                                    uint8_t level = static_cast<uint8_t>(info.level);
+                                    std::memcpy(def, &def_hdr, 4);
+                                    std::memcpy(def + 4, &id, 2);
+                                    std::memcpy(def + 6, &level, 1);
+                                    std::memcpy(def + 7, info.fmt, fmt_len);
+                                    iov[count].iov_base = def;
+                                    iov[count].iov_len = 7 + fmt_len;
+                                    used += 7 + fmt_len;
+                                    ++count;
+                                    announced[id] = true;
+                                }
+                            }
+                            iov[count].iov_base = rec;
+                            iov[count].iov_len = 4 + len;
+                        }
+                        else{
+                            iov[count].iov_base = rec + 4;
+                            iov[count].iov_len = len;
+                        }
+                        ++count;
+                        pos += align4(4 + len);
+                    }
+                    write_all(iov, count);
+                    written += count;
+                    tail = pos;
+                    r->tail.store(tail, std::memory_order_release);  // 写完后才释放空间给生产者
+                }
+
+                uint64_t dropped = r->dropped.exchange(0, std::memory_order_relaxed);
+                if(dropped > 0){
+                    char note[64];
+                    int n = snprintf(note, sizeof(note), "[ERROR] 日志缓冲区已满，丢弃 %llu 条日志\n",
+                                     static_cast<unsigned long long>(dropped));
+                    if(n > 0) write_note(note, std::min(static_cast<size_t>(n), sizeof(note) - 1));
+                }
+            }
+
+            if(written > 0) continue;
+            if(stopping) break;  // 停止前已经把所有缓冲区写空
+
+            // 没有日志可写：休眠，生产者看到writer_sleeping_时唤醒
+            // 有membarrier时先宣布休眠、执行屏障、再确认没有新日志，之后可以一直休眠，没有日志时不会周期性醒来；
+            // 否则偶尔丢失的唤醒只能由10ms的超时兜底
+            writer_sleeping_.store(true, std::memory_order_relaxed);
+            if(heavy_barrier()){
+                if(!has_pending(rings, seen_version)){
+                    std::unique_lock<std::mutex> lock(wake_mtx_);
+                    wake_cv_.wait(lock, [this](){ return wake_pending_; });
+                    wake_pending_ = false;
+                }
+            }
+            else{
+                std::unique_lock<std::mutex> lock(wake_mtx_);
+                wake_cv_.wait_for(lock, std::chrono::milliseconds(10), [this](){ return wake_pending_; });
+                wake_pending_ = false;
+            }
+            writer_sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename ...Args>
+    void log(const char* tag, Args&& ...args){
+        thread_local FixedBuf buf;
+        thread_local std::ostream os(&buf);
+        thread_local char record[RECORD_MAX];
+
+        buf.reset(record, RECORD_MAX - 1);  // 留一个字节给换行
+        os.clear();
+        os << tag;
+        (os << ... << std::forward<Args>(args));
+        size_t len = buf.size();
+        record[len++] = '\n';
+
+        if(mode_ == Mode::SYNC){
+            (void)!write(fd_, record, len);
+        }
+        else{
+            push_record(record, len);
+        }
+    }
+
+public:
+    // fd: 日志输出的文件描述符，默认为标准输出
+    explicit Logger(Mode mode = Mode::ASYNC, int fd = STDOUT_FILENO)
+        : mode_(mode), fd_(fd), id_(next_id()){
+        if(mode_ != Mode::SYNC){
+            membarrier_ = register_membarrier();
+            writer_ = std::thread(&Logger::writer_loop, this);
+        }
+    }
+
+    // path: 日志文件路径(覆盖写)，为nullptr时输出到标准输出；打开失败抛出异常
+    Logger(Mode mode, const char* path) : Logger(mode, open_file(path)){
+        owns_fd_ = path != nullptr;
+    }
+
+    // 析构时写完所有缓冲区中的日志
+    ~Logger(){
+        if(writer_.joinable()){
+            stop_.store(true, std::memory_order_release);
+            wake_writer();
+            writer_.join();
+        }
+        if(owns_fd_) close(fd_);
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // 注册结构化日志格式串，返回格式编号；由LOG_EVENT在每个调用点调用一次
+    static uint16_t register_format(int level, const char* fmt){
+        std::lock_guard<std::mutex> lock(formats_mtx_);
+        if(format_count_ >= MAX_FORMATS) return 0;
+        formats_[format_count_] = FormatInfo{level, fmt};
+        return static_cast<uint16_t>(format_count_++);
+    }
+
+    // 结构化日志：只把格式编号和参数的原始字节放入缓冲区，一般通过LOG_EVENT调用
+    template <typename ...Args>
+    void event(uint16_t fmt_id, const Args& ...args){
+        thread_local char record[RECORD_MAX];
+        std::memcpy(record, &fmt_id, 2);
+        char* p = record + 2;
+        (encode_arg(p, record + RECORD_MAX, args), ...);
+        size_t len = p - record;
+
+        if(mode_ == Mode::SYNC){
+            thread_local char text[RECORD_MAX];
+            size_t n = format_record(record, len, text, RECORD_MAX);
+            (void)!write(fd_, text, n);
+        }
+        else{
+            push_record(record, len, EVENT_FLAG);
+        }
+    }
+
+    // 按格式串和编码后的参数生成一行文本(含换行)，返回长度，cap至少为2；写线程和log_decoder共用
+    // 参数不足时多出的{}原样输出
+    static size_t format_event(int level, const char* fmt, const char* args, size_t args_len,
+                               char* out, size_t cap){
+        size_t n = 0;
+        const size_t limit = cap - 1;  // 留一个字节给换行
+        auto put = [&](const char* s, size_t k){
+            k = std::min(k, limit - n);
+            std::memcpy(out + n, s, k);
+            n += k;
+        };
+        const char* a = args;
+        const char* a_end = args + args_len;
+        // 解码下一个参数，数据不完整时返回false
+        auto put_arg = [&]() -> bool {
+            if(a >= a_end) return false;
+            char tmp[64];
+            int k = 0;
+            uint8_t type = static_cast<uint8_t>(*a++);
+            size_t remain = a_end - a;
+            if(type == ARG_I64 && remain >= 8){
+                int64_t x;
+                std::memcpy(&x, a, 8);
+                k = snprintf(tmp, sizeof(tmp), "%lld", static_cast<long long>(x));
+                a += 8;
+            }
+            else if(type == ARG_U64 && remain >= 8){
+                uint64_t x;
+                std::memcpy(&x, a, 8);
+                k = snprintf(tmp, sizeof(tmp), "%llu", static_cast<unsigned long long>(x));
+                a += 8;
+            }
+            else if(type == ARG_F64 && remain >= 8){
+                double x;
+                std::memcpy(&x, a, 8);
+                k = snprintf(tmp, sizeof(tmp), "%g", x);
+                a += 8;
+            }
+            else if(type == ARG_PEER && remain >= 6){
+                in_addr addr;
+                uint16_t port;
+                std::memcpy(&addr.s_addr, a, 4);
+                std::memcpy(&port, a + 4, 2);
+                char ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+                k = snprintf(tmp, sizeof(tmp), "%s:%u", ip, static_cast<unsigned>(port));
+                a += 6;
+            }
+            else if(type == ARG_STR && remain >= 2){
+                uint16_t len;
+                std::memcpy(&len, a, 2);
+                if(remain - 2 < len){
+                    a = a_end;
+                    return false;
+                }
+                put(a + 2, len);
+                a += 2 + len;
+                return true;
+            }
+            else{
+                a = a_end;  // 未知类型，后面的参数都无法解析
+                return false;
+            }
+            if(k > 0) put(tmp, std::min(static_cast<size_t>(k), sizeof(tmp) - 1));
+            return true;
+        };
+
+        const char* tag = level_tag(level);
+        put(tag, std::strlen(tag));
+        const char* run = fmt;
+        for(const char* f = fmt; *f; ++f){
+            if(f[0] != '{' || f[1] != '}') continue;
+            put(run, f - run);
+            if(!put_arg()) put("{}", 2);
+            ++f;
+            run = f + 1;
+        }
+        put(run, std::strlen(run));
+        out[n++] = '\n';
+        return n;
+    }
+
+    // 带日志级别输出
+    template <typename ...Args>
+    void debug(Args&& ...args){
+        if constexpr(LOG_LEVEL_DEBUG >= LOG_MIN_LEVEL){
+            log("[DEBUG] ", std::forward<Args>(args)...);
+        }
+    }
+
+    template <typename ...Args>
+    void info(Args&& ...args){
+        if constexpr(LOG_LEVEL_INFO >= LOG_MIN_LEVEL){
+            log("[INFO] ", std::forward<Args>(args)...);
+        }
+    }
+
+    template <typename ...Args>
+    void error(Args&& ...args){
+        if constexpr(LOG_LEVEL_ERROR >= LOG_MIN_LEVEL){
+            log("[ERROR] ", std::forward<Args>(args)...);
+        }
+    }
+};
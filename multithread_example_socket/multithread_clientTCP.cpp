@@ -18,6 +18,12 @@ const char* SERVER_IP = "127.0.0.1";
 const int PORT = 8080;
 const int BUFFER_SIZE = 1024;
 
+// 把一行输入包装成HTTP/1.1 POST请求，服务端默认按HTTP处理并保持连接
+std::string make_request(const std::string& body){
+    return "POST / HTTP/1.1\r\nHost: " + std::string(SERVER_IP) + "\r\n"
+           "Content-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
 int main(){
     // 1. 创建TCP嵌套字
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -53,8 +59,8 @@ int main(){
 
     char buffer[BUFFER_SIZE] = {0};
     std::string message;
-    message = "Hello, server!";
-    send(sock, message.c_str(), message.size(), 0);
+    std::string request = make_request("Hello, server!");
+    send(sock, request.c_str(), request.size(), 0);
     // 4. 数据交互
     while(!stop_client){
         std::cout << "> ";
@@ -67,7 +73,8 @@ int main(){
         }
         if(message.empty()) continue;// 检查消息是否为空
 
-        ssize_t send_len = send(sock, message.c_str(), message.size(), 0);
+        request = make_request(message);
+        ssize_t send_len = send(sock, request.c_str(), request.size(), 0);
         if(send_len > 0){
             std::cout << "Message send" << std::endl;
         }
@@ -86,7 +93,7 @@ int main(){
         
         // 清空缓冲区
         memset(buffer, 0, BUFFER_SIZE);
-        ssize_t valrecv = recv(sock, buffer, BUFFER_SIZE, 0);
+        ssize_t valrecv = recv(sock, buffer, BUFFER_SIZE - 1, 0);
         if(valrecv > 0){
             buffer[valrecv] = '\0';
             std::cout << "Received: " << buffer << std::endl;
@@ -14,181 +14,342 @@
 #include <unistd.h>            // POSIX系统服务：close()、read()、write()、fork()等
 #include <signal.h>            // 信号处理函数：signal()、sigaction()等
 #include <fcntl.h>             // 文件控制选项：fcntl()，用于设置非阻塞I/O
+#include <string>              // 字符串类，用于解析命令行参数
+#include <cctype>              // isdigit，判断位置参数是否为数字
+#include <cstdlib>             // strtoul
+#include <string_view>         // 日志中引用缓冲区里的数据
+#include <unordered_map>       // 哈希表，reactor线程记录自己拥有的连接
+#include <algorithm>           // std::max
+#include <chrono>              // 关闭时线程池排空的超时时间
+#include "../common/poller.hpp"        // epoll/poll封装
+#include "../common/cpu_affinity.hpp"  // 线程绑核
+#include "../common/conn_buffer.hpp"   // 按大小分级复用的连接缓冲区
+#include "../common/frame_codec.hpp"   // 长度前缀分帧
+#include "../common/out_queue.hpp"     // writev批量发送的发送队列
+#include "../common/timer_wheel.hpp"   // 连接超时定时器
+#include "../common/wakeup.hpp"        // 退出/中断通知和signalfd
+#include "../common/uring_loop.hpp"    // io_uring事件循环
+#include "../common/zero_copy.hpp"     // 大文件的sendfile/MSG_ZEROCOPY发送
+#ifdef __linux__
+#include "../common/hot_restart.hpp"   // 热重启时交出监听socket
+#endif
+#include "http.hpp"                    // HTTP/1.1请求解析和静态响应
+#include "logger.hpp"                  // 线程安全日志
+#include "thread_pool.hpp"             // 互斥锁+条件变量任务队列的线程池
+#include "work_stealing_pool.hpp"      // 工作窃取线程池
+
+// 用法: ./multithread_serverTCP [pool|event|reactor] [N] [ws] [binlog] [framed] [uring] [file=路径] [copy|sendfile|zerocopy]
+//   pool    : 默认模式，单线程accept，每个连接交给线程池中的一个线程处理，N为线程池大小(默认10)
+//             连接存活期间一直占用一个线程，最多只能同时服务N个客户端
+//   event   : 事件驱动模式，一个reactor线程持有所有socket，只把"可读"事件作为任务分发给线程池，
+//             N为线程池大小(默认4)，成千上万的连接共享这几个线程
+//   reactor : 多reactor模式，N个事件循环线程(默认CPU核数)，每个线程绑定一个CPU，
+//             拥有自己的SO_REUSEPORT监听socket和连接集合，accept和I/O随核数线性扩展
+//   ws      : pool/event模式下使用工作窃取线程池代替单队列线程池
+//   binlog  : 日志以二进制格式写入BINLOG_PATH，连接路径上的日志不在工作线程中格式化，
+//             用 ./log_decoder multithread_serverTCP.binlog 转换成文本
+//   framed  : 请求和回复使用varint长度前缀分帧(见common/frame_codec.hpp)，一次读到的多条请求
+//             逐条处理后，回复合并成一次writev；默认按HTTP/1.1处理请求
+//   uring   : reactor模式下每个事件循环使用io_uring代替epoll(见common/uring_loop.hpp)：多shot accept、
+//             提供缓冲区环上的多shot recv，一轮循环的所有提交和完成合并成一次io_uring_enter；
+//             Connection: close的最后一批响应后面链接shutdown；内核不支持时回退到epoll
+//   file=路径 : GET/HEAD /file 返回该文件的内容，用来服务大的静态响应；文件启动时映射，服务期间不能修改
+//   copy|sendfile|zerocopy : 文件内容的发送方式，默认sendfile(见common/zero_copy.hpp)：
+//             copy为和其他响应一样writev拷贝；zerocopy为send(MSG_ZEROCOPY)，完成通知从错误队列取走；
+//             io_uring事件循环中文件内容总是按映射的内存用sendmsg发送
+//
+// 连接超时：有回复没写完时为写超时，收到了不完整的请求时为读超时，否则为空闲超时，到期后关闭连接
+// event/reactor模式下每个事件循环用一个时间轮管理所有连接的定时器，等待事件的超时取最近的到期时间；
+// pool模式下每个线程只有一个连接，直接用截止时间作为select的超时，阻塞写使用SO_SNDTIMEO
+//
+// 所有等待都没有固定周期的超时：主线程屏蔽SIGINT/SIGTERM并阻塞在signalfd上，收到后调用shutdown，
+// 通过eventfd唤醒accept循环和各个事件循环；排空超时后另一个eventfd唤醒pool模式中阻塞在select上的处理线程
+//
+// 热重启(Linux): 向服务器进程发送SIGUSR2，它以同样的参数exec启动时的程序文件，并把所有监听socket
+// 交给新进程(见common/hot_restart.hpp)；新进程接管后旧进程停止accept：pool模式的accept循环直接结束，
+// 交给线程池的连接按关闭时的方式排空；event/reactor模式的事件循环继续处理已有连接，全部关闭后退出，
+// 最多等待DRAIN_TIMEOUT后关闭剩余连接。新进程启动失败时旧进程继续服务
 
 const int PORT = 8080;
-const int BUFFER_SIZE = 1024;
+const int LISTEN_BACKLOG = SOMAXCONN;  // 已完成连接队列的最大长度
+const std::chrono::milliseconds DRAIN_TIMEOUT(10000);  // 关闭时等待已接入连接处理完的最长时间
+const int HOT_RESTART_TIMEOUT_MS = 10 * 1000;  // 热重启时等待新进程就绪的最长时间
+const char* const BINLOG_PATH = "multithread_serverTCP.binlog";
+const size_t OUTPUT_HIGH_WATERMARK = 256 * 1024;  // 发送队列超过该值时暂停读取该连接
+const uint64_t IDLE_TIMEOUT_MS = 60 * 1000;   // 没有未完成的请求和回复时的空闲超时
+const uint64_t READ_TIMEOUT_MS = 10 * 1000;   // 请求只收到一部分时，等待剩余部分的超时
+const uint64_t WRITE_TIMEOUT_MS = 10 * 1000;  // 回复写不出去(对端不读)时的超时
 
-// 线程安全日志
-class Logger{
-private:
-    std::mutex mtx_;
-public:
-    // 带日志级别输出
-    template <typename ...Args>
-    void info(Args&& ...args){
-        std::lock_guard<std::mutex> lock(mtx_);
-        std::cout << "[INFO] ";
-        (std::cout << ... << std::forward<Args>(args)) << std::endl;
-    }
 
-    template <typename ...Args>
-    void error(Args&& ...args){
-        std::lock_guard<std::mutex> lock(mtx_);
-        std::cout << "[ERROR] ";
-        (std::cout << ... << std::forward<Args>(args)) << std::endl;
-    }
-};
 
+// 一个连接的状态，由事件循环的连接表持有，同一时刻只有一个线程处理它
+struct ClientConn{
+    sockaddr_in addr{};
+    ConnBuffer in;                        // 不完整的请求跨多次可读事件保留
+    OutQueue out;                         // 还没写出的回复
+    HttpParser parser;                    // 记住不完整请求已扫描的位置
+    bool closing = false;                 // 写完已排队的回复后关闭(Connection: close、请求错误或对端已关闭写方向)
+    uint32_t interest = Poller::READABLE; // 当前在Poller中注册的事件
+    TimerWheel::TimerId timer = TimerWheel::INVALID_TIMER;  // 读/写/空闲超时
+    bool busy = false;                    // event模式：已分发给工作线程，超时不能关闭它
+};
 
 
-// 线程池
-class ThreadPool{
+// 连接处理器类
+// 默认按HTTP/1.1处理请求：支持keep-alive和流水线，一次读到的多个请求依次解析，响应合并后一次writev写出
+// GET/HEAD / 返回200，其他路径返回404，响应都是启动时预先序列化好的
+// 指定了静态文件时GET/HEAD /file 返回文件内容，头部预先序列化，正文按_send_mode从文件发送
+class ConnectionHandler{
 private:
-    void worker();
-    std::vector<std::thread> threadpool;
-    std::queue<std::function<void()>> task_queue;
-    std::condition_variable task_available;
-    std::mutex queue_mtx;
-    std::atomic<bool> stop_flag{false};
     Logger& _logger;
+    const bool _framed;               // 请求和回复使用长度前缀分帧
+    const StaticFile* const _file;    // /file 的内容，nullptr表示没有静态文件
+    const SendMode _send_mode;
+    std::atomic<bool> _abort{false};  // 排空超时后通知所有阻塞模式的处理循环退出
+    WakeupChannel _abort_wakeup;      // 与_abort同时通知，唤醒阻塞在select上的处理线程，不drain
+    static constexpr const char* FRAMED_RESPONSE = "Hello from thread pool";
 
-public:
-    ThreadPool(size_t thread_num, Logger& logger): _logger(logger){
-        for(size_t i = 0; i < thread_num; ++i){
-            threadpool.emplace_back(&ThreadPool::worker, this);
-        }
-        _logger.info("线程池创建完成");
-    }
+    // 预先序列化的HTTP响应，[0]为keep-alive版本，[1]为Connection: close版本
+    const StaticResponse _ok[2] = {{"200 OK", "Hello from thread pool\n", true},
+                                   {"200 OK", "Hello from thread pool\n", false}};
+    const StaticResponse _not_found[2] = {{"404 Not Found", "Not Found\n", true},
+                                          {"404 Not Found", "Not Found\n", false}};
+    const StaticResponse _bad_request{"400 Bad Request", "Bad Request\n", false};
+    const StaticResponse _too_large{"413 Content Too Large", "Content Too Large\n", false};
+    const StaticResponse _header_too_large{"431 Request Header Fields Too Large",
+                                           "Request Header Fields Too Large\n", false};
+    const StaticResponse _not_implemented{"501 Not Implemented", "Not Implemented\n", false};
+    const StaticResponse _file_head[2];  // /file 的响应头部，[0]为keep-alive版本，[1]为Connection: close版本
+    static constexpr const char* FILE_TARGET = "/file";
 
-    ~ThreadPool(){
-        stop();
+    static void queue(ClientConn& conn, std::string_view response){
+        conn.out.push_ref(response.data(), response.size());
     }
 
-    template <class F, class ...Args>
-    void add_task(F&& f, Args ...args){
-        std::unique_lock<std::mutex> lock(queue_mtx);
-        task_queue.emplace(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-        lock.unlock();
+    // 依次解析conn.in中所有完整的HTTP请求，响应排入conn.out，不完整的请求留在conn.in中
+    // 请求出错或者不保持连接时排入最后一个响应并标记closing，之后收到的数据直接丢弃
+    void process_http(ClientConn& conn){
+        while(!conn.closing){
+            HttpRequest req;
+            size_t consumed = 0;
+            HttpParser::Status status = conn.parser.parse(conn.in.data(), conn.in.size(), req, consumed);
+            if(status == HttpParser::NEED_MORE) break;
 
-        task_available.notify_one();
-        _logger.info("任务添加成功!");
-    }
+            if(status != HttpParser::COMPLETE){
+                const StaticResponse& error = status == HttpParser::BODY_TOO_LARGE ? _too_large
+                                            : status == HttpParser::HEADER_TOO_LARGE ? _header_too_large
+                                            : status == HttpParser::NOT_IMPLEMENTED ? _not_implemented
+                                            : _bad_request;
+                LOG_EVENT(_logger, LOG_LEVEL_ERROR, "客户端 {} 请求错误: {}", LogPeer(conn.addr), error.head().substr(9, 3));
+                queue(conn, error.full());
+                conn.closing = true;
+                break;
+            }
 
-    void stop(){
-        stop_flag.store(true);
-        task_available.notify_all();
-        std::queue<std::function<void()>> empty;
-        queue_mtx.lock();
-        std::swap(task_queue, empty);
-        queue_mtx.unlock();
-        for(auto &t : threadpool){
-            if(t.joinable()){
-                t.join();
+            LOG_EVENT(_logger, LOG_LEVEL_INFO, "From client {} Request: {} {} ({} bytes body)",
+                      LogPeer(conn.addr), req.method, req.target, req.body.size());
+            if(_file && req.target == FILE_TARGET){
+                queue(conn, _file_head[req.keep_alive ? 0 : 1].head());
+                if(req.method != "HEAD") conn.out.push_file(*_file, _send_mode);
+            }
+            else{
+                bool found = req.target == "/" || req.target == "/index.html";
+                const StaticResponse& response = (found ? _ok : _not_found)[req.keep_alive ? 0 : 1];
+                queue(conn, req.method == "HEAD" ? response.head() : response.full());
             }
+            if(!req.keep_alive) conn.closing = true;
+            conn.in.consume(consumed);
         }
-         _logger.info("线程池销毁完成");
+        if(conn.closing) conn.in.consume(conn.in.size());
+        conn.in.shrink();
     }
 
-};
-
-void ThreadPool::worker(){
-    std::function<void()> task;
-    while(true){
-        std::unique_lock<std::mutex> lock(queue_mtx);
-        task_available.wait(lock, [this](){return !task_queue.empty() || stop_flag.load();});
-
-        if(stop_flag.load()) return;
-        task = std::move(task_queue.front());
-        task_queue.pop();
-        lock.unlock();
-
-        task();
+    // 分帧模式：一次取出所有完整的帧，每帧一条回复，返回false表示应当立即关闭连接
+    bool process_framed(ClientConn& conn){
+        FrameDecoder decoder;
+        std::string_view request;
+        FrameDecoder::Status status;
+        size_t response_len = strlen(FRAMED_RESPONSE);
+        char header[FrameDecoder::MAX_VARINT];
+        size_t header_len = encode_varint(static_cast<uint32_t>(response_len), header);
+        while((status = decoder.next(conn.in, request)) == FrameDecoder::FRAME){
+            LOG_EVENT(_logger, LOG_LEVEL_INFO, "From client {} Received: {}", LogPeer(conn.addr), request);
+            if(!conn.out.push_copy(header, header_len)){
+                LOG_EVENT(_logger, LOG_LEVEL_ERROR, "客户端 {} 未发送的回复过多", LogPeer(conn.addr));
+                return false;
+            }
+            conn.out.push_ref(FRAMED_RESPONSE, response_len);
+        }
+        if(status == FrameDecoder::BAD_FRAME){
+            LOG_EVENT(_logger, LOG_LEVEL_ERROR, "客户端 {} 发送了非法的帧长度", LogPeer(conn.addr));
+            return false;
+        }
+        conn.in.shrink();
+        return true;
     }
-}
 
-
-
-// 连接处理器类
-class ConnectionHandler{
-private:
-    Logger& _logger;
+    // 处理conn.in中已收到的数据，回复排入conn.out，返回false表示应当立即关闭连接
+    bool process_input(ClientConn& conn){
+        if(_framed) return process_framed(conn);
+        process_http(conn);
+        return true;
+    }
 
 public:
-    ConnectionHandler(Logger& logger) : _logger(logger){}
+    ConnectionHandler(Logger& logger, bool framed = false, const StaticFile* file = nullptr,
+                      SendMode send_mode = SendMode::SENDFILE)
+        : _logger(logger), _framed(framed), _file(file), _send_mode(send_mode),
+          _file_head{StaticResponse("200 OK", "application/octet-stream", file ? file->size() : 0, true),
+                     StaticResponse("200 OK", "application/octet-stream", file ? file->size() : 0, false)}{}
 
     ~ConnectionHandler(){}
 
+    void abort(){
+        _abort.store(true);
+        _abort_wakeup.notify();
+    }
+
+    // 按连接当前的状态选择下一次超时
+    static uint64_t timeout_of(const ClientConn& conn){
+        if(!conn.out.empty()) return WRITE_TIMEOUT_MS;
+        if(!conn.in.empty()) return READ_TIMEOUT_MS;
+        return IDLE_TIMEOUT_MS;
+    }
+
+    // 阻塞模式：一个线程处理一个连接直到对端关闭或不再保持连接
     void handle(int client_fd, sockaddr_in client_addr){
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        _logger.info("线程PID: ", getpid(), 
-                    " 连接客户端: ", client_ip, ":", ntohs(client_addr.sin_port));
+        LOG_EVENT(_logger, LOG_LEVEL_INFO, "线程PID: {} 连接客户端: {}", getpid(), LogPeer(client_addr));
 
         // 数据交互
-        char buffer[BUFFER_SIZE];
+        ClientConn conn;
+        conn.addr = client_addr;
+        // 阻塞写最多等待WRITE_TIMEOUT_MS，超时后writev返回EAGAIN，回复没写完时关闭连接
+        struct timeval send_timeout = {static_cast<time_t>(WRITE_TIMEOUT_MS / 1000), 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        uint64_t deadline = TimerWheel::clock_ms() + IDLE_TIMEOUT_MS;
+        int abort_fd = _abort_wakeup.fd();
         fd_set readfds;
-        while(true){
+        while(!_abort.load() && !conn.closing){
             FD_ZERO(&readfds);
             FD_SET(client_fd, &readfds);
+            FD_SET(abort_fd, &readfds);
 
-            struct timeval tv = {1, 0};
-            int activity = select(client_fd + 1, &readfds, NULL, NULL, &tv);
+            // 一直等到截止时间，中断通知会提前唤醒
+            uint64_t now = TimerWheel::clock_ms();
+            if(now >= deadline){
+                LOG_EVENT(_logger, LOG_LEVEL_INFO, "客户端 {} 超时", LogPeer(client_addr));
+                break;
+            }
+            uint64_t wait_ms = deadline - now;
+            struct timeval tv = {static_cast<time_t>(wait_ms / 1000), static_cast<suseconds_t>(wait_ms % 1000 * 1000)};
+            int activity = select(std::max(client_fd, abort_fd) + 1, &readfds, NULL, NULL, &tv);
             if(activity < 0){
+                if(errno == EINTR) continue;
                 std::cerr << "[ERROR] ";
                 perror("Select Failed");
+                break;
             }
             else if(activity == 0){
                 continue;
             }
+            if(FD_ISSET(abort_fd, &readfds)) break;
 
             if(!FD_ISSET(client_fd, &readfds)){
                 _logger.error("FD_ISSET Failed!");
                 continue;
             }
 
-            // 接收数据
-            ssize_t bytes_read = recv(client_fd, buffer, BUFFER_SIZE, 0);
+            // MSG_ZEROCOPY的完成通知放在错误队列中，同样让select报告可读，先取走通知
+            if(conn.out.zc_pending() > 0 && !conn.out.completions_only(client_fd)){
+                std::cerr << "[ERROR] ";
+                perror("Socket Error");
+                break;
+            }
+
+            // 接收数据：可读可能只是因为完成通知，recv不阻塞，没有数据时回到select，
+            // 否则会阻塞在recv上，错过截止时间和中断通知
+            ssize_t bytes_read = conn.in.read_from(client_fd, MSG_DONTWAIT);
             if(bytes_read > 0){
-                buffer[bytes_read] = '\0';
-                std::cout << "\nFrom client " << client_ip << ":" << ntohs(client_addr.sin_port) 
-                            << "\nReceived:" << buffer << std::endl;
+                if(!process_input(conn)) break;
             }
             else if(bytes_read < 0){
-                if(errno == EINTR) {}
+                if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
                 std::cerr << "[ERROR] ";
                 perror("Receive Failed");
+                continue;
             }
             else if(bytes_read == 0){
-                std::cerr << "[ERROR] ";
-                perror("客户端连接已关闭");
+                LOG_EVENT(_logger, LOG_LEVEL_INFO, "客户端 {} 连接已关闭", LogPeer(client_addr));
                 break;
             }
 
-            // 发送响应
-            std::string response = "\nHTTP/1.1 200 OK\r\n"
-                                "Content-Type: text/plain\r\n"
-                                "Content-Length: 21\r\n"
-                                "\r\n"
-                                "Hello from thread pool\n";
-            ssize_t send_len = send(client_fd, response.c_str(), response.size(), 0);
-            if(send_len > 0){
-                _logger.info("Send response");
-            }
-            else if(send_len == 0){
-                std::cerr << "[ERROR] ";
-                perror("客户端连接已关闭");
-                break;
+            // 发送这一批请求的所有回复，阻塞socket上writev会一直写到全部发出或者写超时
+            size_t total = conn.out.bytes();
+            if(total > 0){
+                if(!conn.out.flush(client_fd)){
+                    std::cerr << "[ERROR] ";
+                    perror("Send Failed");
+                    break;
+                }
+                if(!conn.out.empty()){
+                    LOG_EVENT(_logger, LOG_LEVEL_INFO, "客户端 {} 写超时", LogPeer(client_addr));
+                    break;
+                }
+                LOG_EVENT(_logger, LOG_LEVEL_INFO, "Send response: {} bytes", total);
             }
-            else if(send_len < 0){
-                if(errno == EINTR) {}
+            deadline = TimerWheel::clock_ms() + timeout_of(conn);
+        }
+
+        close(client_fd);
+        LOG_EVENT(_logger, LOG_LEVEL_INFO, "线程PID: {} 关闭客户端连接: {}", getpid(), LogPeer(client_addr));
+    }
+
+    // 完成模式(io_uring)：新收到的数据已经追加到conn.in，处理其中所有完整的请求，响应排入conn.out
+    // 返回false表示应当立即关闭连接；conn.closing表示写完已排队的响应后关闭
+    bool on_data(ClientConn& conn){
+        return process_input(conn);
+    }
+
+    // 非阻塞模式：由事件循环在client_fd就绪时调用，events为Poller事件
+    // 可读时读完当前所有数据，所有回复合并后一次writev写出；写不完的留在发送队列中等待可写
+    // 返回之后需要监听的事件，返回0表示连接已关闭或出错，调用方负责关闭client_fd
+    uint32_t on_ready(int client_fd, ClientConn& conn, uint32_t events){
+        // MSG_ZEROCOPY的完成通知放在错误队列中，同样报告为ERROR，取走通知后连接照常处理
+        if((events & Poller::ERROR) && !conn.out.completions_only(client_fd)) return 0;
+        if((events & Poller::HANGUP) && !(events & (Poller::READABLE | Poller::WRITABLE))) return 0;
+
+        if((events & Poller::READABLE) && !conn.closing){
+            // 发送队列积压过多时停止读取，让对端先把回复读走(背压)
+            while(conn.out.bytes() < OUTPUT_HIGH_WATERMARK && !conn.closing){
+                ssize_t bytes_read = conn.in.read_from(client_fd);
+                if(bytes_read > 0){
+                    if(!process_input(conn)) return 0;
+                    continue;
+                }
+                else if(bytes_read == 0){
+                    conn.closing = true;  // 对端不再发送请求，写完已排队的回复后关闭
+                    break;
+                }
+                if(errno == EINTR) continue;
+                if(errno == EAGAIN || errno == EWOULDBLOCK) break;  // 数据已读完
                 std::cerr << "[ERROR] ";
-                perror("Send Failed");
+                perror("Receive Failed");
+                return 0;
             }
         }
 
-        close(client_fd);
-        _logger.info("线程PID: ", getpid(),
-            " 关闭客户端连接: ", client_ip, ":", ntohs(client_addr.sin_port));
+        if(!conn.out.empty() && !conn.out.flush(client_fd)){
+            std::cerr << "[ERROR] ";
+            perror("Send Failed");
+            return 0;
+        }
+        if(conn.closing && conn.out.empty()) return 0;
+
+        uint32_t interest = 0;
+        if(!conn.closing && conn.out.bytes() < OUTPUT_HIGH_WATERMARK) interest |= Poller::READABLE;
+        if(!conn.out.empty()) interest |= Poller::WRITABLE;
+        return interest;
     }
 };
 
@@ -196,16 +357,19 @@ public:
 // 主服务器类
 class ThreadServer{
 private:
-    int server_fd;
+    int server_fd;                 // 第一个监听socket，pool/event模式只用它
+    std::vector<int> _listen_fds;  // 所有监听socket，reactor模式每个事件循环一个，热重启时全部交出
     Logger _logger;
     std::unique_ptr<ThreadPool> _thread_pool;
+    std::unique_ptr<WorkStealingPool> _ws_pool;  // 使用工作窃取线程池时代替_thread_pool
     ConnectionHandler _handler;
+    bool _work_stealing;
+    bool _uring;  // reactor模式使用io_uring事件循环
 
-public:
-    static std::atomic<bool> _running;
-    ThreadServer() : _handler(_logger){
+    // 创建监听socket，reuse_port为true时允许多个socket绑定同一端口(由内核做负载均衡)
+    static int create_listen_socket(bool reuse_port){
         // 1. 创建socket
-        server_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int server_fd = socket(AF_INET, SOCK_STREAM, 0);
         if(server_fd == -1){
             perror("Create Socket Failed");
             throw std::runtime_error("Failed to create socket");
@@ -218,6 +382,11 @@ public:
             perror("Setsockopt Failed");
             throw std::runtime_error("Failed to Setsockopt");
         }
+        if(reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0){
+            close(server_fd);
+            perror("Setsockopt SO_REUSEPORT Failed");
+            throw std::runtime_error("Failed to Setsockopt SO_REUSEPORT");
+        }
 
         // 3. 绑定地址
         sockaddr_in address;
@@ -231,31 +400,258 @@ public:
         }
 
         // 4. 监听
-        if (listen(server_fd, 10) < 0){
+        if (listen(server_fd, LISTEN_BACKLOG) < 0){
             close(server_fd);
             perror("Listening Failed");
             throw std::runtime_error("Failed to listen");
         }
+        return server_fd;
+    }
 
+#ifdef HAVE_IO_URING
+    // io_uring reactor中连接事件的处理，语义与on_ready一致：
+    // 对端关闭写方向时处理完已收到的请求、写完响应再关闭；Connection: close或请求出错时不再读取，写完响应后关闭
+    struct UringReactorHandler{
+        ThreadServer& server;
+        size_t index;
+
+        void on_open(int, ClientConn& conn){
+            LOG_EVENT(server._logger, LOG_LEVEL_INFO, "Reactor {} 连接客户端: {}", index, LogPeer(conn.addr));
+        }
+        bool on_input(int, ClientConn& conn){ return server._handler.on_data(conn); }
+        bool on_eof(int, ClientConn&){ return true; }
+        bool close_after_send(const ClientConn& conn) const { return conn.closing; }
+        void on_close(int, ClientConn& conn, CloseReason why){
+            if(why == CLOSE_TIMEOUT){
+                LOG_EVENT(server._logger, LOG_LEVEL_INFO, "Reactor {} 客户端 {} 超时", index, LogPeer(conn.addr));
+            }
+            LOG_EVENT(server._logger, LOG_LEVEL_INFO, "Reactor {} 关闭客户端连接: {}", index, LogPeer(conn.addr));
+        }
+        uint64_t timeout(const ClientConn& conn, bool writing) const {
+            return writing ? WRITE_TIMEOUT_MS : ConnectionHandler::timeout_of(conn);
+        }
+    };
+
+    // io_uring版本的reactor事件循环，返回false表示io_uring初始化失败，调用方回退到epoll
+    bool run_uring_reactor(int listen_fd, size_t index){
+        UringReactorHandler handler{*this, index};
+        UringLoop<ClientConn, UringReactorHandler> loop(handler, OUTPUT_HIGH_WATERMARK);
+        if(!loop.init(listen_fd, _stop_wakeup.fd(), _drain_wakeup.fd())){
+            std::cerr << "[ERROR] ";
+            perror("Io_uring Init Failed");
+            return false;
+        }
+        _logger.info("Reactor ", index, " 启动(io_uring)");
+        loop.run(_running);
+        _logger.info("Reactor ", index, " 退出，io_uring_enter ", loop.enters(), " 次，完成 ", loop.completions(), " 个操作");
+        return true;
+    }
+#endif
+
+    // 单个reactor的事件循环：accept和所有已接入连接的I/O都在本线程内完成
+    void run_reactor(int listen_fd, size_t index){
+        if(!pin_current_thread(index)){
+            _logger.error("Reactor ", index, " 绑定CPU失败");
+        }
+#ifdef HAVE_IO_URING
+        if(_uring){
+            if(run_uring_reactor(listen_fd, index)) return;
+            _logger.error("Reactor ", index, " io_uring不可用，回退到epoll");
+        }
+#endif
+
+        Poller poller;
+        int flags = fcntl(listen_fd, F_GETFL, 0);
+        fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK);
+        if(!poller.valid() || !poller.add(listen_fd, Poller::READABLE) ||
+           !poller.add(_stop_wakeup.fd(), Poller::READABLE) || !poller.add(_drain_wakeup.fd(), Poller::READABLE)){
+            std::cerr << "[ERROR] ";
+            perror("Poller Init Failed");
+            return;
+        }
+        _logger.info("Reactor ", index, " 启动");
+
+        std::unordered_map<int, ClientConn> clients;  // 本线程拥有的连接
+        TimerWheel timers;                            // 本线程所有连接的超时
+        auto close_client = [&](int fd){
+            auto it = clients.find(fd);
+            LOG_EVENT(_logger, LOG_LEVEL_INFO, "Reactor {} 关闭客户端连接: {}", index, LogPeer(it->second.addr));
+            timers.cancel(it->second.timer);
+            poller.remove(fd);
+            close(fd);
+            clients.erase(it);
+        };
+        auto on_timeout = [&](TimerWheel::TimerId, uint64_t fd){
+            auto it = clients.find(static_cast<int>(fd));
+            if(it == clients.end()) return;
+            LOG_EVENT(_logger, LOG_LEVEL_INFO, "Reactor {} 客户端 {} 超时", index, LogPeer(it->second.addr));
+            close_client(static_cast<int>(fd));
+        };
+
+        std::vector<PollEvent> events;
+        bool draining = false;  // 监听socket已交给新进程，只处理已有的连接
+        while(_running.load() && !(draining && clients.empty())){
+            int n = poller.wait(events, timers.next_timeout());  // 没有定时器时无限等待
+            if(n < 0){
+                std::cerr << "[ERROR] ";
+                perror("Poller Wait Failed");
+                continue;
+            }
+
+            for(const PollEvent& ev : events){
+                if(ev.fd == _stop_wakeup.fd()) continue;  // 退出通知，回到循环条件检查_running
+                if(ev.fd == _drain_wakeup.fd()){
+                    // 热重启：通知fd保持可读，每个事件循环都会收到，各自从Poller中删除它和监听socket
+                    // 监听socket由新进程继续使用，关闭本进程的fd不会把它从epoll中移除，必须显式删除
+                    poller.remove(_drain_wakeup.fd());
+                    poller.remove(listen_fd);
+                    draining = true;
+                    _logger.info("Reactor ", index, " 停止接受新连接，剩余连接: ", clients.size());
+                    continue;
+                }
+                if(ev.fd == listen_fd){
+                    if(draining) continue;  // 同一批事件中停止accept之前取出的
+                    // 接受所有排队的新连接
+                    while(true){
+                        sockaddr_in client_addr;
+                        socklen_t client_len = sizeof(client_addr);
+                        int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
+                        if(client_fd < 0){
+                            if(errno == EINTR || errno == ECONNABORTED) continue;
+                            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                                std::cerr << "[ERROR] ";
+                                perror("Accept Failed");
+                            }
+                            break;
+                        }
+                        int client_flags = fcntl(client_fd, F_GETFL, 0);
+                        fcntl(client_fd, F_SETFL, client_flags | O_NONBLOCK);
+                        if(!poller.add(client_fd, Poller::READABLE)){
+                            close(client_fd);
+                            continue;
+                        }
+                        ClientConn& conn = clients[client_fd];
+                        conn.addr = client_addr;
+                        conn.timer = timers.add(IDLE_TIMEOUT_MS, client_fd);
+                        LOG_EVENT(_logger, LOG_LEVEL_INFO, "Reactor {} 连接客户端: {}", index, LogPeer(client_addr));
+                    }
+                    continue;
+                }
+
+                auto it = clients.find(ev.fd);
+                if(it == clients.end()) continue;
+                ClientConn& conn = it->second;
+                uint32_t interest = _handler.on_ready(ev.fd, conn, ev.events);
+                if(interest == 0){
+                    close_client(ev.fd);
+                    continue;
+                }
+                if(interest != conn.interest){
+                    poller.modify(ev.fd, interest);  // 只在需要监听的事件变化时调用epoll_ctl
+                    conn.interest = interest;
+                }
+                timers.reset(conn.timer, ConnectionHandler::timeout_of(conn));
+            }
+
+            timers.advance(on_timeout);
+        }
+
+        for(auto &client : clients){
+            close(client.first);
+        }
+        _logger.info("Reactor ", index, " 退出，关闭 ", clients.size(), " 个连接");
+    }
+
+    // 两种线程池接口相同，按构造参数选择其一
+    void create_pool(size_t threadpool_size){
+        if(_work_stealing) _ws_pool = std::make_unique<WorkStealingPool>(threadpool_size, _logger);
+        else _thread_pool = std::make_unique<ThreadPool>(threadpool_size, _logger);
+    }
+
+    void destroy_pool(){
+        _ws_pool.reset();
+        _thread_pool.reset();
+    }
+
+    template <class F>
+    void dispatch(F&& task){
+        if(_ws_pool) _ws_pool->add_task(std::forward<F>(task));
+        else _thread_pool->add_task(std::forward<F>(task));
+    }
+
+    // 任务在执行前被丢弃(线程池停止或排空超时)时调用on_drop，用于关闭还没处理的连接
+    template <class F, class D>
+    void dispatch_with_drop(F&& task, D&& on_drop){
+        Task guarded = make_task_with_drop(std::forward<F>(task), std::forward<D>(on_drop));
+        if(_ws_pool) _ws_pool->add_task(std::move(guarded));
+        else _thread_pool->add_task(std::move(guarded));
+    }
+
+    // 优雅关闭线程池：等待队列中和正在处理的连接结束，超时后丢弃剩余任务并中断处理循环
+    void drain_pool(){
+        if(_thread_pool || _ws_pool){
+            auto on_timeout = [this](){ _handler.abort(); };
+            DrainReport report = _thread_pool ? _thread_pool->drain(DRAIN_TIMEOUT, on_timeout)
+                                              : _ws_pool->drain(DRAIN_TIMEOUT, on_timeout);
+            if(report.timed_out){
+                _logger.error("线程池排空超时，丢弃 ", report.dropped, " 个排队任务，中断 ",
+                              report.interrupted, " 个正在处理的连接");
+            }
+        }
+        destroy_pool();
+    }
+
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _draining{false};
+    WakeupChannel _stop_wakeup;   // shutdown时notify且不drain，唤醒accept循环和所有事件循环
+    WakeupChannel _drain_wakeup;  // 热重启时notify且不drain，所有循环停止accept
+
+public:
+    // binlog_path不为空时日志以二进制格式写入该文件，用log_decoder查看
+    // framed为true时请求和回复使用长度前缀分帧，客户端可以连续发送多条请求
+    // uring为true时reactor模式的事件循环使用io_uring
+    // file不为空时GET /file 返回它的内容，按send_mode发送，file的生命周期要长于服务器
+    // listen_fds不为空时(热重启)使用旧进程交出的监听socket，不再创建，服务器负责关闭它们
+    explicit ThreadServer(bool reuse_port = false, bool work_stealing = false, const char* binlog_path = nullptr,
+                          bool framed = false, bool uring = false, const StaticFile* file = nullptr,
+                          SendMode send_mode = SendMode::SENDFILE, std::vector<int> listen_fds = {})
+        : _listen_fds(std::move(listen_fds)),
+          _logger(binlog_path ? Logger::Mode::BINARY : Logger::Mode::ASYNC, binlog_path),
+          _handler(_logger, framed, file, send_mode), _work_stealing(work_stealing), _uring(uring){
+        if(_listen_fds.empty()) _listen_fds.push_back(create_listen_socket(reuse_port));
+        server_fd = _listen_fds[0];
         _logger.info("Server initialized on port ", PORT);
     }
 
+    // reactor模式：补足count个SO_REUSEPORT监听socket(已有的包括热重启接管的)，
+    // 在启动服务器线程之前调用，之后主线程可以安全地读取listen_fds
+    void open_listen_sockets(size_t count){
+        while(_listen_fds.size() < count){
+            _listen_fds.push_back(create_listen_socket(true));
+        }
+    }
+
+    const std::vector<int>& listen_fds() const { return _listen_fds; }
+
     void start(size_t threadpool_size = 4){
         if(_running) return;
 
         _running.store(true);
 
         // 创建线程池
-        _thread_pool = std::make_unique<ThreadPool>(threadpool_size, _logger);
+        create_pool(threadpool_size);
         _logger.info("Starting server with ", threadpool_size, " handler threads");
 
         fd_set readfds;
-        // 主接收循环
+        int stop_fd = _stop_wakeup.fd();
+        int drain_fd = _drain_wakeup.fd();
+        // 主接收循环，没有新连接时一直阻塞，shutdown通过stop_fd唤醒，热重启通过drain_fd唤醒
         while(_running.load()){
             FD_ZERO(&readfds);
             FD_SET(server_fd, &readfds);
-            struct timeval tv = {1, 0}; // 1秒超时
-            int activity = select(server_fd + 1, &readfds, NULL, NULL, &tv);
+            FD_SET(stop_fd, &readfds);
+            FD_SET(drain_fd, &readfds);
+            int activity = select(std::max({server_fd, stop_fd, drain_fd}) + 1, &readfds, NULL, NULL, NULL);
             if(activity < 0){
                 if(errno == EINTR) continue;
                 if(!_running) break;
@@ -263,8 +659,11 @@ public:
                 perror("Select Failed");
                 continue;
             }
-            else if(activity == 0){
-                continue;
+
+            // 热重启：停止accept，已交给线程池的连接在关闭服务器时排空
+            if(FD_ISSET(drain_fd, &readfds)){
+                _logger.info("停止接受新连接");
+                break;
             }
 
             // 接受新连接
@@ -282,24 +681,221 @@ public:
 
             // 将连接交给线程池处理
             // 永远记住：非静态成员函数必须与对象实例一起使用。你不能单独传递它。使用lambda或std::bind来绑定对象实例是最常见的解决方案。
-            _thread_pool->add_task([this, client_fd, client_addr](){
+            // 任务被丢弃时关闭连接，避免fd泄漏
+            dispatch_with_drop([this, client_fd, client_addr](){
                 _handler.handle(client_fd, client_addr);
+            }, [client_fd](){
+                close(client_fd);
             });
         }
         _logger.info("服务器接收连接关闭");
     }
 
-    void stop(){
+    // 事件驱动模式：本线程作为reactor持有监听socket和所有连接，socket以EPOLLONESHOT注册，
+    // 可读时把一次"读-处理-回复"作为任务交给线程池，任务结束后再重新注册，保证同一连接同一时刻只有一个线程在处理
+    void start_event_driven(size_t threadpool_size = 4){
+        if(_running) return;
+
+        Poller poller;
+        int flags = fcntl(server_fd, F_GETFL, 0);
+        fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
+        WakeupChannel timer_wakeup;  // 工作线程把定时器改得比reactor计划醒来的时间更早时唤醒它
+        if(!poller.valid() || !poller.add(server_fd, Poller::READABLE) || !poller.add(_stop_wakeup.fd(), Poller::READABLE) ||
+           !poller.add(timer_wakeup.fd(), Poller::READABLE) || !poller.add(_drain_wakeup.fd(), Poller::READABLE)){
+            perror("Poller Init Failed");
+            return;
+        }
+
+        _running.store(true);
+        create_pool(threadpool_size);
+        _logger.info("Starting event-driven server with ", threadpool_size, " handler threads");
+
+        // 连接表和时间轮由reactor插入、由工作线程修改和删除，需要加锁
+        // 工作线程先删除表项再close，保证fd号被内核复用之前旧表项已经不存在
+        // unordered_map插入其他连接不会移动已有的表项，工作线程可以在锁外使用自己连接的ClientConn
+        // 分发给工作线程的连接标记为busy，超时时跳过，由工作线程处理完后重新设置定时器
+        std::mutex conn_mtx;
+        std::unordered_map<int, ClientConn> clients;
+        TimerWheel timers;
+        uint64_t wake_at_ms = UINT64_MAX;  // reactor本次等待最晚醒来的时间，由conn_mtx保护
+        auto on_timeout = [&](TimerWheel::TimerId, uint64_t fd){
+            auto it = clients.find(static_cast<int>(fd));
+            if(it == clients.end() || it->second.busy) return;
+            LOG_EVENT(_logger, LOG_LEVEL_INFO, "客户端 {} 超时", LogPeer(it->second.addr));
+            poller.remove(it->first);
+            close(it->first);
+            clients.erase(it);
+        };
+
+        std::vector<PollEvent> events;
+        bool draining = false;  // 监听socket已交给新进程，连接全部关闭后退出
+        while(_running.load()){
+            int timeout;
+            {
+                std::lock_guard<std::mutex> lock(conn_mtx);
+                uint64_t now = TimerWheel::clock_ms();
+                timeout = timers.next_timeout(now);  // 没有定时器时无限等待
+                wake_at_ms = timeout < 0 ? UINT64_MAX : now + timeout;
+            }
+            int n = poller.wait(events, timeout);
+            if(n < 0){
+                std::cerr << "[ERROR] ";
+                perror("Poller Wait Failed");
+                continue;
+            }
+
+            for(const PollEvent& ev : events){
+                if(ev.fd == _stop_wakeup.fd()) continue;  // 退出通知，回到循环条件检查_running
+                if(ev.fd == timer_wakeup.fd()){
+                    timer_wakeup.drain();  // 只需要醒来重新计算超时(或者排空中最后一个连接已关闭)
+                    continue;
+                }
+                if(ev.fd == _drain_wakeup.fd()){
+                    // 热重启：停止accept，工作线程关闭最后一个连接时通过timer_wakeup唤醒这里退出
+                    poller.remove(_drain_wakeup.fd());
+                    poller.remove(server_fd);
+                    draining = true;
+                    _logger.info("停止接受新连接");
+                    continue;
+                }
+                if(ev.fd == server_fd){
+                    if(draining) continue;  // 同一批事件中停止accept之前取出的
+                    // 接受所有排队的新连接
+                    while(true){
+                        sockaddr_in client_addr;
+                        socklen_t client_len = sizeof(client_addr);
+                        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+                        if(client_fd < 0){
+                            if(errno == EINTR || errno == ECONNABORTED) continue;
+                            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                                std::cerr << "[ERROR] ";
+                                perror("Accept Failed");
+                            }
+                            break;
+                        }
+                        int client_flags = fcntl(client_fd, F_GETFL, 0);
+                        fcntl(client_fd, F_SETFL, client_flags | O_NONBLOCK);
+                        {
+                            std::lock_guard<std::mutex> lock(conn_mtx);
+                            ClientConn& conn = clients[client_fd];
+                            conn.addr = client_addr;
+                            conn.timer = timers.add(IDLE_TIMEOUT_MS, client_fd);
+                        }
+                        if(!poller.add(client_fd, Poller::READABLE, true)){
+                            std::lock_guard<std::mutex> lock(conn_mtx);
+                            timers.cancel(clients[client_fd].timer);
+                            clients.erase(client_fd);
+                            close(client_fd);
+                            continue;
+                        }
+                        LOG_EVENT(_logger, LOG_LEVEL_INFO, "连接客户端: {}", LogPeer(client_addr));
+                    }
+                    continue;
+                }
+
+                ClientConn* conn;
+                {
+                    std::lock_guard<std::mutex> lock(conn_mtx);
+                    auto it = clients.find(ev.fd);
+                    if(it == clients.end()) continue;
+                    conn = &it->second;
+                    conn->busy = true;
+                }
+
+                // 分发一次读-处理-回复任务，oneshot保证在重新注册前不会再收到该fd的事件
+                int client_fd = ev.fd;
+                uint32_t events = ev.events;
+                dispatch([this, &poller, &conn_mtx, &clients, &timers, &wake_at_ms, &timer_wakeup,
+                          client_fd, conn, events](){
+                    uint32_t interest = _handler.on_ready(client_fd, *conn, events);
+                    if(interest != 0){
+                        // 在锁内重新启用事件，保证超时关闭和重新启用不会交错
+                        std::lock_guard<std::mutex> lock(conn_mtx);
+                        uint64_t now = TimerWheel::clock_ms();
+                        uint64_t timeout = ConnectionHandler::timeout_of(*conn);
+                        if(!timers.reset(conn->timer, timeout, now)) conn->timer = timers.add(timeout, client_fd, now);  // 处理期间已到期
+                        if(now + timeout < wake_at_ms){
+                            wake_at_ms = now + timeout;
+                            timer_wakeup.notify();
+                        }
+                        conn->busy = false;
+                        poller.modify(client_fd, interest, true);
+                        return;
+                    }
+                    sockaddr_in client_addr = conn->addr;
+                    bool last;
+                    {
+                        std::lock_guard<std::mutex> lock(conn_mtx);
+                        timers.cancel(conn->timer);
+                        clients.erase(client_fd);
+                        last = clients.empty();
+                    }
+                    poller.remove(client_fd);
+                    close(client_fd);
+                    if(last && _draining.load()) timer_wakeup.notify();
+                    LOG_EVENT(_logger, LOG_LEVEL_INFO, "线程PID: {} 关闭客户端连接: {}", getpid(), LogPeer(client_addr));
+                });
+            }
+
+            std::lock_guard<std::mutex> lock(conn_mtx);
+            timers.advance(on_timeout);
+            if(draining && clients.empty()) break;
+        }
+
+        // 先排空线程池，等待正在执行的任务结束，再关闭剩下的连接
+        drain_pool();
+        for(auto &client : clients){
+            close(client.first);
+        }
+        _logger.info("服务器接收连接关闭");
+    }
+
+    // 多reactor模式：启动reactor_num个事件循环线程(0表示CPU核数)，阻塞直到全部退出
+    // 需要以reuse_port=true构造，第0个reactor复用server_fd，其余各自使用一个SO_REUSEPORT监听socket；
+    // 热重启接管的监听socket多于reactor_num时按监听socket的个数运行，每个socket都有自己的accept队列
+    void start_multi_reactor(size_t reactor_num = 0){
+        if(_running) return;
+        if(reactor_num == 0) reactor_num = std::max(1u, std::thread::hardware_concurrency());
+        open_listen_sockets(reactor_num);
+        reactor_num = _listen_fds.size();
+
+        _running.store(true);
+        _logger.info("Starting server with ", reactor_num, " reactors");
+
+        std::vector<std::thread> reactors;
+        for(size_t i = 0; i < reactor_num; ++i){
+            reactors.emplace_back(&ThreadServer::run_reactor, this, _listen_fds[i], i);
+        }
+        for(auto &t : reactors){
+            t.join();
+        }
+        _logger.info("服务器接收连接关闭");
+    }
+
+    // 通知所有循环退出，可以在任意线程调用
+    void shutdown(){
         _running.store(false);
+        _stop_wakeup.notify();
+    }
 
-        // 关闭server socket来中断accept
-        if(server_fd >= 0){
-            close(server_fd);
-            server_fd = -1;
+    // 热重启后通知所有循环停止accept，已有连接处理完后循环退出(pool模式的accept循环立即退出)，可以在任意线程调用
+    void drain(){
+        _draining.store(true);
+        _drain_wakeup.notify();
+    }
+
+    void stop(){
+        shutdown();
+
+        // 关闭监听socket来中断accept
+        for(int fd : _listen_fds){
+            close(fd);
         }
+        _listen_fds.clear();
+        server_fd = -1;
 
-        // 销毁线程池
-        _thread_pool.reset();
+        // 排空并销毁线程池
+        drain_pool();
 
         _logger.info("服务器已关闭");
     }
@@ -308,42 +904,178 @@ public:
         stop();
     }
 };
-std::atomic<bool> ThreadServer::_running{false};
 
 
-// 信号处理
-void setup_signal_handler(){
-    struct sigaction sa;
-    sa.__sigaction_u.__sa_handler = [](int){
-        std::cout << "\n[INFO] ";
-        std::cout << "正在关闭服务器..." << std::endl;
-        ThreadServer::_running.store(false);
-    };
+// 信号处理：阻塞等待SIGINT/SIGTERM，收到后返回；服务器线程已经结束(server_done可读)时也返回
+// SIGUSR2时热重启，新进程接管监听socket后通知服务器停止accept，等待已有连接结束，最长DRAIN_TIMEOUT
+void wait_for_shutdown(const SignalChannel& signals, ThreadServer& server, const WakeupChannel& server_done, char* argv[]){
+#ifndef __linux__
+    (void)server;
+    (void)argv;
+#endif
+    pollfd pfds[2] = {{signals.fd(), POLLIN, 0}, {server_done.fd(), POLLIN, 0}};
+    bool draining = false;
+    auto deadline = std::chrono::steady_clock::now();
+    while(true){
+        int timeout = -1;
+        if(draining){
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<long long>(0, left.count()));
+        }
+        int ready = poll(pfds, 2, timeout);
+        if(ready < 0 && errno != EINTR){
+            std::cerr << "[ERROR] ";
+            perror("Poll Signal Failed");
+            return;
+        }
+        if(ready == 0){
+            std::cout << "[INFO] 排空超时，关闭剩余连接" << std::endl;
+            return;
+        }
+        if(ready > 0 && (pfds[1].revents & POLLIN)) return;
+        int sig;
+        while((sig = signals.next()) != 0){
+            if(sig == SIGINT || sig == SIGTERM){
+                std::cout << "\n[INFO] ";
+                std::cout << "正在关闭服务器..." << std::endl;
+                return;
+            }
+#ifdef __linux__
+            if(sig == SIGUSR2 && !draining){
+                std::cout << "[INFO] 收到SIGUSR2，热重启: " << executable_path() << std::endl;
+                pid_t pid;
+                if(hot_restart(server.listen_fds(), argv, HOT_RESTART_TIMEOUT_MS, pid)){
+                    std::cout << "[INFO] 新进程 " << pid << " 已接管监听socket，停止接受新连接，等待已有连接结束" << std::endl;
+                    draining = true;
+                    deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+                    server.drain();
+                }
+                else{
+                    std::cerr << "[ERROR] ";
+                    perror("Hot Restart Failed");
+                    std::cout << "[INFO] 继续服务" << std::endl;
+                }
+            }
+#endif
+        }
+    }
+}
 
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
 
-    // 忽略SIGPIPE
-    signal(SIGPIPE, SIG_IGN);
+// 位置参数中的数量：整个参数是十进制数时返回true，否则调用方把它当作选项处理
+static bool parse_count(const char* arg, unsigned long& count){
+    if(!isdigit(static_cast<unsigned char>(arg[0]))) return false;
+    char* end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if(*end != '\0' || errno == ERANGE) return false;
+    count = value;
+    return true;
 }
 
+int main(int argc, char* argv[]){
+    // 忽略SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#ifdef __linux__
+    executable_path();  // 记下启动时的程序路径，热重启时exec它
+    Takeover takeover;  // 由热重启启动时，监听socket从旧进程接收
+#endif
+    // 在创建任何线程(包括日志线程)之前屏蔽退出信号和热重启信号，所有线程继承屏蔽字，信号只通过signalfd交给主线程
+    SignalChannel signals({SIGINT, SIGTERM, SIGUSR2});
+    if(!signals.valid()){
+        std::cerr << "[ERROR] ";
+        perror("Signalfd Failed");
+        return -1;
+    }
 
-int main(){
-    setup_signal_handler();
+    std::string mode = argc > 1 ? argv[1] : "pool";
+    if(mode != "pool" && mode != "event" && mode != "reactor"){
+        std::cerr << "[ERROR] 未知模式: " << mode << "，用法: " << argv[0] << " [pool|event|reactor] [N]" << std::endl;
+        return -1;
+    }
+    // 第二个参数是数字时为N，否则从它开始都是选项(如 ./multithread_serverTCP reactor uring)
+    unsigned long count = mode == "pool" ? 10 : mode == "event" ? 4 : 0;
+    int first_option = 2;
+    if(argc > 2 && parse_count(argv[2], count)) first_option = 3;
+    size_t n = count;
 
     try{
-        ThreadServer server;
+        bool work_stealing = false;
+        bool binlog = false;
+        bool framed = false;
+        bool uring = false;
+        const char* file_path = nullptr;
+        SendMode send_mode = SendMode::SENDFILE;
+        for(int i = first_option; i < argc; ++i){
+            std::string opt = argv[i];
+            if(opt == "ws") work_stealing = true;
+            else if(opt == "binlog") binlog = true;
+            else if(opt == "framed") framed = true;
+            else if(opt == "uring") uring = true;
+            else if(opt.compare(0, 5, "file=") == 0) file_path = argv[i] + 5;
+            else if(!parse_send_mode(opt, send_mode)){
+                std::cerr << "[ERROR] 未知选项: " << opt << "，用法: " << argv[0]
+                          << " [pool|event|reactor] [N] [ws] [binlog] [framed] [uring] [file=路径] [copy|sendfile|zerocopy]" << std::endl;
+                return -1;
+            }
+        }
+        StaticFile file;
+        if(file_path){
+            if(!file.open(file_path)){
+                std::cerr << "[ERROR] ";
+                perror("Open Static File Failed");
+                return -1;
+            }
+            std::cout << "[INFO] 静态文件: " << file_path << " (" << file.size() << " 字节)，GET /file 返回它的内容" << std::endl;
+        }
+#ifndef HAVE_IO_URING
+        if(uring){
+            std::cerr << "[ERROR] 当前平台不支持io_uring，回退到epoll" << std::endl;
+            uring = false;
+        }
+#endif
+        // 热重启时直接使用旧进程交出的监听socket，它们的accept队列中可能已经有等待的连接
+        std::vector<int> listen_fds;
+#ifdef __linux__
+        if(takeover.requested()){
+            if(!takeover.receive(listen_fds)){
+                std::cerr << "[ERROR] ";
+                perror("Receive Listen Sockets Failed");
+                return -1;
+            }
+            std::cout << "[INFO] 已从旧进程接管 " << listen_fds.size() << " 个监听socket" << std::endl;
+        }
+#endif
+        ThreadServer server(mode == "reactor", work_stealing, binlog ? BINLOG_PATH : nullptr, framed, uring,
+                            file_path ? &file : nullptr, send_mode, std::move(listen_fds));
+        if(mode == "reactor"){
+            // 所有监听socket在服务器线程启动前创建好，热重启时主线程把它们交给新进程
+            if(n == 0) n = std::max(1u, std::thread::hardware_concurrency());
+            server.open_listen_sockets(n);
+        }
 
-        // 在单独的线程中启动服务器
-        std::thread server_thread([&server](){
-            server.start(10); // 10个工作线程
+        // 在单独的线程中启动服务器，结束时通知主线程(排空完成或启动失败)
+        WakeupChannel server_done;
+        std::thread server_thread([&server, &mode, &server_done, n](){
+            if(mode == "reactor") server.start_multi_reactor(n);  // n个事件循环线程
+            else if(mode == "event") server.start_event_driven(n); // reactor + n个工作线程
+            else server.start(n); // n个工作线程
+            server_done.notify();
         });
 
         std::cout << "[INFO] Server running. Press Ctrl+C to stop." << std::endl;
+        std::cout << "[INFO] 服务器进程: " << getpid() << std::endl;
+#ifdef __linux__
+        // 服务器线程已经启动(在此之前到达的连接排在accept队列中)，通知旧进程停止accept
+        if(takeover.requested() && !takeover.ready()){
+            std::cerr << "[ERROR] ";
+            perror("Notify Old Process Failed");
+        }
+#endif
 
-        // 主线程等待服务器线程结束
+        // 主线程等待退出信号，然后等待服务器线程结束
+        wait_for_shutdown(signals, server, server_done, argv);
+        server.shutdown();
         server_thread.join();
     }
     catch (const std::exception &e){
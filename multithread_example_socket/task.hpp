@@ -0,0 +1,308 @@
+#pragma once
+#include <cstddef>             // std::max_align_t
+#include <new>                 // placement new
+#include <mutex>               // 块池的全局空闲链表
+#include <tuple>               // 保存任务参数
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 定长内存块池
+// 每个线程缓存一批空闲块，分配和释放都不加锁；缓存超过上限时把一半还给全局链表，
+// 缓存为空时从全局链表批量取回，所以跨线程释放(提交线程分配、工作线程释放)也不会退化成每次malloc
+template <size_t BlockSize>
+class BlockPool{
+private:
+    struct Block{ Block* next; };
+    static_assert(BlockSize >= sizeof(Block), "block too small");
+
+    static constexpr size_t CACHE_MAX = 64;  // 线程缓存上限
+    static constexpr size_t BATCH = 32;      // 与全局链表一次交换的块数
+
+    struct Global{
+        std::mutex mtx;
+        Block* head = nullptr;
+    };
+
+    struct Cache{
+        Block* head = nullptr;
+        size_t count = 0;
+        ~Cache(){ flush(*this, count); }  // 线程退出时把缓存还给全局链表
+    };
+
+    static Global& global(){
+        static Global g;
+        return g;
+    }
+
+    static Cache& cache(){
+        thread_local Cache c;
+        return c;
+    }
+
+    static void refill(Cache& c){
+        Global& g = global();
+        std::lock_guard<std::mutex> lock(g.mtx);
+        while(g.head && c.count < BATCH){
+            Block* b = g.head;
+            g.head = b->next;
+            b->next = c.head;
+            c.head = b;
+            ++c.count;
+        }
+    }
+
+    static void flush(Cache& c, size_t n){
+        if(n == 0) return;
+        Global& g = global();
+        std::lock_guard<std::mutex> lock(g.mtx);
+        while(c.head && n-- > 0){
+            Block* b = c.head;
+            c.head = b->next;
+            b->next = g.head;
+            g.head = b;
+            --c.count;
+        }
+    }
+
+public:
+    static void* allocate(){
+        Cache& c = cache();
+        if(!c.head) refill(c);
+        if(!c.head) return ::operator new(BlockSize);  // 池中没有空闲块，新分配的块释放后进入池中复用
+        Block* b = c.head;
+        c.head = b->next;
+        --c.count;
+        return b;
+    }
+
+    static void deallocate(void* p){
+        Cache& c = cache();
+        Block* b = static_cast<Block*>(p);
+        b->next = c.head;
+        c.head = b;
+        if(++c.count > CACHE_MAX) flush(c, BATCH);
+    }
+};
+
+
+
+// 只移动的任务类型，代替std::function<void()>
+// 捕获不超过INLINE_CAPACITY字节的可调用对象直接存放在对象内部，不分配内存；
+// 更大的捕获放到BlockPool的定长块中复用；只有超过POOLED_CAPACITY的捕获才会走operator new
+class Task{
+public:
+    static constexpr size_t INLINE_CAPACITY = 64;
+    static constexpr size_t POOLED_CAPACITY = 256;
+
+    Task() noexcept = default;
+
+    template <class F, class Fn = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same<Fn, Task>::value>>
+    Task(F&& f){
+        if constexpr(fits_inline<Fn>()){
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &inline_ops<Fn>;
+        }
+        else if constexpr(sizeof(Fn) <= POOLED_CAPACITY && alignof(Fn) <= alignof(std::max_align_t)){
+            void* block = BlockPool<POOLED_CAPACITY>::allocate();
+            new (block) Fn(std::forward<F>(f));
+            set_pointer(block);
+            ops_ = &pooled_ops<Fn>;
+        }
+        else{
+            set_pointer(new Fn(std::forward<F>(f)));
+            ops_ = &heap_ops<Fn>;
+        }
+    }
+
+    Task(Task&& other) noexcept{
+        move_from(other);
+    }
+
+    Task& operator=(Task&& other) noexcept{
+        if(this != &other){
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task(){
+        reset();
+    }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    void operator()(){
+        ops_->invoke(storage_);
+    }
+
+    void reset() noexcept{
+        if(ops_){
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    // 每种存储方式一张函数表
+    struct Ops{
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // 移动到dst并析构src
+        void (*destroy)(void* storage);
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[INLINE_CAPACITY];
+    const Ops* ops_ = nullptr;
+
+    template <class Fn>
+    static constexpr bool fits_inline(){
+        return sizeof(Fn) <= INLINE_CAPACITY && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    void set_pointer(void* p){ *reinterpret_cast<void**>(storage_) = p; }
+    static void* get_pointer(void* storage){ return *reinterpret_cast<void**>(storage); }
+
+    void move_from(Task& other) noexcept{
+        ops_ = other.ops_;
+        if(ops_){
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    template <class Fn>
+    static constexpr Ops inline_ops{
+        [](void* s){ (*static_cast<Fn*>(s))(); },
+        [](void* dst, void* src){
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* s){ static_cast<Fn*>(s)->~Fn(); },
+    };
+
+    template <class Fn>
+    static constexpr Ops pooled_ops{
+        [](void* s){ (*static_cast<Fn*>(get_pointer(s)))(); },
+        [](void* dst, void* src){ *reinterpret_cast<void**>(dst) = get_pointer(src); },
+        [](void* s){
+            Fn* fn = static_cast<Fn*>(get_pointer(s));
+            fn->~Fn();
+            BlockPool<POOLED_CAPACITY>::deallocate(fn);
+        },
+    };
+
+    template <class Fn>
+    static constexpr Ops heap_ops{
+        [](void* s){ (*static_cast<Fn*>(get_pointer(s)))(); },
+        [](void* dst, void* src){ *reinterpret_cast<void**>(dst) = get_pointer(src); },
+        [](void* s){ delete static_cast<Fn*>(get_pointer(s)); },
+    };
+};
+
+// 把可调用对象和参数打包成Task，参数按值保存一次(右值移动，左值复制)，之后只移动不复制
+template <class F>
+Task make_task(F&& f){
+    return Task(std::forward<F>(f));
+}
+
+template <class F, class Arg, class ...Args>
+Task make_task(F&& f, Arg&& arg, Args&& ...args){
+    return Task([fn = std::decay_t<F>(std::forward<F>(f)),
+                 params = std::make_tuple(std::forward<Arg>(arg), std::forward<Args>(args)...)]() mutable {
+        std::apply(fn, std::move(params));
+    });
+}
+
+
+
+// 带丢弃回调的任务：如果任务在执行前被销毁(线程池停止、排空超时或拒绝提交)，
+// 析构时调用on_drop释放任务持有的资源，例如关闭已经accept但还没处理的连接
+template <class F, class D>
+class DropGuardTask{
+private:
+    F fn_;
+    D on_drop_;
+    bool armed_ = true;
+
+public:
+    DropGuardTask(F fn, D on_drop) : fn_(std::move(fn)), on_drop_(std::move(on_drop)){}
+
+    DropGuardTask(DropGuardTask&& other) noexcept
+        : fn_(std::move(other.fn_)), on_drop_(std::move(other.on_drop_)), armed_(other.armed_){
+        other.armed_ = false;
+    }
+
+    DropGuardTask(const DropGuardTask&) = delete;
+    DropGuardTask& operator=(const DropGuardTask&) = delete;
+    DropGuardTask& operator=(DropGuardTask&&) = delete;
+
+    ~DropGuardTask(){
+        if(armed_) on_drop_();
+    }
+
+    void operator()(){
+        armed_ = false;
+        fn_();
+    }
+};
+
+template <class F, class D>
+Task make_task_with_drop(F&& f, D&& on_drop){
+    return Task(DropGuardTask<std::decay_t<F>, std::decay_t<D>>(std::forward<F>(f), std::forward<D>(on_drop)));
+}
+
+
+
+// 线程池排空的结果(ThreadPool和WorkStealingPool共用)
+struct DrainReport{
+    size_t completed = 0;    // 排空期间执行完成的任务数
+    size_t dropped = 0;      // 超时后仍在队列中、被丢弃的任务数
+    size_t rejected = 0;     // 排空开始后提交、被拒绝的任务数
+    size_t interrupted = 0;  // 超时时仍在执行的任务数(通过on_timeout通知它们尽快结束)
+    bool timed_out = false;
+};
+
+// 任务环形队列，代替std::queue<std::function<void()>>
+// 容量按2的幂翻倍增长，预热后入队出队不再分配内存
+class TaskQueue{
+private:
+    std::vector<Task> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+
+    void grow(){
+        std::vector<Task> bigger(ring_.empty() ? 64 : ring_.size() * 2);
+        for(size_t i = 0; i < size_; ++i){
+            bigger[i] = std::move(ring_[(head_ + i) & (ring_.size() - 1)]);
+        }
+        ring_.swap(bigger);
+        head_ = 0;
+    }
+
+public:
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+    void push(Task&& task){
+        if(size_ == ring_.size()) grow();
+        ring_[(head_ + size_) & (ring_.size() - 1)] = std::move(task);
+        ++size_;
+    }
+
+    Task pop(){
+        Task task = std::move(ring_[head_]);
+        head_ = (head_ + 1) & (ring_.size() - 1);
+        --size_;
+        return task;
+    }
+
+    void clear(){
+        while(!empty()) pop();
+    }
+};
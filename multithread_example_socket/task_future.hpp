@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>              // 就绪标志和引用计数
+#include <mutex>               // 只在真正需要阻塞等待时使用
+#include <condition_variable>
+#include <exception>           // 把任务中抛出的异常传给等待方
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "task.hpp"            // BlockPool
+
+// 轻量级future/promise，代替std::future/std::promise
+// 共享状态从BlockPool分配、侵入式引用计数，提交结果时只有在有线程阻塞等待的情况下才加锁通知，
+// 调用get()前结果已经就绪时完全无锁
+template <class T>
+class TaskFuture;
+
+namespace task_future_detail{
+
+template <class T>
+struct SharedState{
+    using Stored = std::conditional_t<std::is_void<T>::value, char, T>;
+
+    std::atomic<int> refs{1};
+    std::atomic<bool> ready{false};
+    std::atomic<bool> has_waiter{false};
+    std::optional<Stored> value;
+    std::exception_ptr error;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    static SharedState* create(){
+        return new (BlockPool<sizeof(SharedState)>::allocate()) SharedState();
+    }
+
+    void add_ref(){ refs.fetch_add(1, std::memory_order_relaxed); }
+
+    void release(){
+        if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            this->~SharedState();
+            BlockPool<sizeof(SharedState)>::deallocate(this);
+        }
+    }
+
+    void publish(){
+        ready.store(true, std::memory_order_seq_cst);
+        if(has_waiter.load(std::memory_order_seq_cst)){
+            { std::lock_guard<std::mutex> lock(mtx); }
+            cv.notify_all();
+        }
+    }
+
+    void wait(){
+        // 先短暂自旋，大部分小任务在这期间就会完成
+        for(int spin = 0; spin < 64; ++spin){
+            if(ready.load(std::memory_order_acquire)) return;
+            std::this_thread::yield();
+        }
+        has_waiter.store(true, std::memory_order_seq_cst);
+        if(ready.load(std::memory_order_seq_cst)) return;
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this](){ return ready.load(std::memory_order_acquire); });
+    }
+};
+
+} // namespace task_future_detail
+
+
+// 任务一侧：执行可调用对象并把结果或异常写入共享状态
+template <class T>
+class TaskPromise{
+private:
+    using State = task_future_detail::SharedState<T>;
+    State* state_;
+
+public:
+    TaskPromise() : state_(State::create()){}
+    TaskPromise(TaskPromise&& other) noexcept : state_(other.state_){ other.state_ = nullptr; }
+    TaskPromise(const TaskPromise&) = delete;
+    TaskPromise& operator=(const TaskPromise&) = delete;
+    TaskPromise& operator=(TaskPromise&&) = delete;
+
+    ~TaskPromise(){
+        if(state_){
+            // 任务被丢弃而没有执行(例如线程池停止)，让等待方得到异常而不是永远阻塞
+            if(!state_->ready.load(std::memory_order_relaxed)){
+                state_->error = std::make_exception_ptr(std::runtime_error("task dropped before execution"));
+                state_->publish();
+            }
+            state_->release();
+        }
+    }
+
+    TaskFuture<T> get_future();
+
+    template <class Fn>
+    void run(Fn&& fn){
+        try{
+            if constexpr(std::is_void<T>::value){
+                fn();
+                state_->value.emplace('\0');
+            }
+            else{
+                state_->value.emplace(fn());
+            }
+        }
+        catch(...){
+            state_->error = std::current_exception();
+        }
+        state_->publish();
+    }
+};
+
+
+// 等待方：wait()阻塞到任务完成，get()取出结果(只能调用一次)或重新抛出任务中的异常
+template <class T>
+class TaskFuture{
+private:
+    using State = task_future_detail::SharedState<T>;
+    State* state_ = nullptr;
+
+    friend class TaskPromise<T>;
+    explicit TaskFuture(State* state) : state_(state){ state_->add_ref(); }
+
+public:
+    TaskFuture() = default;
+    TaskFuture(TaskFuture&& other) noexcept : state_(other.state_){ other.state_ = nullptr; }
+    TaskFuture& operator=(TaskFuture&& other) noexcept{
+        if(this != &other){
+            if(state_) state_->release();
+            state_ = other.state_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+    TaskFuture(const TaskFuture&) = delete;
+    TaskFuture& operator=(const TaskFuture&) = delete;
+
+    ~TaskFuture(){
+        if(state_) state_->release();
+    }
+
+    bool valid() const { return state_ != nullptr; }
+    bool ready() const { return state_ && state_->ready.load(std::memory_order_acquire); }
+    void wait() const { state_->wait(); }
+
+    T get(){
+        state_->wait();
+        State* state = state_;
+        state_ = nullptr;
+        struct Releaser{ State* s; ~Releaser(){ s->release(); } } releaser{state};
+        if(state->error) std::rethrow_exception(state->error);
+        if constexpr(!std::is_void<T>::value){
+            return std::move(*state->value);
+        }
+    }
+};
+
+template <class T>
+TaskFuture<T> TaskPromise<T>::get_future(){
+    return TaskFuture<T>(state_);
+}
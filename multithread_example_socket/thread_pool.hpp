@@ -0,0 +1,194 @@
+#pragma once
+#include <vector>              // C++动态数组容器，用于存储线程等对象
+#include <thread>              // C++11线程库，提供std::thread类
+#include <mutex>               // C++11互斥锁，用于线程同步
+#include <condition_variable>  // C++11条件变量，用于线程间通信
+#include <atomic>              // C++11原子操作，提供线程安全的原子变量
+#include <chrono>              // 排空超时
+#include <functional>          // 超时回调
+#include "logger.hpp"
+#include <iterator>            // std::begin/std::end
+#include <type_traits>         // std::invoke_result_t
+#include "task.hpp"            // 只移动、不分配内存的任务类型和环形任务队列
+#include "task_future.hpp"     // submit()返回的轻量级future
+
+// 线程池
+class ThreadPool{
+private:
+    void worker();
+    std::vector<std::thread> threadpool;
+    TaskQueue task_queue;
+    std::condition_variable task_available;
+    std::condition_variable drained;          // 排空时等待队列清空且没有正在执行的任务
+    std::mutex queue_mtx;
+    std::atomic<bool> stop_flag{false};
+    bool accepting = true;                    // 排空开始后不再接受新任务，受queue_mtx保护
+    std::atomic<bool> draining{false};
+    std::atomic<size_t> active{0};            // 正在执行的任务数
+    std::atomic<size_t> completed{0};         // 累计完成的任务数
+    size_t rejected = 0;                      // 排空开始后被拒绝的任务数，受queue_mtx保护
+    Logger& _logger;
+
+    // 入队，排空开始后拒绝并销毁任务(带丢弃回调的任务会在此时释放资源)
+    bool enqueue(Task&& task){
+        std::unique_lock<std::mutex> lock(queue_mtx);
+        if(!accepting){
+            ++rejected;
+            lock.unlock();
+            task.reset();
+            return false;
+        }
+        task_queue.push(std::move(task));
+        lock.unlock();
+
+        task_available.notify_one();
+        return true;
+    }
+
+public:
+    ThreadPool(size_t thread_num, Logger& logger): _logger(logger){
+        for(size_t i = 0; i < thread_num; ++i){
+            threadpool.emplace_back(&ThreadPool::worker, this);
+        }
+        _logger.info("线程池创建完成");
+    }
+
+    ~ThreadPool(){
+        stop();
+    }
+
+    // 完美转发：可调用对象和参数只在打包进Task时移动(或复制左值)一次，
+    // 捕获不超过Task::INLINE_CAPACITY的任务全程不分配内存
+    // 排空开始后提交的任务被拒绝，返回false
+    template <class F, class ...Args>
+    bool add_task(F&& f, Args&& ...args){
+        if(!enqueue(make_task(std::forward<F>(f), std::forward<Args>(args)...))) return false;  // 在锁外构造
+        _logger.debug("任务添加成功!");  // 每个任务一条，默认在编译期去掉
+        return true;
+    }
+
+    // 提交任务并返回future，通过future.get()取得返回值或任务中抛出的异常
+    template <class F, class ...Args>
+    auto submit(F&& f, Args&& ...args)
+        -> TaskFuture<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>{
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+        TaskPromise<R> promise;
+        TaskFuture<R> future = promise.get_future();
+        add_task([promise = std::move(promise), fn = std::decay_t<F>(std::forward<F>(f)),
+                  params = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            promise.run([&](){ return std::apply(fn, std::move(params)); });
+        });
+        return future;
+    }
+
+    // 批量提交：整批任务只加一次锁、只唤醒一次，range中的每个元素都是无参可调用对象
+    // 传入右值容器时元素被移动，否则被复制；返回提交的任务数
+    template <class Range>
+    size_t submit_bulk(Range&& range){
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(queue_mtx);
+            if(!accepting) return 0;
+            for(auto it = std::begin(range); it != std::end(range); ++it){
+                if constexpr(std::is_rvalue_reference<Range&&>::value){
+                    task_queue.push(make_task(std::move(*it)));
+                }
+                else{
+                    task_queue.push(make_task(*it));
+                }
+                ++count;
+            }
+        }
+
+        if(count == 1) task_available.notify_one();
+        else if(count > 1) task_available.notify_all();
+        _logger.debug("批量添加任务: ", count);  // 与add_task一样按调用记录，默认在编译期去掉
+        return count;
+    }
+
+    // 优雅排空：立即停止接受新任务，继续执行队列中和正在执行的任务，最多等待timeout；
+    // 超时后丢弃队列中剩余的任务(触发它们的丢弃回调)，调用on_timeout通知正在执行的任务尽快结束，
+    // 最后等待所有工作线程退出并返回统计结果
+    DrainReport drain(std::chrono::milliseconds timeout, const std::function<void()>& on_timeout = {}){
+        DrainReport report;
+        size_t completed_before = completed.load();
+        TaskQueue leftover;
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx);
+            accepting = false;
+            draining.store(true);
+            bool idle = drained.wait_for(lock, timeout, [this](){
+                return task_queue.empty() && active.load() == 0;
+            });
+            if(!idle){
+                report.timed_out = true;
+                report.dropped = task_queue.size();
+                report.interrupted = active.load();
+                std::swap(leftover, task_queue);
+            }
+            stop_flag.store(true);
+        }
+        task_available.notify_all();
+        leftover.clear();  // 在锁外销毁，丢弃回调可能比较耗时
+        if(report.timed_out && on_timeout) on_timeout();
+
+        join_workers();
+        report.completed = completed.load() - completed_before;
+        {
+            std::lock_guard<std::mutex> lock(queue_mtx);
+            report.rejected = rejected;
+        }
+        _logger.info("线程池排空完成: 完成 ", report.completed, " 丢弃 ", report.dropped,
+                     " 拒绝 ", report.rejected, " 超时中断 ", report.interrupted);
+        return report;
+    }
+
+    // 立即停止：丢弃队列中的所有任务，只等待正在执行的任务结束
+    void stop(){
+        if(threadpool.empty()) return;  // 已经停止(或已排空)
+        stop_flag.store(true);
+        task_available.notify_all();
+        TaskQueue leftover;
+        queue_mtx.lock();
+        accepting = false;
+        std::swap(leftover, task_queue);
+        queue_mtx.unlock();
+        leftover.clear();
+        join_workers();
+    }
+
+private:
+    void join_workers(){
+        for(auto &t : threadpool){
+            if(t.joinable()){
+                t.join();
+            }
+        }
+        threadpool.clear();
+        _logger.info("线程池销毁完成");
+    }
+
+};
+
+inline void ThreadPool::worker(){
+    Task task;
+    while(true){
+        std::unique_lock<std::mutex> lock(queue_mtx);
+        task_available.wait(lock, [this](){return !task_queue.empty() || stop_flag.load();});
+
+        if(stop_flag.load()) return;
+        task = task_queue.pop();
+        active.fetch_add(1);
+        lock.unlock();
+
+        task();
+        task.reset();  // 尽早释放捕获的资源
+        completed.fetch_add(1, std::memory_order_relaxed);
+
+        // 只有排空期间才需要加锁通知，平时完成任务不碰锁
+        if(active.fetch_sub(1) == 1 && draining.load()){
+            std::lock_guard<std::mutex> drain_lock(queue_mtx);
+            drained.notify_all();
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#include <iostream>            // C++标准输入输出流，用于控制台输入输出
+#include <vector>              // C++动态数组容器，用于存储线程
+#include <thread>              // C++11线程库，提供std::thread类
+#include <atomic>              // C++11原子操作，统计已完成任务数
+#include <chrono>              // 计时
+#include <string>              // 解析命令行参数
+#include <stdexcept>           // submit检查中任务抛出的异常
+#include <streambuf>           // 空输出缓冲区
+#include <fcntl.h>             // open("/dev/null")
+#include <unistd.h>            // close()
+#include "logger.hpp"
+#include "thread_pool.hpp"
+#include "work_stealing_pool.hpp"
+
+// 线程池基准测试：多个生产者线程同时提交大量小任务，比较
+//   ThreadPool       : 单个std::queue + 一把互斥锁 + 一个条件变量
+//   WorkStealingPool : 每个工作线程一个无锁双端队列 + 分散的注入队列 + 随机窃取
+// 用法: ./threadpool_bench [producers] [tasks_per_producer] [threads]
+// 编译: g++ -std=c++17 -O2 -pthread threadpool_bench.cpp -o threadpool_bench
+//
+// 线程池的日志写到/dev/null，std::cout也重定向到空缓冲区
+// 开始计时之前先检查submit()/TaskFuture的行为，有失败项时以状态码1退出
+
+// 丢弃所有输出的缓冲区
+class NullBuffer : public std::streambuf{
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// 一个很小的任务：做一点计算后计数
+static void tiny_work(std::atomic<size_t>& done){
+    volatile unsigned x = 0;
+    for(int i = 0; i < 50; ++i) x = x + i;
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+// 多个生产者同时提交，返回从开始提交到全部任务执行完的耗时(毫秒)
+template <class Pool>
+double run_many_producers(Pool& pool, size_t producers, size_t tasks_per_producer){
+    std::atomic<size_t> done{0};
+    std::atomic<bool> go{false};
+    size_t total = producers * tasks_per_producer;
+
+    std::vector<std::thread> threads;
+    for(size_t p = 0; p < producers; ++p){
+        threads.emplace_back([&](){
+            while(!go.load()) std::this_thread::yield();
+            for(size_t i = 0; i < tasks_per_producer; ++i){
+                pool.add_task([&done](){ tiny_work(done); });
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for(auto &t : threads) t.join();
+    while(done.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 单个生产者按批提交：逐个add_task vs 每批一次submit_bulk(一次加锁、一次唤醒)
+double run_batches(ThreadPool& pool, size_t batches, size_t batch_size, bool bulk){
+    std::atomic<size_t> done{0};
+    size_t total = batches * batch_size;
+    auto job = [&done](){ tiny_work(done); };
+    std::vector<decltype(job)> batch(batch_size, job);
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < batches; ++b){
+        if(bulk){
+            pool.submit_bulk(batch);
+        }
+        else{
+            for(auto &task : batch) pool.add_task(task);
+        }
+    }
+    while(done.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 任务内部继续提交子任务(扇出)，工作窃取线程池在这种场景下完全不需要加锁
+template <class Pool>
+double run_fan_out(Pool& pool, size_t roots, size_t children){
+    std::atomic<size_t> done{0};
+    size_t total = roots * (children + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t r = 0; r < roots; ++r){
+        pool.add_task([&pool, &done, children](){
+            for(size_t c = 0; c < children; ++c){
+                pool.add_task([&done](){ tiny_work(done); });
+            }
+            tiny_work(done);
+        });
+    }
+    while(done.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// submit()/TaskFuture的正确性检查：返回值、任务中抛出的异常、执行前被丢弃的任务，返回失败的检查项
+std::vector<std::string> check_submit(Logger& logger){
+    std::vector<std::string> failures;
+    ThreadPool pool(1, logger);
+
+    TaskFuture<int> sum = pool.submit([](int a, int b){ return a + b; }, 2, 3);
+    if(sum.get() != 5) failures.push_back("返回值");
+
+    TaskFuture<void> thrown = pool.submit([](){ throw std::runtime_error("task error"); });
+    try{
+        thrown.get();
+        failures.push_back("任务异常");
+    }
+    catch(const std::runtime_error& e){
+        if(std::string(e.what()) != "task error") failures.push_back("任务异常");
+    }
+
+    // 唯一的工作线程被占住时排队的任务在排空超时后被丢弃，future得到异常而不是永远阻塞
+    std::atomic<bool> started{false}, release{false};
+    TaskFuture<void> blocker = pool.submit([&started, &release](){
+        started.store(true);
+        while(!release.load()) std::this_thread::yield();
+    });
+    TaskFuture<int> queued = pool.submit([](){ return 1; });
+    while(!started.load()) std::this_thread::yield();
+    DrainReport report = pool.drain(std::chrono::milliseconds(0), [&release](){ release.store(true); });
+    blocker.get();
+    try{
+        queued.get();
+        failures.push_back("丢弃的任务");
+    }
+    catch(const std::runtime_error&){
+        if(report.dropped != 1) failures.push_back("丢弃的任务");
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[]){
+    size_t producers = argc > 1 ? std::stoul(argv[1]) : 8;
+    size_t tasks_per_producer = argc > 2 ? std::stoul(argv[2]) : 200000;
+    size_t threads = argc > 3 ? std::stoul(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+    size_t total = producers * tasks_per_producer;
+    size_t roots = producers * 16, children = tasks_per_producer / 16;
+    size_t fan_total = roots * (children + 1);
+
+    std::cout << "生产者: " << producers << "  每个生产者任务数: " << tasks_per_producer
+              << "  工作线程: " << threads << std::endl;
+
+    NullBuffer null_buffer;
+    std::streambuf* saved = std::cout.rdbuf(&null_buffer);
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    size_t batch_size = 256, batches = total / batch_size;
+    double tp_ms, ws_ms, tp_fan_ms, ws_fan_ms, single_ms, bulk_ms;
+    std::vector<std::string> submit_failures;
+    {
+        // Logger的日志线程在析构时才写完剩余的日志，null_fd要在它销毁之后再关闭
+        Logger logger(Logger::Mode::ASYNC, null_fd);
+        submit_failures = check_submit(logger);
+        {
+            ThreadPool pool(threads, logger);
+            tp_ms = run_many_producers(pool, producers, tasks_per_producer);
+            tp_fan_ms = run_fan_out(pool, roots, children);
+            single_ms = run_batches(pool, batches, batch_size, false);
+            bulk_ms = run_batches(pool, batches, batch_size, true);
+        }
+        {
+            WorkStealingPool pool(threads, logger);
+            ws_ms = run_many_producers(pool, producers, tasks_per_producer);
+            ws_fan_ms = run_fan_out(pool, roots, children);
+        }
+    }
+    std::cout.rdbuf(saved);
+    close(null_fd);
+
+    std::cout << "[submit检查] ";
+    if(submit_failures.empty()){
+        std::cout << "返回值、任务异常、丢弃的任务: 通过" << std::endl;
+    }
+    else{
+        for(auto &name : submit_failures) std::cout << name << " ";
+        std::cout << "失败" << std::endl;
+        return 1;
+    }
+
+    auto report = [](const char* name, size_t total, double ms){
+        std::cout << "  " << name << ": " << ms << " ms, "
+                  << static_cast<size_t>(total / (ms / 1000.0)) << " 任务/秒" << std::endl;
+    };
+    std::cout << "[多生产者提交]" << std::endl;
+    report("ThreadPool      ", total, tp_ms);
+    report("WorkStealingPool", total, ws_ms);
+    std::cout << "[任务内扇出提交]" << std::endl;
+    report("ThreadPool      ", fan_total, tp_fan_ms);
+    report("WorkStealingPool", fan_total, ws_fan_ms);
+    std::cout << "[ThreadPool按批提交，每批" << batch_size << "个]" << std::endl;
+    report("add_task        ", batches * batch_size, single_ms);
+    report("submit_bulk     ", batches * batch_size, bulk_ms);
+    return 0;
+}
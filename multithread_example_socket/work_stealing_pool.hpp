@@ -0,0 +1,380 @@
+#pragma once
+#include <vector>              // C++动态数组容器，用于存储线程等对象
+#include <thread>              // C++11线程库，提供std::thread类
+#include <mutex>               // C++11互斥锁，用于注入队列和休眠
+#include <condition_variable>  // C++11条件变量，只在线程空闲时用于休眠
+#include <atomic>              // C++11原子操作，无锁双端队列
+#include <memory>              // C++智能指针，用于自动内存管理
+#include <random>              // 随机选择窃取对象
+#include <chrono>              // 排空超时
+#include <functional>          // 超时回调
+#include <cstdint>
+#include "logger.hpp"
+#include "task.hpp"            // 只移动、不分配内存的任务类型和定长块池
+
+// Chase-Lev无锁工作窃取双端队列
+// 只有所有者线程可以在底部push/pop，其他线程只能从顶部steal
+// 扩容时旧数组不立即释放(窃取者可能还在读)，保留到队列析构
+template <class T>
+class WorkStealingDeque{
+private:
+    struct Array{
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+
+        explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<T*>[cap]){}
+        T* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, T* x){ slots[i & (capacity - 1)].store(x, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};     // 窃取端
+    alignas(64) std::atomic<int64_t> bottom_{0};  // 所有者端
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;  // 所有分配过的数组，仅所有者线程修改
+
+    Array* grow(Array* old, int64_t bottom, int64_t top){
+        arrays_.emplace_back(new Array(old->capacity * 2));
+        Array* bigger = arrays_.back().get();
+        for(int64_t i = top; i < bottom; ++i){
+            bigger->put(i, old->get(i));
+        }
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256){
+        arrays_.emplace_back(new Array(capacity));  // capacity必须是2的幂
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    // 所有者线程：压入底部
+    void push(T* x){
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if(b - t > a->capacity - 1){
+            a = grow(a, b, t);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 所有者线程：从底部弹出(LIFO，缓存友好)，队列为空返回nullptr
+    T* pop(){
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        T* x = nullptr;
+        if(t <= b){
+            x = a->get(b);
+            if(t == b){
+                // 最后一个元素，与窃取者竞争
+                if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+                    x = nullptr;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else{
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    // 任意线程：从顶部窃取(FIFO)，队列为空或竞争失败返回nullptr
+    T* steal(){
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b) return nullptr;
+
+        Array* a = array_.load(std::memory_order_acquire);
+        T* x = a->get(t);
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+            return nullptr;
+        }
+        return x;
+    }
+
+    bool empty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+};
+
+
+
+// 工作窃取线程池
+// 每个工作线程有一个无锁双端队列：工作线程内部提交的任务直接压入自己的队列，不需要任何锁；
+// 外部线程提交的任务轮流放入各工作线程的注入队列，锁被分散到N个队列上，不再争抢同一把锁。
+// 工作线程依次查找：自己的队列 -> 自己的注入队列 -> 随机选择其他线程窃取，
+// 全部为空时才在条件变量上休眠，提交方只在有线程休眠时才去加锁唤醒。
+// 关闭方式与ThreadPool相同：drain等待已提交的任务完成(有超时)，stop丢弃未执行的任务
+class WorkStealingPool{
+private:
+    // 双端队列中存放的是节点指针，节点本身从块池分配
+    struct TaskNode{
+        Task task;
+        TaskNode* next = nullptr;  // 注入队列中的侵入式链表指针
+    };
+    using NodePool = BlockPool<sizeof(TaskNode)>;
+
+    static TaskNode* new_node(Task&& task){
+        return new (NodePool::allocate()) TaskNode{std::move(task), nullptr};
+    }
+
+    static void free_node(TaskNode* node){
+        node->~TaskNode();
+        NodePool::deallocate(node);
+    }
+
+    struct alignas(64) Worker{
+        WorkStealingDeque<TaskNode> deque;
+        std::mutex inbox_mtx;
+        TaskNode* inbox_head = nullptr;         // 外部线程提交的任务，侵入式FIFO链表，入队不分配内存
+        TaskNode* inbox_tail = nullptr;
+        std::atomic<size_t> inbox_size{0};      // 无锁判断注入队列是否为空
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threadpool;
+    std::atomic<int64_t> pending{0};    // 已提交未取走的任务数
+    std::atomic<int> idle{0};           // 正在休眠的线程数
+    std::mutex park_mtx;
+    std::condition_variable park_cv;
+    std::atomic<bool> stop_flag{false};
+    std::atomic<bool> accepting{true};    // 排空开始后不再接受新任务
+    std::atomic<bool> draining{false};
+    std::atomic<size_t> active{0};        // 正在执行的任务数
+    std::atomic<size_t> completed{0};     // 累计完成的任务数
+    std::atomic<size_t> rejected{0};      // 排空开始后被拒绝的任务数
+    std::mutex drain_mtx;
+    std::condition_variable drained;      // 排空时等待所有任务完成
+    Logger& _logger;
+
+    // 当前线程所属的线程池和编号，用于判断提交者是否为本池的工作线程
+    static thread_local WorkStealingPool* tl_pool;
+    static thread_local size_t tl_index;
+
+    void worker(size_t index);
+    TaskNode* find_task(size_t index, std::minstd_rand& rng);
+
+    static TaskNode* take_from_inbox(Worker& w){
+        if(w.inbox_size.load(std::memory_order_relaxed) == 0) return nullptr;
+        std::lock_guard<std::mutex> lock(w.inbox_mtx);
+        TaskNode* node = w.inbox_head;
+        if(!node) return nullptr;
+        w.inbox_head = node->next;
+        if(!w.inbox_head) w.inbox_tail = nullptr;
+        w.inbox_size.fetch_sub(1, std::memory_order_relaxed);
+        node->next = nullptr;
+        return node;
+    }
+
+    // 丢弃还没执行的任务(触发它们的丢弃回调)，只能在工作线程全部退出后调用，返回丢弃的个数
+    size_t discard_all(){
+        size_t count = 0;
+        for(auto &w : workers){
+            while(TaskNode* node = w->deque.steal()){ free_node(node); ++count; }
+            while(TaskNode* node = take_from_inbox(*w)){ free_node(node); ++count; }
+        }
+        pending.store(0, std::memory_order_relaxed);
+        return count;
+    }
+
+    void join_workers(){
+        for(auto &t : threadpool){
+            if(t.joinable()){
+                t.join();
+            }
+        }
+        _logger.info("工作窃取线程池销毁完成");
+    }
+
+    void push(TaskNode* node){
+        // 排空开始后拒绝并销毁任务(带丢弃回调的任务会在此时释放资源)
+        if(!accepting.load(std::memory_order_relaxed)){
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            free_node(node);
+            return;
+        }
+        // 先增加计数再发布任务，保证pending不会小于0
+        pending.fetch_add(1, std::memory_order_seq_cst);
+        if(tl_pool == this){
+            workers[tl_index]->deque.push(node);
+        }
+        else{
+            // 每个提交线程从不同的位置开始轮询，避免多个生产者集中到同一个注入队列
+            static thread_local size_t next = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            Worker& w = *workers[next++ % workers.size()];
+            std::lock_guard<std::mutex> lock(w.inbox_mtx);
+            if(w.inbox_tail) w.inbox_tail->next = node;
+            else w.inbox_head = node;
+            w.inbox_tail = node;
+            w.inbox_size.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(idle.load(std::memory_order_seq_cst) > 0){
+            // 加锁保证不会在休眠线程检查条件和进入等待之间发出通知
+            { std::lock_guard<std::mutex> lock(park_mtx); }
+            park_cv.notify_one();
+        }
+    }
+
+public:
+    WorkStealingPool(size_t thread_num, Logger& logger): _logger(logger){
+        if(thread_num == 0) thread_num = 1;
+        for(size_t i = 0; i < thread_num; ++i){
+            workers.emplace_back(new Worker());
+        }
+        for(size_t i = 0; i < thread_num; ++i){
+            threadpool.emplace_back(&WorkStealingPool::worker, this, i);
+        }
+        _logger.info("工作窃取线程池创建完成");
+    }
+
+    ~WorkStealingPool(){
+        stop();
+        discard_all();  // 丢弃未执行的任务
+    }
+
+    template <class F, class ...Args>
+    void add_task(F&& f, Args&& ...args){
+        push(new_node(make_task(std::forward<F>(f), std::forward<Args>(args)...)));
+    }
+
+    // 优雅排空：立即停止接受新任务，继续执行已提交的和正在执行的任务，最多等待timeout；
+    // 超时后调用on_timeout通知正在执行的任务尽快结束，等待工作线程退出后丢弃剩余的任务，返回统计结果
+    DrainReport drain(std::chrono::milliseconds timeout, const std::function<void()>& on_timeout = {}){
+        DrainReport report;
+        if(stop_flag.load()) return report;  // 已经停止(或已排空)
+        size_t completed_before = completed.load();
+        accepting.store(false);
+        {
+            std::unique_lock<std::mutex> lock(drain_mtx);
+            draining.store(true);
+            bool idle = drained.wait_for(lock, timeout, [this](){
+                return pending.load() == 0 && active.load() == 0;
+            });
+            if(!idle){
+                report.timed_out = true;
+                report.interrupted = active.load();
+            }
+        }
+        // 先让空闲线程退出，再中断正在执行的任务，它们结束后不会再取新任务
+        stop_flag.store(true);
+        {
+            std::lock_guard<std::mutex> lock(park_mtx);
+        }
+        park_cv.notify_all();
+        if(report.timed_out && on_timeout) on_timeout();
+
+        join_workers();
+        report.dropped = discard_all();
+        report.completed = completed.load() - completed_before;
+        report.rejected = rejected.load();
+        _logger.info("工作窃取线程池排空完成: 完成 ", report.completed, " 丢弃 ", report.dropped,
+                     " 拒绝 ", report.rejected, " 超时中断 ", report.interrupted);
+        return report;
+    }
+
+    // 立即停止：未执行的任务在析构时丢弃，只等待正在执行的任务结束
+    void stop(){
+        if(stop_flag.exchange(true)) return;
+        accepting.store(false);
+        {
+            std::lock_guard<std::mutex> lock(park_mtx);
+        }
+        park_cv.notify_all();
+        join_workers();
+    }
+};
+
+inline thread_local WorkStealingPool* WorkStealingPool::tl_pool = nullptr;
+inline thread_local size_t WorkStealingPool::tl_index = 0;
+
+inline WorkStealingPool::TaskNode* WorkStealingPool::find_task(size_t index, std::minstd_rand& rng){
+    Worker& self = *workers[index];
+
+    // 1. 自己的队列
+    if(TaskNode* node = self.deque.pop()) return node;
+
+    // 2. 自己的注入队列：一次性转移到自己的队列中，让其他线程也能窃取
+    if(self.inbox_size.load(std::memory_order_relaxed) > 0){
+        TaskNode* batch;
+        {
+            std::lock_guard<std::mutex> lock(self.inbox_mtx);
+            batch = self.inbox_head;
+            self.inbox_head = self.inbox_tail = nullptr;
+            self.inbox_size.store(0, std::memory_order_relaxed);
+        }
+        while(batch){
+            TaskNode* node = batch;
+            batch = node->next;
+            node->next = nullptr;
+            self.deque.push(node);
+        }
+        if(TaskNode* node = self.deque.pop()) return node;
+    }
+
+    // 3. 从随机位置开始遍历其他线程，先窃取队列，再尝试注入队列
+    size_t n = workers.size();
+    size_t start = rng() % n;
+    for(size_t k = 0; k < n; ++k){
+        size_t victim = (start + k) % n;
+        if(victim == index) continue;
+        if(TaskNode* node = workers[victim]->deque.steal()) return node;
+    }
+    for(size_t k = 0; k < n; ++k){
+        size_t victim = (start + k) % n;
+        if(victim == index) continue;
+        if(TaskNode* node = take_from_inbox(*workers[victim])) return node;
+    }
+    return nullptr;
+}
+
+inline void WorkStealingPool::worker(size_t index){
+    tl_pool = this;
+    tl_index = index;
+    std::minstd_rand rng(static_cast<unsigned>(index + 1));
+
+    while(!stop_flag.load(std::memory_order_relaxed)){
+        TaskNode* node = find_task(index, rng);
+        if(node){
+            // 先计入active再减少pending，排空检查不会看到两者同时为0而任务还没执行
+            active.fetch_add(1, std::memory_order_seq_cst);
+            pending.fetch_sub(1, std::memory_order_seq_cst);
+            node->task();
+            free_node(node);
+            completed.fetch_add(1, std::memory_order_relaxed);
+            // 只有排空期间才需要加锁通知，平时完成任务不碰锁
+            if(active.fetch_sub(1, std::memory_order_seq_cst) == 1 && draining.load()){
+                std::lock_guard<std::mutex> drain_lock(drain_mtx);
+                drained.notify_all();
+            }
+            continue;
+        }
+
+        // 短暂自旋，避免任务间隙很短时频繁休眠和唤醒
+        bool found = false;
+        for(int spin = 0; spin < 64 && !found; ++spin){
+            std::this_thread::yield();
+            found = pending.load(std::memory_order_relaxed) > 0;
+        }
+        if(found) continue;
+
+        // 空闲：休眠直到有新任务或线程池停止
+        idle.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(park_mtx);
+            park_cv.wait(lock, [this](){
+                return pending.load(std::memory_order_seq_cst) > 0 || stop_flag.load();
+            });
+        }
+        idle.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
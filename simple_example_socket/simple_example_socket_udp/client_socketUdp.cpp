@@ -4,12 +4,54 @@
 #include <netinet/in.h> // Internet地址结构: struct sockaddr_in
 #include <arpa/inet.h> // IP地址转换: inet_pton
 #include <unistd.h> // POSIX系统服务 close(), read(), write() sleep(), getpid()
+#include <string>
+#include <random>
+#include <poll.h>
+#include "../../common/reliable_udp.hpp"
+#include "../../common/timer_wheel.hpp"
+
+// 用法: ./client_socketUdp [reliable]
+//   reliable: 与 ./server_socketUdp reliable 配合使用，消息经ReliableChannel发送，丢包时自动重传直到收到回复
 
 const char* SERVER_IP = "127.0.0.1";
 const int PORT = 8080;
 const int BUFFER_SIZE = 1024;
+const uint64_t RELIABLE_TIMEOUT_MS = 5000;  // 可靠模式下等待回复的总时间
+
+// 可靠模式：发送message并等待一个回复，成功时把回复写入reply
+static bool reliable_request(int sock, const sockaddr_in& serv_addr, const char* message, std::string& reply){
+    std::mt19937 rng(std::random_device{}());
+    ReliableChannel channel(std::uniform_int_distribution<uint32_t>(1, UINT32_MAX)(rng));
+    channel.send(message, strlen(message));
+
+    char buffer[BUFFER_SIZE + ReliableChannel::HEADER_SIZE];
+    bool replied = false;
+    uint64_t deadline = TimerWheel::clock_ms() + RELIABLE_TIMEOUT_MS;
+    // 收到回复后再flush一次，把确认发给服务器
+    while(true){
+        uint64_t now = TimerWheel::clock_ms();
+        channel.flush(now, [&](const char* data, size_t len) {
+            sendto(sock, data, len, 0, (struct sockaddr*)&serv_addr, sizeof(serv_addr));
+        });
+        if (replied) return true;
+        if (channel.failed() || now >= deadline) return false;
+
+        int timeout = channel.next_timeout(now);
+        if (timeout < 0 || now + timeout > deadline) timeout = static_cast<int>(deadline - now);
+        pollfd pfd{sock, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) <= 0) continue;
+        ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+        if (len < 0) continue;
+        channel.on_packet(buffer, len, TimerWheel::clock_ms(), [&](const char* data, size_t n) {
+            reply.assign(data, n);
+            replied = true;
+        });
+    }
+}
+
+int main(int argc, char* argv[]){
+    bool reliable = argc > 1 && std::string(argv[1]) == "reliable";
 
-int main(){
     // 1. 创建UDP嵌套字
     int sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock == -1){
@@ -29,8 +71,20 @@ int main(){
     }
 
     // 3. 数据交互
-    // 发送数据
     const char* message = "Hello from UDP client";
+    if (reliable){
+        std::string reply;
+        if (!reliable_request(sock, serv_addr, message, reply)){
+            std::cerr << "[ERROR] " << "没有收到回复" << std::endl;
+            close(sock);
+            return -1;
+        }
+        std::cout << "Received from " << SERVER_IP << ":" << PORT << " : " << reply << std::endl;
+        close(sock);
+        return 0;
+    }
+
+    // 发送数据
     sendto(sock, message, strlen(message), 0,
             (struct sockaddr*)&serv_addr, sizeof(serv_addr));
     std::cout << "Message sent to " << SERVER_IP << ":" << PORT << std::endl;
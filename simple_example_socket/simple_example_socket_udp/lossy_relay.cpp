@@ -0,0 +1,276 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <csignal>
+#include <sys/socket.h> // 核心Socket API
+#include <netinet/in.h> // Internet地址结构: struct sockaddr_in
+#include <arpa/inet.h> // IP地址转换: inet_pton
+#include <unistd.h> // POSIX系统服务 close()
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <net/if.h>
+#include <linux/if_tun.h>
+#endif
+#include "../../common/timer_wheel.hpp"  // TimerWheel::clock_ms
+
+// 本地的丢包中继，用来在环回上测试丢包时的行为
+// 每个方向的每个数据报(或IP包)按loss%的概率丢弃，没丢的延迟delay_ms后转发；延迟固定，转发顺序不变
+//
+// 用法: ./lossy_relay udp [loss%] [delay_ms] [listen_port] [target_port]
+//   在listen_port(默认9090)上收客户端的数据报，每个客户端用一个单独的socket转发到127.0.0.1:target_port(默认8080)，
+//   回复原路返回；不需要特权，只能中继UDP
+//   例: ./server_socketUdp reliable  +  ./lossy_relay udp 1 0  +  ./reliable_bench udp 127.0.0.1 9090
+//
+// 用法: ./lossy_relay tun [loss%] [delay_ms]
+//   创建TUN设备lossy0，地址10.9.0.1/23，在IP层丢包，TCP和UDP都适用(需要root或CAP_NET_ADMIN)
+//   发往10.9.1.x的包进入TUN设备，中继把源地址10.9.0.a改成10.9.1.a、目的地址10.9.1.b改成10.9.0.b后写回，
+//   内核就像收到了从10.9.1.a发来的包；回复走同样的路径换回原来的地址，所以连接10.9.1.1:PORT就是连接本机的服务器
+//   两个地址同时一个加256、一个减256，IP头和TCP/UDP的校验和都不用重新计算
+//   例: ./poll_serverTCP poll 1 framed  +  ./lossy_relay tun 1 0  +  ./reliable_bench tcp 10.9.1.1 8080
+
+const int DEFAULT_LISTEN_PORT = 9090;
+const int DEFAULT_TARGET_PORT = 8080;
+const int MAX_PACKET = 65536;
+
+volatile sig_atomic_t stop_relay = 0;
+void sigint_handle(int){
+    stop_relay = 1;
+}
+
+// 等待转发的数据报
+struct Delayed {
+    uint64_t due_ms;
+    int fd;
+    sockaddr_in to;  // sin_family为0时fd已经connect或者是TUN设备，直接write
+    std::string data;
+};
+
+class Relay {
+public:
+    Relay(double loss, uint64_t delay_ms) : loss_(loss / 100.0), delay_ms_(delay_ms), rng_(std::random_device{}()) {}
+
+    // 按丢包率决定是否丢弃；不丢弃时排入延迟队列
+    void forward(int fd, const sockaddr_in* to, const char* data, size_t len){
+        ++total_;
+        if (dist_(rng_) < loss_){
+            ++dropped_;
+            return;
+        }
+        Delayed d{TimerWheel::clock_ms() + delay_ms_, fd, sockaddr_in{}, std::string(data, len)};
+        if (to) d.to = *to;
+        queue_.push_back(std::move(d));
+    }
+
+    // 发出所有到期的数据报
+    void flush(){
+        uint64_t now = TimerWheel::clock_ms();
+        while(!queue_.empty() && queue_.front().due_ms <= now){
+            Delayed& d = queue_.front();
+            ssize_t n;
+            if (d.to.sin_family) n = sendto(d.fd, d.data.data(), d.data.size(), 0, (struct sockaddr*)&d.to, sizeof(d.to));
+            else n = write(d.fd, d.data.data(), d.data.size());
+            if (n < 0 && errno != ECONNREFUSED) perror("Forward failed");
+            queue_.pop_front();
+        }
+    }
+
+    // 距离下一个数据报到期的毫秒数，队列为空时返回-1
+    int next_timeout() const {
+        if (queue_.empty()) return -1;
+        uint64_t now = TimerWheel::clock_ms();
+        return queue_.front().due_ms <= now ? 0 : static_cast<int>(queue_.front().due_ms - now);
+    }
+
+    uint64_t total() const { return total_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    double loss_;
+    uint64_t delay_ms_;
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> dist_{0.0, 1.0};
+    std::deque<Delayed> queue_;
+    uint64_t total_ = 0, dropped_ = 0;
+};
+
+// UDP中继：客户端 <-> listen_port <-> 每客户端一个upstream socket <-> 127.0.0.1:target_port
+static int run_udp(Relay& relay, int listen_port, int target_port){
+    int listen_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_fd < 0){
+        perror("Socket creation failed!");
+        return -1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listen_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("Bind Failed!");
+        close(listen_fd);
+        return -1;
+    }
+    sockaddr_in target{};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(target_port);
+    target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::cout << "[INFO] " << "UDP中继 127.0.0.1:" << listen_port << " -> 127.0.0.1:" << target_port << std::endl;
+
+    // 客户端地址(ip<<16|port) -> upstream socket，fds与clients下标对应
+    std::unordered_map<uint64_t, int> upstream;
+    std::vector<pollfd> fds{{listen_fd, POLLIN, 0}};
+    std::vector<sockaddr_in> clients{sockaddr_in{}};
+    std::vector<char> buf(MAX_PACKET);
+
+    while(!stop_relay){
+        int ready = poll(fds.data(), fds.size(), relay.next_timeout());
+        if (ready < 0){
+            if (errno != EINTR) perror("Poll failed!");
+            continue;
+        }
+        if (fds[0].revents & POLLIN){
+            sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(listen_fd, buf.data(), buf.size(), MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+            if (n >= 0){
+                uint64_t key = (static_cast<uint64_t>(from.sin_addr.s_addr) << 16) | from.sin_port;
+                auto it = upstream.find(key);
+                if (it == upstream.end()){
+                    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+                    if (fd < 0 || connect(fd, (struct sockaddr*)&target, sizeof(target)) < 0){
+                        perror("Upstream socket failed!");
+                        if (fd >= 0) close(fd);
+                        continue;
+                    }
+                    it = upstream.emplace(key, fd).first;
+                    fds.push_back({fd, POLLIN, 0});
+                    clients.push_back(from);
+                }
+                relay.forward(it->second, nullptr, buf.data(), n);
+            }
+        }
+        for(size_t i = 1; i < fds.size(); ++i){
+            if (!(fds[i].revents & POLLIN)) continue;
+            ssize_t n = recv(fds[i].fd, buf.data(), buf.size(), MSG_DONTWAIT);
+            if (n >= 0) relay.forward(listen_fd, &clients[i], buf.data(), n);
+        }
+        relay.flush();
+    }
+
+    for(auto& p : fds) close(p.fd);
+    return 0;
+}
+
+#ifdef __linux__
+// 创建并配置TUN设备，失败返回-1
+static int open_tun(const char* name){
+    int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if (fd < 0){
+        perror("Open /dev/net/tun failed!");
+        return -1;
+    }
+    ifreq ifr{};
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0){
+        perror("TUNSETIFF failed!");
+        close(fd);
+        return -1;
+    }
+
+    // 地址10.9.0.1/23：10.9.1.0/24也在这个网段里，发往它的包直接进入TUN设备
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    auto set_addr = [&ifr](unsigned long req, const char* ip, int sock) {
+        sockaddr_in* a = reinterpret_cast<sockaddr_in*>(&ifr.ifr_addr);
+        a->sin_family = AF_INET;
+        inet_pton(AF_INET, ip, &a->sin_addr);
+        return ioctl(sock, req, &ifr) == 0;
+    };
+    bool ok = set_addr(SIOCSIFADDR, "10.9.0.1", sock) && set_addr(SIOCSIFNETMASK, "255.255.254.0", sock);
+    if (ok){
+        ok = ioctl(sock, SIOCGIFFLAGS, &ifr) == 0;
+        ifr.ifr_flags |= IFF_UP | IFF_RUNNING;
+        ok = ok && ioctl(sock, SIOCSIFFLAGS, &ifr) == 0;
+    }
+    close(sock);
+    if (!ok){
+        perror("Configure TUN device failed!");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// TUN中继：交换10.9.0.x和10.9.1.x两个网段，在IP层丢包
+static int run_tun(Relay& relay){
+    int tun_fd = open_tun("lossy0");
+    if (tun_fd < 0) return -1;
+    std::cout << "[INFO] " << "TUN中继 lossy0 10.9.0.1/23，连接10.9.1.1即经过中继连接本机" << std::endl;
+
+    std::vector<char> buf(MAX_PACKET);
+    pollfd pfd{tun_fd, POLLIN, 0};
+    while(!stop_relay){
+        int ready = poll(&pfd, 1, relay.next_timeout());
+        if (ready < 0){
+            if (errno != EINTR) perror("Poll failed!");
+            continue;
+        }
+        if (pfd.revents & POLLIN){
+            ssize_t n = read(tun_fd, buf.data(), buf.size());
+            unsigned char* ip = reinterpret_cast<unsigned char*>(buf.data());
+            // 只处理IPv4、源为10.9.0.x、目的为10.9.1.x的包，其余(比如IPv6邻居发现)丢掉
+            if (n >= 20 && (ip[0] >> 4) == 4 &&
+                ip[12] == 10 && ip[13] == 9 && ip[14] == 0 &&
+                ip[16] == 10 && ip[17] == 9 && ip[18] == 1){
+                ip[14] = 1;
+                ip[18] = 0;
+                relay.forward(tun_fd, nullptr, buf.data(), n);
+            }
+        }
+        relay.flush();
+    }
+    close(tun_fd);
+    return 0;
+}
+#endif
+
+int main(int argc, char* argv[]){
+    std::string mode = argc > 1 ? argv[1] : "udp";
+    if (mode != "udp" && mode != "tun"){
+        std::cerr << "[ERROR] " << "未知模式: " << mode << "，用法: " << argv[0]
+                  << " udp [loss%] [delay_ms] [listen_port] [target_port] | tun [loss%] [delay_ms]" << std::endl;
+        return -1;
+    }
+    double loss = argc > 2 ? std::stod(argv[2]) : 1.0;
+    uint64_t delay_ms = argc > 3 ? std::stoull(argv[3]) : 0;
+
+    struct sigaction sa{};
+    sa.sa_handler = sigint_handle;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    Relay relay(loss, delay_ms);
+    std::cout << "[INFO] " << "丢包率 " << loss << "%，单向延迟 " << delay_ms << " ms" << std::endl;
+    int ret;
+    if (mode == "udp"){
+        int listen_port = argc > 4 ? std::stoi(argv[4]) : DEFAULT_LISTEN_PORT;
+        int target_port = argc > 5 ? std::stoi(argv[5]) : DEFAULT_TARGET_PORT;
+        ret = run_udp(relay, listen_port, target_port);
+    }
+    else {
+#ifdef __linux__
+        ret = run_tun(relay);
+#else
+        std::cerr << "[ERROR] " << "当前平台不支持TUN设备" << std::endl;
+        ret = -1;
+#endif
+    }
+    std::cout << "[INFO] " << "转发 " << relay.total() << " 个，丢弃 " << relay.dropped() << " 个" << std::endl;
+    return ret;
+}
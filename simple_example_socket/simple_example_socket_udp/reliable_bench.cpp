@@ -0,0 +1,242 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <sys/socket.h> // 核心Socket API
+#include <netinet/in.h> // Internet地址结构: struct sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <arpa/inet.h> // IP地址转换: inet_pton
+#include <unistd.h> // POSIX系统服务 close()
+#include <poll.h>
+#include "../../common/udp_batch.hpp"
+#include "../../common/reliable_udp.hpp"
+#include "../../common/timer_wheel.hpp"
+#include "../../common/frame_codec.hpp"  // TCP模式的长度前缀分帧
+
+// 请求/回复延迟压测：可靠UDP与TCP在丢包下的对比
+// 保持depth个未完成的请求，每收到一个回复(按发送顺序对应最早的请求)就发下一个，统计每个请求的往返时间分布
+//
+// 用法: ./reliable_bench udp|tcp [host] [port] [requests] [size] [depth]
+//   udp: ReliableChannel客户端，对应 ./server_socketUdp reliable
+//   tcp: varint长度前缀分帧的TCP客户端(TCP_NODELAY)，对应 ./poll_serverTCP poll 1 framed
+// 编译: g++ -std=c++17 -O2 reliable_bench.cpp -o reliable_bench
+//
+// 丢包对比(lossy_relay的两种模式都在两个方向上按同样的概率丢包):
+//   ./server_socketUdp reliable       ./lossy_relay udp 1     ./reliable_bench udp 127.0.0.1 9090
+//   ./poll_serverTCP poll 1 framed    ./lossy_relay tun 1     ./reliable_bench tcp 10.9.1.1 8080
+//   (tun模式下可靠UDP也可以用 ./reliable_bench udp 10.9.1.1 8080，两者经过完全相同的丢包路径)
+
+const int NO_REPLY_TIMEOUT_MS = 5000;  // 这么久没有任何回复时认为服务器不可达
+
+using bench_clock = std::chrono::steady_clock;
+
+struct LatencyStats {
+    std::vector<double> samples_us;
+
+    void add(bench_clock::time_point sent, bench_clock::time_point now){
+        samples_us.push_back(std::chrono::duration<double, std::micro>(now - sent).count());
+    }
+
+    double percentile(double p){
+        if (samples_us.empty()) return 0;
+        size_t k = static_cast<size_t>(p / 100.0 * (samples_us.size() - 1));
+        std::nth_element(samples_us.begin(), samples_us.begin() + k, samples_us.end());
+        return samples_us[k];
+    }
+};
+
+// 连接到host:port的socket，失败返回-1
+static int connect_to(const char* host, int port, int type){
+    int sock = socket(AF_INET, type, 0);
+    if (sock < 0){
+        perror("Socket Creation Failed!");
+        return -1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0){
+        perror("Invalid address or address not supported");
+        close(sock);
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("Connect failed!");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 可靠UDP：poll的超时取ReliableChannel的下一次重传时间
+static bool run_udp(const char* host, int port, size_t requests, const std::string& payload, unsigned depth,
+                    LatencyStats& stats, uint64_t& retransmits){
+    int sock = connect_to(host, port, SOCK_DGRAM);
+    if (sock < 0) return false;
+
+    std::mt19937 rng(std::random_device{}());
+    uint32_t conn_id = std::uniform_int_distribution<uint32_t>(1, UINT32_MAX)(rng);
+    ReliableChannel channel(conn_id);
+    UdpRecvBatch in(64);
+    UdpSendBatch out(64);
+
+    std::deque<bench_clock::time_point> inflight;
+    size_t sent = 0;
+    auto send_next = [&]() {
+        if (sent == requests) return;
+        channel.send(payload.data(), payload.size());
+        inflight.push_back(bench_clock::now());
+        ++sent;
+    };
+    for(unsigned i = 0; i < depth; ++i) send_next();
+
+    uint64_t last_reply = TimerWheel::clock_ms();
+    bool ok = true;
+    while(stats.samples_us.size() < requests){
+        uint64_t now = TimerWheel::clock_ms();
+        channel.flush(now, [&out](const char* data, size_t len) { out.add(data, len); });
+        out.flush(sock);
+        if (channel.failed()){
+            std::cerr << "[ERROR] " << "重传次数过多，服务器不可达" << std::endl;
+            ok = false;
+            break;
+        }
+        if (now - last_reply > NO_REPLY_TIMEOUT_MS){
+            std::cerr << "[ERROR] " << NO_REPLY_TIMEOUT_MS << " ms没有收到回复" << std::endl;
+            ok = false;
+            break;
+        }
+
+        int timeout = channel.next_timeout(now);
+        if (timeout < 0 || timeout > NO_REPLY_TIMEOUT_MS) timeout = NO_REPLY_TIMEOUT_MS;
+        pollfd pfd{sock, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) <= 0) continue;
+
+        int n = in.recv(sock, MSG_DONTWAIT);
+        now = TimerWheel::clock_ms();
+        for(int i = 0; i < n; ++i){
+            channel.on_packet(in.data(i), in.len(i), now, [&](const char*, size_t) {
+                stats.add(inflight.front(), bench_clock::now());
+                inflight.pop_front();
+                last_reply = now;
+                send_next();
+            });
+        }
+    }
+    // 把最后的确认发出去，服务器不用再重传最后的回复
+    channel.flush(TimerWheel::clock_ms(), [&out](const char* data, size_t len) { out.add(data, len); });
+    out.flush(sock);
+    retransmits = channel.retransmits();
+    close(sock);
+    return ok;
+}
+
+// TCP：每个请求一帧，回复逐帧解析
+static bool run_tcp(const char* host, int port, size_t requests, const std::string& payload, unsigned depth,
+                    LatencyStats& stats){
+    int sock = connect_to(host, port, SOCK_STREAM);
+    if (sock < 0) return false;
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    char header[FrameDecoder::MAX_VARINT];
+    size_t header_len = encode_varint(static_cast<uint32_t>(payload.size()), header);
+    std::string frame = std::string(header, header_len) + payload;
+
+    std::deque<bench_clock::time_point> inflight;
+    size_t sent = 0;
+    std::string pending;  // 这一轮要发的请求，合并成一次send
+    auto send_next = [&]() {
+        if (sent == requests) return;
+        pending += frame;
+        inflight.push_back(bench_clock::now());
+        ++sent;
+    };
+    auto flush = [&]() {
+        size_t off = 0;
+        while(off < pending.size()){
+            ssize_t n = send(sock, pending.data() + off, pending.size() - off, 0);
+            if (n < 0){
+                if (errno == EINTR) continue;
+                perror("Send Failed");
+                return false;
+            }
+            off += static_cast<size_t>(n);
+        }
+        pending.clear();
+        return true;
+    };
+    for(unsigned i = 0; i < depth; ++i) send_next();
+
+    ConnBuffer in;
+    FrameDecoder decoder;
+    bool ok = flush();
+    while(ok && stats.samples_us.size() < requests){
+        pollfd pfd{sock, POLLIN, 0};
+        int ready = poll(&pfd, 1, NO_REPLY_TIMEOUT_MS);
+        if (ready == 0){
+            std::cerr << "[ERROR] " << NO_REPLY_TIMEOUT_MS << " ms没有收到回复" << std::endl;
+            ok = false;
+            break;
+        }
+        if (ready < 0) continue;
+        ssize_t n = in.read_from(sock);
+        if (n <= 0){
+            if (n < 0 && errno == EINTR) continue;
+            perror("Connection closed");
+            ok = false;
+            break;
+        }
+        std::string_view reply;
+        while(decoder.next(in, reply) == FrameDecoder::FRAME){
+            stats.add(inflight.front(), bench_clock::now());
+            inflight.pop_front();
+            send_next();
+        }
+        in.shrink();
+        ok = flush();
+    }
+    close(sock);
+    return ok;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode = argc > 1 ? argv[1] : "udp";
+    if (mode != "udp" && mode != "tcp"){
+        std::cerr << "[ERROR] " << "未知模式: " << mode << "，用法: " << argv[0]
+                  << " udp|tcp [host] [port] [requests] [size] [depth]" << std::endl;
+        return -1;
+    }
+    const char* host = argc > 2 ? argv[2] : "127.0.0.1";
+    int port = argc > 3 ? std::stoi(argv[3]) : 8080;
+    size_t requests = argc > 4 ? std::stoul(argv[4]) : 20000;
+    size_t size = argc > 5 ? std::stoul(argv[5]) : 64;
+    unsigned depth = argc > 6 ? std::stoul(argv[6]) : 1;
+    if (depth == 0) depth = 1;
+    if (mode == "udp" && size > ReliableChannel::MAX_PAYLOAD){
+        std::cerr << "[ERROR] " << "可靠UDP的消息最长 " << ReliableChannel::MAX_PAYLOAD << " 字节" << std::endl;
+        return -1;
+    }
+
+    std::string payload(size, 'x');
+    LatencyStats stats;
+    stats.samples_us.reserve(requests);
+    uint64_t retransmits = 0;
+    auto start = bench_clock::now();
+    bool ok = mode == "udp" ? run_udp(host, port, requests, payload, depth, stats, retransmits)
+                            : run_tcp(host, port, requests, payload, depth, stats);
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    std::cout << "[INFO] " << mode << " " << host << ":" << port << "，请求 " << stats.samples_us.size() << "/" << requests
+              << "，大小 " << size << "，并发 " << depth << "，" << static_cast<uint64_t>(stats.samples_us.size() / elapsed)
+              << " 请求/s" << std::endl;
+    if (mode == "udp") std::cout << "[INFO] " << "客户端重传 " << retransmits << " 次" << std::endl;
+    std::cout << "[INFO] " << "延迟(us): p50 " << stats.percentile(50) << "  p90 " << stats.percentile(90)
+              << "  p99 " << stats.percentile(99) << "  p99.9 " << stats.percentile(99.9)
+              << "  max " << stats.percentile(100) << std::endl;
+    return ok ? 0 : -1;
+}
@@ -4,13 +4,66 @@
 #include <netinet/in.h> // Internet地址结构: struct sockaddr_in
 #include <arpa/inet.h> // IP地址转换: inet_pton
 #include <unistd.h> // POSIX系统服务 close(), read(), write() sleep(), getpid()
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+#include <tuple>
+#include <poll.h>
+#ifdef __linux__
+#include <linux/filter.h> // SO_ATTACH_REUSEPORT_CBPF
+#endif
+#include "../../common/udp_batch.hpp"
+#include "../../common/cpu_affinity.hpp"  // 线程绑核
+#include "../../common/timer_wheel.hpp"
+#include "../../common/reliable_udp.hpp"
 
+// 用法: ./server_socketUdp [simple|batch|gso|reliable] [N] [threads]
+//   simple : 每次recvfrom收一个数据报，打印后用sendto回复一个
+//   batch  : 每次recvmmsg最多收N个数据报(默认64)到预先分配的槽位中，整批用sendmmsg回复，
+//            不清零缓冲区也不逐包打印，每秒输出一次收包速率(pps)
+//   gso    : 在batch的基础上开启UDP_GRO，每个槽位收到的可能是同一个客户端的多个数据报合并成的缓冲区，
+//            按控制消息里的段长切分后逐个处理；给同一个客户端的多个回复用一个UDP_SEGMENT消息发出
+//            (Linux 5.0以上，内核不支持时回退到batch)
+//   reliable: 可靠有序的请求/回复(见common/reliable_udp.hpp)，每个客户端按连接id对应一个ReliableChannel，
+//            按顺序交付的每个请求回复一个消息；重传定时器和空闲超时放在时间轮里，poll的超时取最近的定时器
+//   threads: 工作线程数(默认1，0表示CPU核数)
+//            大于1时每个线程绑定一个CPU，各自拥有一个SO_REUSEPORT的UDP socket和独立的收发循环，
+//            由内核按四元组哈希把数据报分给各个socket；Linux下再给这组socket挂一个按收包CPU选择socket的
+//            BPF程序，在第i个CPU上收到的数据报交给绑定在第i个CPU上的线程，整个处理过程不跨核
+// 压测: ./udp_bench [seconds] [batch] [window] [size] [flows]
+//       ./reliable_bench udp|tcp ... (可靠模式与TCP服务器在丢包下的延迟对比)
 
 const int PORT = 8080;
 const int BUFFER_SIZE = 1024;
+const unsigned DEFAULT_BATCH = 64;
+const uint64_t RELIABLE_IDLE_TIMEOUT_MS = 30 * 1000;  // reliable模式下客户端这么久没有数据报时丢弃它的状态
 
+static const char RESPONSE[] = "Hello from UDP server";
+static const size_t RESPONSE_LEN = sizeof(RESPONSE) - 1;
 
-int main(){
+// gso模式下连续存放的UDP_GSO_MAX_SEGMENTS个回复，一个GSO消息直接引用它的前k段
+static const std::string RESPONSE_TRAIN = [] {
+    std::string train;
+    for(unsigned i = 0; i < UDP_GSO_MAX_SEGMENTS; ++i) train.append(RESPONSE, RESPONSE_LEN);
+    return train;
+}();
+
+// 多个线程的输出按行加锁，避免交错
+static std::mutex cout_mtx;
+
+static void print_line(const std::string& line){
+    std::lock_guard<std::mutex> lock(cout_mtx);
+    std::cout << line << std::endl;
+}
+
+// 创建绑定到PORT的UDP socket，失败返回-1
+// reuse_port为true时设置SO_REUSEPORT，允许多个socket绑定同一端口
+static int create_udp_socket(bool reuse_port){
     // 1. 创建UDP嵌套字
     int server_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (server_fd == -1){
@@ -25,9 +78,14 @@ int main(){
         close(server_fd);
         return -1;
     }
+    if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))){
+        perror("Setsockopt SO_REUSEPORT failed!");
+        close(server_fd);
+        return -1;
+    }
 
     // 3. 绑定地址和端口
-    sockaddr_in address; // IPv4地址容器
+    sockaddr_in address{}; // IPv4地址容器
     address.sin_family = AF_INET;
     address.sin_port = htons(PORT);
     address.sin_addr.s_addr = INADDR_ANY;
@@ -37,11 +95,31 @@ int main(){
         close(server_fd);
         return -1;
     }
+    return server_fd;
+}
 
-    std::cout << "PID:" << getpid() << std::endl;
-    std::cout << "UDP server listening port:" << PORT << " ..." << std::endl;
+// 给SO_REUSEPORT组挂一个BPF程序：返回收包的CPU编号作为组内socket的下标
+// 组内socket按创建顺序编号，第i个socket由绑定在第i个CPU上的线程处理；
+// 返回的下标超过socket个数时(线程数少于CPU数)内核退回到默认的四元组哈希
+// 只需要挂在组内任意一个socket上，所有socket都bind之后调用
+static bool attach_cpu_steering(int server_fd){
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU) },  // A = 当前CPU
+        { BPF_RET | BPF_A, 0, 0, 0 },                                                    // return A
+    };
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    return setsockopt(server_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+#else
+    (void)server_fd;
+    return false;
+#endif
+}
 
-    // 4. 数据交互
+// 逐个数据报的收发循环
+static void run_simple(int server_fd){
     char buffer[BUFFER_SIZE] = {0};
     sockaddr_in client_addr;
     int client_addr_len = sizeof(client_addr);
@@ -50,30 +128,308 @@ int main(){
         // 缓冲区清空
         memset(buffer, 0, BUFFER_SIZE);
 
-        // 接收客户端消息
-        ssize_t len = recvfrom(server_fd, buffer, BUFFER_SIZE, 0,
+        // 接收客户端消息，留一个字节给字符串结束符
+        client_addr_len = sizeof(client_addr);
+        ssize_t len = recvfrom(server_fd, buffer, BUFFER_SIZE - 1, 0,
                             (struct sockaddr*)&client_addr, (socklen_t*)&client_addr_len);
         if (len < 0){
             perror("Recefrom failed!");
             continue;
         }
-        std::cout << "len = " << len << std::endl;
         buffer[len] = '\0'; // 添加字符串结束符
 
         char client_ip[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        std::cout << "Received from " << client_ip << ":" << ntohs(client_addr.sin_port) 
-                << " : " << buffer << std::endl;
+        std::ostringstream line;
+        line << "len = " << len << "\n"
+             << "Received from " << client_ip << ":" << ntohs(client_addr.sin_port) << " : " << buffer;
+        print_line(line.str());
 
         // 发送响应
-        const char* response = "Hello from UDP server";
-        sendto(server_fd, response, strlen(response), 0,
+        sendto(server_fd, RESPONSE, sizeof(RESPONSE) - 1, 0,
                 (struct sockaddr*)&client_addr, client_addr_len);
     }
+}
+
+// 批量模式的收发循环，id为线程编号，用于区分每个线程的统计输出
+// gso为true时socket已开启UDP_GRO：槽位按64KB分配，每个槽位按段长切分，回复合并成GSO消息
+static void run_batch(int server_fd, unsigned batch, unsigned id, bool gso){
+    UdpRecvBatch in(batch, gso ? UdpRecvBatch::GRO_SLOT_SIZE : UdpRecvBatch::DEFAULT_SLOT_SIZE, gso);
+    UdpSendBatch out(batch);
+
+    // 加大接收缓冲区，吸收突发的数据报(实际上限受net.core.rmem_max限制)
+    int rcvbuf = 4 * 1024 * 1024;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0){
+        perror("Setsockopt SO_RCVBUF failed!");
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto last_report = clock::now();
+    uint64_t packets = 0, bytes = 0, replies = 0, syscalls = 0, send_failed = 0;
+    // 发出排队的回复，记录没发出去的消息数
+    auto flush_out = [&out, &send_failed, server_fd]() {
+        unsigned queued = out.size();
+        send_failed += queued - out.flush(server_fd);
+    };
+
+    while(true){
+        int n = in.recv(server_fd);
+        if (n < 0){
+            if (errno != EINTR) perror("Recvmmsg failed!");
+            continue;
+        }
+        ++syscalls;
+
+        // 处理：每个数据报回复一个固定的响应，回复直接指向常量，目标地址从接收槽位拷贝
+        // 一个槽位里的k个数据报来自同一个客户端，它们的k个回复作为一个GSO消息发出
+        for(unsigned i = 0; i < in.size(); ++i){
+            bytes += in.len(i);
+            unsigned segments = in.segments(i);
+            packets += segments;
+            while(segments > 0){
+                unsigned k = segments < UDP_GSO_MAX_SEGMENTS ? segments : UDP_GSO_MAX_SEGMENTS;
+                if (out.full()) flush_out();
+                out.add(in.addr(i), RESPONSE_TRAIN.data(), k * RESPONSE_LEN, RESPONSE_LEN);
+                segments -= k;
+                replies += k;
+            }
+        }
+        flush_out();
+
+        auto now = clock::now();
+        double secs = std::chrono::duration<double>(now - last_report).count();
+        if (secs >= 1.0){
+            std::ostringstream line;
+            line << "[INFO] " << "线程 " << id << ": " << static_cast<uint64_t>(packets / secs) << " pps, "
+                 << static_cast<uint64_t>(bytes / secs / 1024) << " KB/s, 回复 " << replies
+                 << ", 平均每次recvmmsg " << (syscalls ? static_cast<double>(packets) / syscalls : 0)
+                 << " 个数据报";
+            if (send_failed) line << ", 发送失败 " << send_failed << " 个消息";
+            print_line(line.str());
+            last_report = now;
+            packets = bytes = replies = syscalls = send_failed = 0;
+        }
+    }
+}
+
+// reliable模式下的一个客户端
+// 按连接id而不是地址区分客户端，客户端换了地址(比如NAT重新映射了端口)时连接仍然有效，回复发到最新的地址
+// 服务器一侧的通道是被动方：空闲超时丢弃状态后，客户端继续发送的消息在新的通道上从原来的序号接着交付
+struct ReliablePeer {
+    ReliablePeer(const sockaddr_in& a, uint32_t conn_id) : addr(a), channel(conn_id, passive_options()) {}
+
+    sockaddr_in addr;
+    ReliableChannel channel;
+    TimerWheel::TimerId retransmit_timer = TimerWheel::INVALID_TIMER;
+    TimerWheel::TimerId idle_timer = TimerWheel::INVALID_TIMER;
+    bool dirty = false;  // 本轮收到了数据报或重传定时器到期，需要flush
+
+    static ReliableOptions passive_options(){
+        ReliableOptions opt;
+        opt.passive = true;
+        return opt;
+    }
+};
+
+// 时间轮定时器的data: 连接id和定时器种类
+static uint64_t peer_timer_data(uint32_t conn_id, bool idle){
+    return (static_cast<uint64_t>(conn_id) << 1) | (idle ? 1 : 0);
+}
+
+// 可靠模式的收发循环：一批数据报交给各自的ReliableChannel，再统一flush，所有回复一次sendmmsg发出
+static void run_reliable(int server_fd, unsigned batch, unsigned id){
+    UdpRecvBatch in(batch);
+    UdpSendBatch out(batch);
+    std::unordered_map<uint32_t, ReliablePeer> peers;
+    TimerWheel timers;
+    std::vector<ReliablePeer*> dirty;
+    std::vector<uint32_t> failed;
+    std::vector<uint32_t> expired;
+
+    using clock = std::chrono::steady_clock;
+    auto last_report = clock::now();
+    uint64_t packets = 0, messages = 0, retransmits = 0;
+
+    auto mark_dirty = [&dirty](ReliablePeer& peer) {
+        if (peer.dirty) return;
+        peer.dirty = true;
+        dirty.push_back(&peer);
+    };
+
+    pollfd pfd{server_fd, POLLIN, 0};
+    while(true){
+        int ready = poll(&pfd, 1, timers.next_timeout());
+        if (ready < 0 && errno != EINTR){
+            perror("Poll failed!");
+            continue;
+        }
+        uint64_t now = TimerWheel::clock_ms();
+
+        if (ready > 0 && (pfd.revents & POLLIN)){
+            int n = in.recv(server_fd, MSG_DONTWAIT);
+            for(int i = 0; i < n; ++i){
+                uint32_t conn_id;
+                if (!ReliableChannel::parse_conn_id(in.data(i), in.len(i), conn_id)) continue;  // 不是本协议的数据报
+                auto it = peers.find(conn_id);
+                if (it == peers.end()){
+                    it = peers.emplace(std::piecewise_construct, std::forward_as_tuple(conn_id),
+                                       std::forward_as_tuple(in.addr(i), conn_id)).first;
+                    it->second.idle_timer = timers.add(RELIABLE_IDLE_TIMEOUT_MS, peer_timer_data(conn_id, true), now);
+                }
+                else {
+                    timers.reset(it->second.idle_timer, RELIABLE_IDLE_TIMEOUT_MS, now);
+                }
+                ReliablePeer& peer = it->second;
+                peer.addr = in.addr(i);
+                ++packets;
+                // 每个按顺序交付的请求回复一个消息
+                peer.channel.on_packet(in.data(i), in.len(i), now, [&peer, &messages](const char*, size_t) {
+                    ++messages;
+                    peer.channel.send(RESPONSE, RESPONSE_LEN);
+                });
+                mark_dirty(peer);
+            }
+        }
+
+        // 空闲超时的客户端记下来，等本轮的回复发出后再丢弃状态(它可能已经在dirty中)；重传定时器到期时flush
+        timers.advance(now, [&](TimerWheel::TimerId, uint64_t data) {
+            auto it = peers.find(static_cast<uint32_t>(data >> 1));
+            if (it == peers.end()) return;
+            ReliablePeer& peer = it->second;
+            if (data & 1){
+                peer.idle_timer = TimerWheel::INVALID_TIMER;
+                expired.push_back(it->first);
+                return;
+            }
+            peer.retransmit_timer = TimerWheel::INVALID_TIMER;
+            mark_dirty(peer);
+        });
+
+        for(ReliablePeer* peer : dirty){
+            peer->dirty = false;
+            uint64_t before = peer->channel.retransmits();
+            peer->channel.flush(now, [&](const char* data, size_t len) {
+                if (out.full()) out.flush(server_fd);
+                out.add(peer->addr, data, len);
+            });
+            retransmits += peer->channel.retransmits() - before;
+            if (peer->channel.failed()){
+                failed.push_back(peer->channel.conn_id());
+                continue;
+            }
+            // 按ReliableChannel下一次需要flush的时间重新设置重传定时器
+            int timeout = peer->channel.next_timeout(now);
+            if (timeout < 0){
+                timers.cancel(peer->retransmit_timer);
+                peer->retransmit_timer = TimerWheel::INVALID_TIMER;
+            }
+            else if (!timers.reset(peer->retransmit_timer, timeout, now)){
+                peer->retransmit_timer = timers.add(timeout, peer_timer_data(peer->channel.conn_id(), false), now);
+            }
+        }
+        dirty.clear();
+        out.flush(server_fd);
+
+        // 回复都发出去之后才能释放失败和空闲超时的连接，排队的数据报引用着它们的缓冲区
+        for(uint32_t conn_id : expired){
+            auto it = peers.find(conn_id);
+            if (it == peers.end()) continue;
+            timers.cancel(it->second.retransmit_timer);
+            peers.erase(it);
+        }
+        expired.clear();
+        for(uint32_t conn_id : failed){
+            auto it = peers.find(conn_id);
+            if (it == peers.end()) continue;
+            print_line("[ERROR] 线程 " + std::to_string(id) + ": 连接 " + std::to_string(conn_id) + " 重传次数过多，已断开");
+            timers.cancel(it->second.retransmit_timer);
+            timers.cancel(it->second.idle_timer);
+            peers.erase(it);
+        }
+        failed.clear();
+
+        auto tick = clock::now();
+        double secs = std::chrono::duration<double>(tick - last_report).count();
+        if (secs >= 1.0 && packets > 0){
+            std::ostringstream line;
+            line << "[INFO] " << "线程 " << id << ": " << static_cast<uint64_t>(packets / secs) << " pps, "
+                 << static_cast<uint64_t>(messages / secs) << " 请求/s, 重传 " << retransmits
+                 << ", 客户端 " << peers.size();
+            print_line(line.str());
+            last_report = tick;
+            packets = messages = retransmits = 0;
+        }
+    }
+}
+
+int main(int argc, char* argv[]){
+    std::string mode = argc > 1 ? argv[1] : "simple";
+    if (mode != "simple" && mode != "batch" && mode != "gso" && mode != "reliable"){
+        std::cerr << "[ERROR] " << "未知模式: " << mode << "，用法: " << argv[0] << " [simple|batch|gso|reliable] [N] [threads]" << std::endl;
+        return -1;
+    }
+    unsigned batch = argc > 2 ? std::stoul(argv[2]) : DEFAULT_BATCH;
+    if (batch == 0) batch = 1;
+    unsigned threads = argc > 3 ? std::stoul(argv[3]) : 1;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // 先创建并绑定所有socket，任何一个失败都直接退出
+    bool reuse_port = threads > 1;
+    std::vector<int> fds;
+    for(unsigned i = 0; i < threads; ++i){
+        int server_fd = create_udp_socket(reuse_port);
+        if (server_fd < 0){
+            for(int fd : fds) close(fd);
+            return -1;
+        }
+        fds.push_back(server_fd);
+    }
+    // 线程数超过CPU数时，多出来的socket按CPU分发永远收不到数据报，只用默认的哈希分发
+    if (reuse_port && threads <= std::thread::hardware_concurrency() && !attach_cpu_steering(fds[0])){
+        std::cerr << "[ERROR] " << "挂载按CPU分发的BPF程序失败，使用内核默认的哈希分发" << std::endl;
+    }
+    if (mode == "gso"){
+        for(int fd : fds){
+            if (!udp_gso_supported(fd) || !enable_udp_gro(fd)){
+                std::cerr << "[ERROR] " << "内核不支持UDP GSO/GRO，回退到batch模式" << std::endl;
+                mode = "batch";
+                break;
+            }
+        }
+    }
+
+    std::cout << "PID:" << getpid() << std::endl;
+    std::cout << "UDP server listening port:" << PORT << " ..." << std::endl;
+    if (mode == "reliable"){
+        std::cout << "[INFO] " << "可靠有序模式，每次系统调用最多 " << batch << " 个数据报" << std::endl;
+    }
+    else if (mode != "simple"){
+        std::cout << "[INFO] " << (mode == "gso" ? "GSO/GRO批量模式" : "批量模式") << "，每次系统调用最多 " << batch
+                  << (mode == "gso" ? " 个消息" : " 个数据报") << std::endl;
+    }
+    if (threads > 1){
+        std::cout << "[INFO] " << "工作线程数: " << threads << std::endl;
+    }
+
+    // 4. 数据交互：每个线程一个socket和一个收发循环，多于一个时绑定到各自的CPU
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < threads; ++i){
+        workers.emplace_back([&mode, &fds, batch, threads, i]() {
+            if (threads > 1 && !pin_current_thread(i)){
+                print_line("[ERROR] 线程 " + std::to_string(i) + " 绑定CPU失败");
+            }
+            if (mode == "simple") run_simple(fds[i]);
+            else if (mode == "reliable") run_reliable(fds[i], batch, i);
+            else run_batch(fds[i], batch, i, mode == "gso");
+        });
+    }
+    for(auto& t : workers){
+        t.join();
+    }
 
     // 5. 关闭连接
     // 注意：UDP服务器通常不会主动关闭，此处为示例完整性添加
-    close(server_fd);
+    for(int fd : fds) close(fd);
 
     return 0;
-}
\ No newline at end of file
+}
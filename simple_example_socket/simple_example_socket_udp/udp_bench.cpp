@@ -0,0 +1,181 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <sys/socket.h> // 核心Socket API
+#include <netinet/in.h> // Internet地址结构: struct sockaddr_in
+#include <arpa/inet.h> // IP地址转换: inet_pton
+#include <unistd.h> // POSIX系统服务 close()
+#include "../../common/udp_batch.hpp"
+
+// UDP收发速率(pps)压测
+// 向server_socketUdp连续发送数据报并接收回复，最多保持window个未收到回复的请求，
+// 超过窗口时等待回复，避免发送方把服务器的接收缓冲区打满造成大量丢包
+// 发送和接收都用sendmmsg/recvmmsg，每次最多batch个；batch为1时退化为每个数据报一次系统调用
+// 一段时间内收不到回复时，把仍未回复的请求计为丢失并重新打开窗口
+// flows个线程各用一个socket(源端口不同)同时压测，服务器的SO_REUSEPORT哈希会把它们分到不同的工作线程
+// 最后一个参数为gso时，每批数据报作为尽量少的UDP_SEGMENT消息发出(一个消息最多64段)，接收回复时开启UDP_GRO
+// 用法: ./udp_bench [seconds] [batch] [window] [size] [flows] [mmsg|gso]
+// 编译: g++ -std=c++17 -O2 -pthread udp_bench.cpp -o udp_bench
+//
+// 对比:
+//   ./server_socketUdp simple > /dev/null  与  ./udp_bench 5 1
+//   ./server_socketUdp batch 64            与  ./udp_bench 5 64
+//   ./server_socketUdp batch 64 0          与  ./udp_bench 5 64 256 64 4
+//   ./server_socketUdp gso 64              与  ./udp_bench 5 64 1024 1200 1 mmsg / gso  (大批量传输)
+
+const char* SERVER_IP = "127.0.0.1";
+const int PORT = 8080;
+const int LOSS_TIMEOUT_MS = 200;  // 等待回复超过这个时间，认为未回复的请求都已丢失
+
+struct FlowStats {
+    uint64_t sent = 0, received = 0, lost = 0, send_calls = 0, recv_calls = 0;
+    bool failed = false;
+};
+
+// 一条流：一个connect到服务器的socket，按窗口发送并接收回复，直到deadline
+static void run_flow(std::chrono::steady_clock::time_point deadline, unsigned batch, unsigned window, size_t size,
+                     bool gso, FlowStats& st){
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1){
+        perror("Socket Creation Failed!");
+        st.failed = true;
+        return;
+    }
+
+    sockaddr_in serv_addr{};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(PORT);
+    inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr.s_addr);
+    // connect之后发送不需要目标地址，也只会收到服务器的数据报
+    if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0){
+        perror("Connect failed!");
+        close(sock);
+        st.failed = true;
+        return;
+    }
+    timeval tv{0, LOSS_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (gso && !enable_udp_gro(sock)){
+        perror("Setsockopt UDP_GRO failed!");
+        close(sock);
+        st.failed = true;
+        return;
+    }
+
+    // 不用GSO时每个消息一个数据报；用GSO时一批数据报平分成尽量少的消息，每个消息per_msg段(最后一个可能更少)
+    unsigned per_msg = gso ? std::min(batch, udp_gso_max_segments(size)) : 1;
+    unsigned msgs = (batch + per_msg - 1) / per_msg;
+    std::vector<char> payload(size * per_msg, 'x');
+    UdpSendBatch out(msgs);
+    UdpRecvBatch in(batch, gso ? UdpRecvBatch::GRO_SLOT_SIZE : UdpRecvBatch::DEFAULT_SLOT_SIZE, gso);
+    uint64_t outstanding = 0;
+
+    // 收到的回复数：开启GRO时一个槽位可能是合并后的多个回复
+    auto replies = [&in]() {
+        uint64_t n = 0;
+        for(unsigned i = 0; i < in.size(); ++i) n += in.segments(i);
+        return n;
+    };
+
+    while(std::chrono::steady_clock::now() < deadline){
+        // 窗口内还有空间时发一批
+        if (outstanding + batch <= window){
+            for(unsigned left = batch; left > 0;){
+                unsigned k = std::min(left, per_msg);
+                out.add(payload.data(), k * size, gso ? size : 0);
+                left -= k;
+            }
+            unsigned n = out.flush(sock);
+            ++st.send_calls;
+            uint64_t datagrams = n == msgs ? batch : static_cast<uint64_t>(n) * per_msg;  // 有消息发送失败时按整段估计
+            st.sent += datagrams;
+            outstanding += datagrams;
+        }
+
+        // 窗口还没满时只取已经到达的回复，满了再阻塞等待
+        bool wait = outstanding + batch > window;
+        int n = in.recv(sock, wait ? MSG_WAITFORONE : MSG_DONTWAIT);
+        if (n > 0){
+            ++st.recv_calls;
+            uint64_t got = replies();
+            st.received += got;
+            outstanding = outstanding > got ? outstanding - got : 0;
+        }
+        else if (n < 0 && wait && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            st.lost += outstanding;
+            outstanding = 0;
+        }
+        else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+            perror("Recvmmsg failed!");  // 服务器没有启动时是ECONNREFUSED
+            st.failed = true;
+            break;
+        }
+    }
+
+    // 收掉还在路上的回复
+    while(outstanding > 0){
+        int n = in.recv(sock, MSG_WAITFORONE);
+        if (n <= 0) break;
+        ++st.recv_calls;
+        uint64_t got = replies();
+        st.received += got;
+        outstanding = outstanding > got ? outstanding - got : 0;
+    }
+    st.lost += outstanding;
+    close(sock);
+}
+
+int main(int argc, char* argv[]){
+    double seconds = argc > 1 ? std::stod(argv[1]) : 5;
+    unsigned batch = argc > 2 ? std::stoul(argv[2]) : 64;
+    unsigned window = argc > 3 ? std::stoul(argv[3]) : 256;
+    size_t size = argc > 4 ? std::stoul(argv[4]) : 64;
+    unsigned flows = argc > 5 ? std::stoul(argv[5]) : 1;
+    std::string mode = argc > 6 ? argv[6] : "mmsg";
+    if (mode != "mmsg" && mode != "gso"){
+        std::cerr << "[ERROR] " << "未知模式: " << mode << "，用法: " << argv[0]
+                  << " [seconds] [batch] [window] [size] [flows] [mmsg|gso]" << std::endl;
+        return -1;
+    }
+    bool gso = mode == "gso";
+    if (batch == 0) batch = 1;
+    if (window < batch) window = batch;
+    if (flows == 0) flows = 1;
+
+    std::cout << "[INFO] " << "压测 " << SERVER_IP << ":" << PORT << "，" << seconds << " 秒，batch=" << batch
+              << "，window=" << window << "，size=" << size << "，flows=" << flows << "，" << mode << std::endl;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+    std::vector<FlowStats> stats(flows);
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < flows; ++i){
+        threads.emplace_back(run_flow, deadline, batch, window, size, gso, std::ref(stats[i]));
+    }
+    for(auto& t : threads){
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    FlowStats total;
+    for(const FlowStats& st : stats){
+        total.sent += st.sent;
+        total.received += st.received;
+        total.lost += st.lost;
+        total.send_calls += st.send_calls;
+        total.recv_calls += st.recv_calls;
+        total.failed = total.failed || st.failed;
+    }
+    std::cout << "[INFO] " << "发送 " << total.sent << "，收到回复 " << total.received << "，丢失 " << total.lost << std::endl;
+    std::cout << "[INFO] " << "发送 " << static_cast<uint64_t>(total.sent / elapsed) << " pps ("
+              << static_cast<uint64_t>(total.sent * size / elapsed / (1024 * 1024)) << " MB/s)，回复 "
+              << static_cast<uint64_t>(total.received / elapsed) << " pps" << std::endl;
+    std::cout << "[INFO] " << "sendmmsg " << total.send_calls << " 次，recvmmsg " << total.recv_calls << " 次" << std::endl;
+    return total.failed ? -1 : 0;
+}